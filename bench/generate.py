@@ -0,0 +1,112 @@
+"""Synthetic converter inputs of a requested size.
+
+Each generator repeats a block of code with fresh names until the text
+reaches `size` bytes, so the type map and allocation tables grow with the
+input the way they do on real code.
+"""
+from __future__ import annotations
+
+from typing import Dict, Tuple
+
+_PRINTF_BLOCK = """\
+int report_{i}(int n{i}, double avg{i}, char tag{i}) {{
+    long total{i} = n{i} * 3;
+    printf("block {i}: n=%d avg=%f tag=%c\\n", n{i}, avg{i}, tag{i});
+    printf("  total=%ld (%d items)\\n", total{i}, n{i});
+    printf("  plain text line {i}\\n");
+    printf("Enter a value for {i}: ");
+    scanf("%d", &n{i});
+    return n{i};
+}}
+
+"""
+
+_COUT_BLOCK = """\
+int show_{i}(int n{i}, double avg{i}) {{
+    int count{i} = n{i} + 1;
+    double half{i} = avg{i} / 2;
+    std::cout << "block {i}: n=" << n{i} << " avg=" << avg{i} << std::endl;
+    std::cout << "  count=" << count{i} << ", half=" << half{i} << '\\n';
+    std::cout << "  plain text line {i}" << std::endl;
+    std::cin >> count{i};
+    return count{i};
+}}
+
+"""
+
+_ALLOC_BLOCK = """\
+struct Item{i} {{
+    int key;
+    struct Item{i}* next;
+}};
+
+int fill_{i}(int n) {{
+    int* values{i} = (int*)malloc(sizeof(int) * n);
+    double* weights{i} = calloc(n, sizeof(double));
+    struct Item{i}* head{i} = (struct Item{i}*)malloc(sizeof(struct Item{i}));
+    head{i}->next = NULL;
+    for (int k = 0; k < n; k++) values{i}[k] = k;
+    free(values{i});
+    free(weights{i});
+    free(head{i});
+    return n;
+}}
+
+"""
+
+# a header-like block: none of the words the rewrite rules look for
+_DECL_BLOCK = """\
+typedef enum {{ MODE{i}_OFF, MODE{i}_ON, MODE{i}_AUTO }} mode{i}_t;
+typedef unsigned int flags{i}_t;
+
+int scale_{i}(int x{i}, int y{i});
+double ratio_{i}(double num{i}, double den{i});
+
+static inline int clamp_{i}(int v{i}, int lo{i}, int hi{i}) {{
+    if (v{i} < lo{i}) return lo{i};
+    if (v{i} > hi{i}) return hi{i};
+    return v{i} * 2 + (v{i} >> 1) - lo{i};
+}}
+
+"""
+
+# name -> (source direction, block template)
+GENERATORS: Dict[str, Tuple[str, str]] = {
+    "printf-heavy": ("c", _PRINTF_BLOCK),
+    "cout-heavy": ("cpp", _COUT_BLOCK),
+    "alloc-heavy": ("c", _ALLOC_BLOCK),
+    "declarations": ("c", _DECL_BLOCK),
+}
+
+_HEADERS = {
+    "c": "#include <stdio.h>\n#include <stdlib.h>\n\n",
+    "cpp": "#include <iostream>\n\n",
+}
+
+
+def generate(kind: str, size: int) -> str:
+    """About `size` bytes of `kind` input (never less than one block)."""
+    lang, block = GENERATORS[kind]
+    parts = [_HEADERS[lang]]
+    length = len(parts[0])
+    i = 0
+    while length < size or i == 0:
+        text = block.format(i=i)
+        parts.append(text)
+        length += len(text)
+        i += 1
+    return "".join(parts)
+
+
+def target_of(kind: str) -> str:
+    """Conversion target for a generator: C input goes to C++ and back."""
+    return "cpp" if GENERATORS[kind][0] == "c" else "c"
+
+
+def parse_size(text: str) -> int:
+    """'64', '10K', '1M', '100M' -> bytes."""
+    text = text.strip().upper()
+    for suffix, factor in (("K", 1024), ("M", 1024 ** 2), ("G", 1024 ** 3)):
+        if text.endswith(suffix):
+            return int(float(text[:-1]) * factor)
+    return int(text)
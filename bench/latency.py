@@ -0,0 +1,177 @@
+"""Worst-case latency: adversarial and fuzzed inputs must convert in linear time.
+
+    python -m bench.latency                  # every family, 8K .. 64K, all configs
+    python -m bench.latency --quick          # two sizes, for a pre-commit check
+    python -m bench.latency printf-open soup # some families only
+
+Each family repeats one piece of text up to the size: statements that
+never close (`printf(` with no `);`, `std::cout << x` with no `;`, a
+`malloc(` size that runs on), comments and initializers left open, and
+many lines of the statements the line-walking passes look back or ahead
+from. `soup` is seeded random tokens and `mutated` is `examples/` with
+closing brackets and semicolons dropped at random. Each family runs on
+the default options, every option at once, and the token engine.
+
+A series whose time grows faster than size^LIMIT (the log-log slope) fails
+the run, and so does any case that a zero time budget does not pass
+through unchanged. Series still under MIN_SECONDS at the largest size are
+fixed costs and are not fitted.
+"""
+from __future__ import annotations
+
+import argparse
+import os
+import random
+import sys
+import time
+import warnings
+from typing import Callable, Dict, List, Optional, Tuple
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+if ROOT not in sys.path:
+    sys.path.insert(0, ROOT)
+
+from bench.generate import parse_size  # noqa: E402
+from bench.run import _slope  # noqa: E402
+from cconv.converter import ConversionWarning, ConvertOptions, convert  # noqa: E402
+
+DEFAULT_SIZES = "8K,16K,32K,64K"
+QUICK_SIZES = "8K,64K"
+LIMIT = 1.25
+MIN_SECONDS = 0.02
+
+# name -> (text repeated up to the size, text once before it)
+REPEATED: Dict[str, Tuple[str, str]] = {
+    "printf-open": ("printf(", ""),
+    "printf-nosemi": ('printf("%d", x) ', ""),
+    "scanf-open": ("scanf(", ""),
+    "cout-nosemi": ("std::cout << x ", ""),
+    "cin-nosemi": ("std::cin >> x ", ""),
+    "malloc-open": ("p = (int*)malloc(sizeof(int) * n ", ""),
+    "malloc-typed": ("int *p = malloc(sizeof(int) * n ", ""),
+    "calloc-open": ("p = (int*)calloc(n ", ""),
+    "new-open": ("new a[", ""),
+    "comment-open": ("/* ", ""),
+    "typedef-open": ("typedef struct a {", ""),
+    "main-open": ("int main() { ", ""),
+    "printf-lines": ('printf("%d\\n", x);\n', ""),
+    "cout-lines": ("std::cout << x << std::endl;\n", ""),
+    "printf-chain": ('printf("a"); printf("b"); printf("c");\n', ""),
+    "throw-lines": ('throw std::runtime_error("x");\n', ""),
+    "print-loop": ('for (int i = 0; i < n; i++) printf("%d ", i);\n', ""),
+    "scanf-lines": ('scanf("%d", &x);\n', ""),
+    "malloc-lines": ("x = (int*)malloc(sizeof(int) * n);\nfree(x);\n", ""),
+    "bool-uses": ("b[i] = 1;\nif (b[j]) x++;\n", "#include <stdio.h>\nbool b[100];\n"),
+    "owned-uses": ("p[0] = 1;\n", "int *p = malloc(sizeof(int) * 10);\n"),
+    "array-init-open": ("int a[N] = {1,\n", ""),
+    "std-array-open": ("std::array<int, N> a = {1,\n", ""),
+}
+
+_SOUP = ["printf", "scanf", "(", ")", ";", "{", "}", "[", "]", "std::cout", "<<", ">>", "std::cin", "new",
+         "delete", "malloc", "calloc", "free", "sizeof", "int", "*", "=", ",", "x", "/*", "*/", "//", '"', "'",
+         "\n", " ", "#include", "template", "<", ">", "struct", "typedef", "NULL", "bool", "throw", "main",
+         "return", "for", "if", "0", "1"]
+_CLOSERS = ");}]"
+
+
+def _repeated(name: str) -> Callable[[int, int], str]:
+    unit, head = REPEATED[name]
+    return lambda size, seed: head + unit * max(1, (size - len(head)) // len(unit))
+
+
+def _soup(size: int, seed: int) -> str:
+    rng = random.Random(seed)
+    parts: List[str] = []
+    n = 0
+    while n < size:
+        tok = rng.choice(_SOUP)
+        parts.append(tok)
+        n += len(tok) + 1
+    return " ".join(parts)[:size]
+
+
+def _mutated(size: int, seed: int) -> str:
+    rng = random.Random(seed)
+    with open(os.path.join(ROOT, "examples", "example_c.c"), "r", encoding="utf-8") as f:
+        base = f.read()
+    text = base * (size // len(base) + 1)
+    # about one closer in four goes missing
+    return "".join(c for c in text if c not in _CLOSERS or rng.random() >= 0.25)[:size]
+
+
+FAMILIES: Dict[str, Callable[[int, int], str]] = {name: _repeated(name) for name in REPEATED}
+FAMILIES["soup"] = _soup
+FAMILIES["mutated"] = _mutated
+
+# every option at once
+_ALL = ConvertOptions(fast_io=True, coalesce_output=True, fast_input=True, node_pool=True,
+                      ownership="vector", constexpr=True, pack_bools=True, reorder_fields=True)
+# (name, options, targets)
+CONFIGS: List[Tuple[str, ConvertOptions, Tuple[str, ...]]] = [
+    ("default", ConvertOptions(), ("cpp", "c")),
+    ("all", _ALL, ("cpp", "c")),
+    ("tokens", ConvertOptions(engine="tokens"), ("cpp",)),
+]
+
+
+def _time(code: str, target: str, options: ConvertOptions, repeat: int) -> float:
+    best = None
+    for _ in range(repeat):
+        t0 = time.perf_counter()
+        convert(code, target, options)
+        sec = time.perf_counter() - t0
+        best = sec if best is None else min(best, sec)
+    assert best is not None
+    return best
+
+
+def _passes_through(code: str, target: str, options: ConvertOptions) -> bool:
+    with warnings.catch_warnings():
+        warnings.simplefilter("ignore", ConversionWarning)
+        return convert(code, target, options, budget=0.0) == code
+
+
+def main(argv=None) -> int:
+    p = argparse.ArgumentParser(description="Check the converter's worst-case time is linear in the input")
+    p.add_argument("families", nargs="*", help=f"Families to run (default all: {', '.join(FAMILIES)})")
+    p.add_argument("--sizes", default=DEFAULT_SIZES, help=f"Input sizes (default {DEFAULT_SIZES})")
+    p.add_argument("--quick", action="store_true", help=f"Only sizes {QUICK_SIZES}")
+    p.add_argument("--seed", type=int, default=1, help="Seed of the soup and mutated inputs")
+    p.add_argument("--repeat", type=int, default=2, help="Runs per case; the best is kept")
+    p.add_argument("--limit", type=float, default=LIMIT,
+                   help=f"Fail series whose time grows faster than size^LIMIT (default {LIMIT})")
+    args = p.parse_args(argv)
+
+    unknown = [f for f in args.families if f not in FAMILIES]
+    if unknown:
+        p.error(f"unknown families: {', '.join(unknown)}")
+    sizes = [parse_size(s) for s in (QUICK_SIZES if args.quick else args.sizes).split(",") if s]
+    failed: List[str] = []
+    sys.stdout.write(f"{'family':16} {'config':8} {'target':6} {'ms @ ' + str(sizes[-1]):>12} {'slope':>6}\n")
+    for family in args.families or list(FAMILIES):
+        make = FAMILIES[family]
+        inputs = [make(size, args.seed) for size in sizes]
+        for config, options, targets in CONFIGS:
+            for target in targets:
+                convert(inputs[0][:1024], target, options)  # lazy imports, regex compilation
+                points = [(len(code), _time(code, target, options, args.repeat)) for code in inputs]
+                slope: Optional[float] = None
+                if points[-1][1] >= MIN_SECONDS:
+                    slope = _slope(points, min_bytes=0)
+                flag = ""
+                if slope is not None and slope > args.limit:
+                    flag = "  SUPER-LINEAR"
+                    failed.append(f"super-linear: {family} {config}/{target} ~ size^{slope:.2f}")
+                if not _passes_through(inputs[-1], target, options):
+                    flag += "  NOT PASSED THROUGH"
+                    failed.append(f"zero budget did not pass {family} {config}/{target} through")
+                exp = "n/a" if slope is None else f"{slope:.2f}"
+                sys.stdout.write(f"{family:16} {config:8} {target:6} {points[-1][1] * 1e3:>12.1f} {exp:>6}{flag}\n")
+                sys.stdout.flush()
+    for line in failed:
+        sys.stdout.write(f"REGRESSION {line}\n")
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
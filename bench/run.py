@@ -0,0 +1,222 @@
+"""Converter benchmarks: time, throughput and peak RSS per input, as JSON.
+
+    python -m bench.run                      # examples + synthetic 1 KB .. 10 MB
+    python -m bench.run --sizes 1K,1M,100M   # pick the synthetic sizes
+    python -m bench.run --json out.json      # save the results
+    python -m bench.run --compare base.json  # fail on regressions against a saved run
+
+Every case runs in a fresh process so its peak RSS is its own. Each
+synthetic series is checked for super-linear scaling (the log-log slope of
+time over size); a flagged series or a throughput regression beyond
+`--max-regression` makes the run exit with status 1.
+"""
+from __future__ import annotations
+
+import argparse
+import json
+import math
+import multiprocessing
+import os
+import platform
+import resource
+import subprocess
+import sys
+from concurrent.futures import ProcessPoolExecutor
+from typing import Any, Dict, List, Optional, Tuple
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+if ROOT not in sys.path:
+    sys.path.insert(0, ROOT)
+
+from bench.generate import GENERATORS, generate, parse_size, target_of  # noqa: E402
+from cconv import __version__  # noqa: E402
+from cconv.batch import target_for  # noqa: E402
+from cconv.converter import ConvertOptions, convert  # noqa: E402
+
+DEFAULT_SIZES = "1K,10K,100K,1M,10M"
+# sizes below this are dominated by fixed costs and say nothing about scaling
+SCALING_MIN_BYTES = 64 * 1024
+SCALING_LIMIT = 1.2
+
+# (name, kind, source: path or generator, target, engine, size)
+Case = Tuple[str, str, str, str, str, int]
+
+
+def _run_case(case: Case, repeat: int) -> Dict[str, Any]:
+    """Runs in a worker process: convert `repeat` times, keep the best run."""
+    name, kind, source, target, engine, size = case
+    if kind == "example":
+        with open(source, "r", encoding="utf-8") as f:
+            code = f.read()
+    else:
+        code = generate(source, size)
+    options = ConvertOptions(engine=engine)
+    # the first call pays for lazy imports and regex compilation
+    warm = generate(source, 0) if kind == "synthetic" else code[:4096]
+    convert(warm, target, options)
+    best: Optional[Dict[str, Any]] = None
+    for _ in range(repeat):
+        _, st = convert(code, target, options, stats=True)
+        if best is None or st.seconds < best["seconds"]:
+            best = {"seconds": st.seconds, "out_bytes": st.bytes_out,
+                    "passes": {"analysis": st.analysis_seconds, **st.pass_seconds}}
+    assert best is not None
+    nbytes = len(code.encode("utf-8"))
+    return {
+        "name": name,
+        "kind": kind,
+        "target": target,
+        "engine": engine,
+        "bytes": nbytes,
+        "out_bytes": best["out_bytes"],
+        "seconds": best["seconds"],
+        "mb_per_s": nbytes / 1e6 / best["seconds"] if best["seconds"] > 0 else 0.0,
+        # ru_maxrss is KiB on Linux; the worker starts fresh, so this is the case's peak
+        "peak_rss_kb": resource.getrusage(resource.RUSAGE_SELF).ru_maxrss,
+        "passes": {k: round(v, 6) for k, v in best["passes"].items()},
+    }
+
+
+def _cases(sizes: List[int], engines: List[str], examples: bool) -> List[Case]:
+    cases: List[Case] = []
+    if examples:
+        ex_dir = os.path.join(ROOT, "examples")
+        for fn in sorted(os.listdir(ex_dir)):
+            path = os.path.join(ex_dir, fn)
+            target = target_for(path, None)
+            if target is None:
+                continue
+            for engine in (engines if target == "cpp" else ["regex"]):
+                cases.append((fn, "example", path, target, engine, 0))
+    for kind in GENERATORS:
+        target = target_of(kind)
+        for engine in (engines if target == "cpp" else ["regex"]):
+            for size in sizes:
+                cases.append((kind, "synthetic", kind, target, engine, size))
+    return cases
+
+
+def _slope(points: List[Tuple[int, float]], min_bytes: int = SCALING_MIN_BYTES) -> Optional[float]:
+    """Least-squares slope of log(seconds) over log(bytes); 1.0 is linear."""
+    pts = [(math.log(b), math.log(s)) for b, s in points if b >= min_bytes and s > 0]
+    if len(pts) < 2:
+        return None
+    mx = sum(x for x, _ in pts) / len(pts)
+    my = sum(y for _, y in pts) / len(pts)
+    den = sum((x - mx) ** 2 for x, _ in pts)
+    if den == 0:
+        return None
+    return sum((x - mx) * (y - my) for x, y in pts) / den
+
+
+def scaling(results: List[Dict[str, Any]], limit: float = SCALING_LIMIT) -> List[Dict[str, Any]]:
+    series: Dict[Tuple[str, str, str], List[Tuple[int, float]]] = {}
+    for r in results:
+        if r["kind"] == "synthetic":
+            series.setdefault((r["name"], r["target"], r["engine"]), []).append((r["bytes"], r["seconds"]))
+    out = []
+    for (name, target, engine), pts in sorted(series.items()):
+        slope = _slope(pts)
+        out.append({
+            "name": name, "target": target, "engine": engine,
+            "exponent": None if slope is None else round(slope, 3),
+            "superlinear": slope is not None and slope > limit,
+        })
+    return out
+
+
+def _key(r: Dict[str, Any]) -> Tuple[str, str, str, int]:
+    return (r["name"], r["target"], r["engine"], r["bytes"])
+
+
+def compare(results: List[Dict[str, Any]], base: Dict[str, Any], max_regression: float) -> List[str]:
+    """Cases whose throughput dropped by more than `max_regression` (0.2 = 20%)."""
+    old = {_key(r): r for r in base.get("results", [])}
+    slower = []
+    for r in results:
+        b = old.get(_key(r))
+        # tiny inputs are all timer noise
+        if not b or b["mb_per_s"] <= 0 or r["bytes"] < SCALING_MIN_BYTES:
+            continue
+        drop = 1.0 - r["mb_per_s"] / b["mb_per_s"]
+        if drop > max_regression:
+            slower.append(f"{r['name']} {r['target']}/{r['engine']} {r['bytes']} B: "
+                          f"{b['mb_per_s']:.2f} -> {r['mb_per_s']:.2f} MB/s ({drop:.0%} slower)")
+    return slower
+
+
+def _git_commit() -> Optional[str]:
+    try:
+        return subprocess.run(["git", "rev-parse", "--short", "HEAD"], cwd=ROOT, capture_output=True,
+                              text=True, check=True).stdout.strip()
+    except (OSError, subprocess.CalledProcessError):
+        return None
+
+
+def _print_table(results: List[Dict[str, Any]], scale: List[Dict[str, Any]], out) -> None:
+    out.write(f"{'case':24} {'target':6} {'engine':6} {'bytes':>11} {'ms':>10} {'MB/s':>7} {'RSS MB':>7}  slowest pass\n")
+    for r in results:
+        passes = {k: v for k, v in r["passes"].items() if k != "analysis"}
+        slow = max(passes, key=passes.get) if passes else "-"
+        out.write(f"{r['name']:24} {r['target']:6} {r['engine']:6} {r['bytes']:>11} "
+                  f"{r['seconds'] * 1e3:>10.2f} {r['mb_per_s']:>7.2f} {r['peak_rss_kb'] / 1024:>7.1f}  {slow}\n")
+    for s in scale:
+        flag = "  SUPER-LINEAR" if s["superlinear"] else ""
+        exp = "n/a" if s["exponent"] is None else f"{s['exponent']:.2f}"
+        out.write(f"scaling {s['name']} {s['target']}/{s['engine']}: time ~ size^{exp}{flag}\n")
+
+
+def main(argv=None) -> int:
+    p = argparse.ArgumentParser(description="Benchmark the C <-> C++ converter")
+    p.add_argument("--sizes", default=DEFAULT_SIZES,
+                   help=f"Synthetic input sizes (default {DEFAULT_SIZES}; up to 100M)")
+    p.add_argument("--engines", default="regex,tokens", help="C -> C++ engines to time")
+    p.add_argument("--repeat", type=int, default=3, help="Runs per case; the best is kept")
+    p.add_argument("--no-examples", action="store_true", help="Skip the examples/ inputs")
+    p.add_argument("--json", help="Write the results to this file")
+    p.add_argument("--compare", help="Results JSON of an earlier run to compare against")
+    p.add_argument("--max-regression", type=float, default=0.2,
+                   help="Throughput drop that fails --compare (default 0.2 = 20%%)")
+    p.add_argument("--scaling-limit", type=float, default=SCALING_LIMIT,
+                   help=f"Flag series whose time grows faster than size^LIMIT (default {SCALING_LIMIT})")
+    args = p.parse_args(argv)
+
+    sizes = [parse_size(s) for s in args.sizes.split(",") if s]
+    engines = [e for e in args.engines.split(",") if e]
+    cases = _cases(sizes, engines, not args.no_examples)
+    results = []
+    ctx = multiprocessing.get_context("spawn")
+    for case in cases:
+        # one process per case keeps ru_maxrss per case
+        with ProcessPoolExecutor(max_workers=1, mp_context=ctx) as pool:
+            results.append(pool.submit(_run_case, case, args.repeat).result())
+        r = results[-1]
+        sys.stderr.write(f"  {r['name']} {r['target']}/{r['engine']} {r['bytes']} B: {r['seconds'] * 1e3:.1f} ms\n")
+
+    scale = scaling(results, args.scaling_limit)
+    report = {
+        "cconv": __version__,
+        "commit": _git_commit(),
+        "python": platform.python_version(),
+        "machine": platform.machine(),
+        "results": results,
+        "scaling": scale,
+    }
+    _print_table(results, scale, sys.stdout)
+    if args.json:
+        with open(args.json, "w", encoding="utf-8") as f:
+            json.dump(report, f, indent=2)
+            f.write("\n")
+
+    failed = [f"super-linear: {s['name']} {s['target']}/{s['engine']} ~ size^{s['exponent']}"
+              for s in scale if s["superlinear"]]
+    if args.compare:
+        with open(args.compare, "r", encoding="utf-8") as f:
+            failed += compare(results, json.load(f), args.max_regression)
+    for line in failed:
+        sys.stdout.write(f"REGRESSION {line}\n")
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,460 @@
+"""Runtime differential: does the converted program run as fast as the original?
+
+    python -m bench.runtime                      # every case, 500k operations
+    python -m bench.runtime --ops 1000000        # larger traces
+    python -m bench.runtime --fast-io            # convert with ConvertOptions(fast_io=True)
+    python -m bench.runtime --fast-input         # the same for fast_input (all traces are numeric)
+    python -m bench.runtime --json out.json      # save the results
+
+Each example is compiled as it is and converted, both sides with the same
+flags (`--cflags`, default -O2). Both run on the same stdin, and their
+stdout and exit status must match. The data structure examples get their
+`main` replaced by a driver that replays a generated operation trace
+(push/pop/peek), so they run long enough to time. `example_c.c` reads its
+`n` from stdin. The run exits with status 1 on a mismatch, a build failure,
+or a converted program more than `--max-slowdown` slower in wall time. A
+program that runs in under MIN_SECONDS isn't timed against that limit.
+
+Wall time is the best of `--repeat` runs. Max RSS comes from wait4() in a
+small C launcher, and instructions from `perf stat` when perf is installed.
+"""
+from __future__ import annotations
+
+import argparse
+import json
+import os
+import platform
+import random
+import re
+import shlex
+import shutil
+import subprocess
+import sys
+import tempfile
+from typing import Any, Dict, List, Optional, Tuple
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+if ROOT not in sys.path:
+    sys.path.insert(0, ROOT)
+
+from cconv import __version__  # noqa: E402
+from cconv.batch import target_for  # noqa: E402
+from cconv.converter import ConvertOptions, _blank_comments, convert  # noqa: E402
+
+DEFAULT_OPS = 500_000
+# shorter runs are all process start-up and timer noise
+MIN_SECONDS = 0.05
+
+# Drivers that replace `main`. The trace on stdin is a count, then one
+# "op value" line per operation: 0 push_front, 1 push_back, 2 pop_front,
+# 3 pop_back, 4 peek. Pops and peeks only come when the structure isn't
+# empty.
+_SLL_C = """\
+int main() {
+    int n, op, value;
+    struct Node* head = NULL;
+    scanf("%d", &n);
+    for (int i = 0; i < n; i++) {
+        scanf("%d %d", &op, &value);
+        if (op == 0) {
+            head = push_front(head, value);
+        } else if (op == 2) {
+            struct Node* tmp = head->next;
+            free(head);
+            head = tmp;
+        } else {
+            printf("%d\\n", head->data);
+        }
+    }
+    print_list(head);
+    free_list(head);
+    return 0;
+}
+"""
+
+_DEQUE_ARRAY_C = """\
+int main() {
+    int n, op, value;
+    scanf("%d", &n);
+    for (int i = 0; i < n; i++) {
+        scanf("%d %d", &op, &value);
+        if (op == 0) {
+            insertFront(value);
+        } else if (op == 1) {
+            insertRear(value);
+        } else if (op == 2) {
+            deleteFront();
+        } else if (op == 3) {
+            deleteRear();
+        } else {
+            displayDeque();
+        }
+    }
+    return 0;
+}
+"""
+
+_DEQUE_ARRAY_CPP = """\
+int main() {
+    int n, op, value;
+    std::cin >> n;
+    for (int i = 0; i < n; i++) {
+        std::cin >> op >> value;
+        if (op == 0) {
+            insertFront(value);
+        } else if (op == 1) {
+            insertRear(value);
+        } else if (op == 2) {
+            deleteFront();
+        } else if (op == 3) {
+            deleteRear();
+        } else {
+            displayDeque();
+        }
+    }
+    return 0;
+}
+"""
+
+_DEQUE_INT_C = """\
+int main(void) {
+    int n, op, value;
+    Deque dq;
+    deque_init(&dq);
+    scanf("%d", &n);
+    for (int i = 0; i < n; i++) {
+        scanf("%d %d", &op, &value);
+        if (op == 0) {
+            deque_push_front(&dq, value);
+        } else if (op == 1) {
+            deque_push_back(&dq, value);
+        } else if (op == 2) {
+            deque_pop_front(&dq);
+        } else if (op == 3) {
+            deque_pop_back(&dq);
+        } else {
+            printf("%d %d\\n", deque_get_front(&dq), deque_get_rear(&dq));
+        }
+    }
+    printf("Size of deque: %d\\n", deque_get_size(&dq));
+    deque_destroy(&dq);
+    return 0;
+}
+"""
+
+_DEQUE_TEMPLATE_CPP = """\
+int main() {
+    int n, op, value;
+    Deque<int> dq;
+    std::cin >> n;
+    for (int i = 0; i < n; i++) {
+        std::cin >> op >> value;
+        if (op == 0) {
+            dq.push_front(value);
+        } else if (op == 1) {
+            dq.push_back(value);
+        } else if (op == 2) {
+            dq.pop_front();
+        } else if (op == 3) {
+            dq.pop_back();
+        } else {
+            std::cout << dq.get_front() << " " << dq.get_rear() << std::endl;
+        }
+    }
+    std::cout << "Size of deque: " << dq.get_size() << std::endl;
+    return 0;
+}
+"""
+
+_STACK_TEMPLATE_CPP = """\
+int main() {
+    int n, op, value;
+    Stack<int> st;
+    std::cin >> n;
+    for (int i = 0; i < n; i++) {
+        std::cin >> op >> value;
+        if (op == 0) {
+            st.push(value);
+        } else if (op == 2) {
+            st.pop();
+        } else {
+            std::cout << maxOf(st.top(), value) << std::endl;
+        }
+    }
+    std::cout << "Size of stack: " << st.size() << std::endl;
+    return 0;
+}
+"""
+
+# example -> (driver or None, stdin: "trace", "trace-list", "n" or "none")
+PROGRAMS: Dict[str, Tuple[Optional[str], str]] = {
+    "example_c.c": (None, "n"),
+    "example_cpp.cpp": (None, "none"),
+    "bintree_c.c": (None, "none"),
+    "sll_c.c": (_SLL_C, "trace-list"),
+    "deque_c.c": (_DEQUE_ARRAY_C, "trace"),
+    "deque_cpp.cpp": (_DEQUE_ARRAY_CPP, "trace"),
+    "deque_cpp_int_c.c": (_DEQUE_INT_C, "trace"),
+    "deque_template_cpp.cpp": (_DEQUE_TEMPLATE_CPP, "trace"),
+    "stack_template_cpp.cpp": (_STACK_TEMPLATE_CPP, "trace-list"),
+}
+
+# Starts the program, waits for it, and writes "seconds status max_rss_kb" to
+# argv[1]. A launcher this small keeps ru_maxrss the program's own: a child
+# forked from Python starts out with the interpreter's RSS on the books.
+_LAUNCHER_C = """\
+#include <stdio.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+int main(int argc, char** argv) {
+    struct timespec t0, t1;
+    struct rusage ru;
+    int status;
+    FILE* out;
+    pid_t pid;
+    if (argc < 3) return 2;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    pid = fork();
+    if (pid == 0) {
+        execv(argv[2], argv + 2);
+        _exit(127);
+    }
+    if (pid < 0 || wait4(pid, &status, 0, &ru) < 0) return 1;
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    out = fopen(argv[1], "w");
+    if (!out) return 1;
+    fprintf(out, "%.9f %d %ld\\n", (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9,
+            WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status), ru.ru_maxrss);
+    return fclose(out) != 0;
+}
+"""
+
+_main_head = re.compile(r"^int\s+main\s*\([^)]*\)\s*\{", re.MULTILINE)
+
+
+def with_driver(code: str, driver: str) -> str:
+    """`code` with its `main` replaced by `driver`."""
+    mask = _blank_comments(code)
+    m = _main_head.search(mask)
+    if not m:
+        raise ValueError("no main() to replace")
+    depth = 0
+    for j in range(m.end() - 1, len(mask)):
+        if mask[j] == "{":
+            depth += 1
+        elif mask[j] == "}":
+            depth -= 1
+            if depth == 0:
+                return code[:m.start()] + driver + code[j + 1:].lstrip("\n")
+    raise ValueError("unbalanced main()")
+
+
+def trace(ops: int, seed: int, kinds: Tuple[int, ...] = (0, 1, 2, 3, 4)) -> str:
+    """`ops` operations drawn from `kinds`, never popping or peeking when
+    empty. Pushes are twice as likely as pops, so the structure grows."""
+    rng = random.Random(seed)
+    pushes = [k for k in kinds if k in (0, 1)]
+    others = [k for k in kinds if k not in (0, 1)]
+    weights = [2] * len(pushes) + [1] * len(others)
+    size = 0
+    lines = [str(ops)]
+    for _ in range(ops):
+        op = rng.choices(pushes + others, weights)[0] if size else rng.choice(pushes)
+        if op in (2, 3):
+            size -= 1
+        elif op in (0, 1):
+            size += 1
+        lines.append(f"{op} {rng.randrange(1_000_000)}")
+    return "\n".join(lines) + "\n"
+
+
+def _stdin(kind: str, ops: int, seed: int) -> str:
+    if kind == "trace":
+        return trace(ops, seed)
+    if kind == "trace-list":
+        return trace(ops, seed, (0, 2, 4))
+    if kind == "n":
+        return f"{ops}\n"
+    return ""
+
+
+def _compile(cc: str, flags: List[str], src: str, exe: str) -> Optional[str]:
+    """Build `src`; the compiler's output on failure, else None."""
+    proc = subprocess.run([cc, *flags, "-o", exe, src], capture_output=True, text=True)
+    return None if proc.returncode == 0 else proc.stderr.strip() or f"{cc} exited with {proc.returncode}"
+
+
+def _run(launcher: str, exe: str, stdin_path: str, out_path: str) -> Tuple[float, int, int]:
+    """One run: (wall seconds, exit status, max RSS KiB)."""
+    report = out_path + ".run"
+    with open(stdin_path, "rb") as fin, open(out_path, "wb") as fout:
+        subprocess.run([launcher, report, exe], stdin=fin, stdout=fout, stderr=subprocess.DEVNULL, check=True)
+    with open(report, "r", encoding="utf-8") as f:
+        seconds, status, rss = f.read().split()
+    return float(seconds), int(status), int(rss)
+
+
+def _instructions(exe: str, stdin_path: str, tmp: str) -> Optional[int]:
+    """User-space instructions retired, when `perf stat` is available."""
+    if shutil.which("perf") is None:
+        return None
+    stat = os.path.join(tmp, "perf.csv")
+    with open(stdin_path, "rb") as fin:
+        proc = subprocess.run(["perf", "stat", "-x,", "-e", "instructions:u", "-o", stat, "--", exe],
+                              stdin=fin, stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+    if proc.returncode != 0 or not os.path.exists(stat):
+        return None
+    with open(stat, "r", encoding="utf-8") as f:
+        for line in f:
+            field = line.split(",", 1)[0]
+            if field.isdigit():
+                return int(field)
+    return None
+
+
+def _measure(launcher: str, exe: str, stdin_path: str, out_path: str, repeat: int, tmp: str) -> Dict[str, Any]:
+    best = None
+    status = rss = 0
+    for _ in range(repeat):
+        seconds, status, peak = _run(launcher, exe, stdin_path, out_path)
+        best = seconds if best is None else min(best, seconds)
+        rss = max(rss, peak)
+    return {"seconds": best, "status": status, "max_rss_kb": rss,
+            "instructions": _instructions(exe, stdin_path, tmp)}
+
+
+def run_case(example: str, args: argparse.Namespace, options: ConvertOptions, tmp: str,
+             launcher: str) -> Dict[str, Any]:
+    driver, stdin_kind = PROGRAMS[example]
+    path = os.path.join(ROOT, "examples", example)
+    target = target_for(path, None)
+    lang = "cpp" if target == "c" else "c"
+    with open(path, "r", encoding="utf-8") as f:
+        code = f.read()
+    if driver is not None:
+        code = with_driver(code, driver)
+    converted = convert(code, target, options)
+    stem = os.path.splitext(example)[0]
+    result: Dict[str, Any] = {"name": example, "target": target,
+                              "ops": args.ops if stdin_kind != "none" else 0, "failure": None}
+    stdin_path = os.path.join(tmp, f"{stem}.in")
+    with open(stdin_path, "w", encoding="utf-8") as f:
+        f.write(_stdin(stdin_kind, args.ops, args.seed))
+    sides = {}
+    for side, text, side_lang in (("original", code, lang), ("converted", converted, target)):
+        src = os.path.join(tmp, f"{stem}.{side}.{'c' if side_lang == 'c' else 'cpp'}")
+        exe = os.path.join(tmp, f"{stem}.{side}")
+        with open(src, "w", encoding="utf-8") as f:
+            f.write(text)
+        cc = args.cc if side_lang == "c" else args.cxx
+        err = _compile(cc, shlex.split(args.cflags) + shlex.split(args.ldflags), src, exe)
+        if err is not None:
+            result["failure"] = f"{side} does not build: {err.splitlines()[0]}"
+            return result
+        sides[side] = _measure(launcher, exe, stdin_path, os.path.join(tmp, f"{stem}.{side}.out"), args.repeat, tmp)
+    result.update(sides)
+    orig, conv = sides["original"], sides["converted"]
+    with open(os.path.join(tmp, f"{stem}.original.out"), "rb") as a, \
+            open(os.path.join(tmp, f"{stem}.converted.out"), "rb") as b:
+        same = a.read() == b.read()
+    result["ratio"] = conv["seconds"] / orig["seconds"] if orig["seconds"] > 0 else None
+    if orig["status"] != conv["status"]:
+        result["failure"] = f"exit status {orig['status']} -> {conv['status']}"
+    elif not same:
+        result["failure"] = "outputs differ"
+    elif orig["seconds"] >= MIN_SECONDS and result["ratio"] > 1 + args.max_slowdown:
+        result["failure"] = f"converted is {result['ratio'] - 1:.0%} slower"
+    return result
+
+
+def _fmt(v: Optional[float], scale: float = 1.0, spec: str = ".1f") -> str:
+    return "-" if v is None else format(v * scale, spec)
+
+
+def _print_table(results: List[Dict[str, Any]], out) -> None:
+    out.write(f"{'case':24} {'to':3} {'ops':>8} {'orig ms':>9} {'conv ms':>9} {'ratio':>6} "
+              f"{'orig Minstr':>11} {'conv Minstr':>11} {'orig MB':>7} {'conv MB':>7}  status\n")
+    for r in results:
+        o, c = r.get("original") or {}, r.get("converted") or {}
+        oi, ci = o.get("instructions"), c.get("instructions")
+        out.write(
+            f"{r['name']:24} {r['target']:3} {r['ops']:>8} {_fmt(o.get('seconds'), 1e3):>9} "
+            f"{_fmt(c.get('seconds'), 1e3):>9} {_fmt(r.get('ratio'), 1, '.2f'):>6} "
+            f"{_fmt(oi, 1e-6):>11} {_fmt(ci, 1e-6):>11} "
+            f"{_fmt(o.get('max_rss_kb'), 1 / 1024):>7} {_fmt(c.get('max_rss_kb'), 1 / 1024):>7}  "
+            f"{r['failure'] or 'ok'}\n")
+
+
+def main(argv=None) -> int:
+    p = argparse.ArgumentParser(description="Compare the run time of each example with its conversion")
+    p.add_argument("cases", nargs="*", help=f"Examples to run (default: all of {', '.join(PROGRAMS)})")
+    p.add_argument("--ops", type=int, default=DEFAULT_OPS,
+                   help=f"Trace length, or n for example_c.c (default {DEFAULT_OPS})")
+    p.add_argument("--seed", type=int, default=1, help="Trace seed")
+    p.add_argument("--repeat", type=int, default=3, help="Runs per side; the best is kept")
+    p.add_argument("--max-slowdown", type=float, default=0.1,
+                   help="Wall time increase of the converted side that fails the run (default 0.1 = 10%%)")
+    p.add_argument("--cc", default=os.environ.get("CC", "gcc"), help="C compiler")
+    p.add_argument("--cxx", default=os.environ.get("CXX", "g++"), help="C++ compiler")
+    p.add_argument("--cflags", default="-O2", help="Flags for both compilers (default -O2)")
+    p.add_argument("--ldflags", default="", help="Linker flags")
+    p.add_argument("--endl", action="store_true", help="Convert with ConvertOptions(endl=True)")
+    p.add_argument("--fast-io", action="store_true", help="Convert with ConvertOptions(fast_io=True)")
+    p.add_argument("--coalesce-output", action="store_true",
+                   help="Convert with ConvertOptions(coalesce_output=True)")
+    p.add_argument("--fast-input", action="store_true", help="Convert with ConvertOptions(fast_input=True)")
+    p.add_argument("--keep", help="Keep sources, binaries and outputs in this directory")
+    p.add_argument("--json", help="Write the results to this file")
+    args = p.parse_args(argv)
+
+    for name in args.cases:
+        if name not in PROGRAMS:
+            p.error(f"unknown case: {name}")
+    for cc in (args.cc, args.cxx):
+        if shutil.which(cc) is None:
+            p.error(f"compiler not found: {cc}")
+    options = ConvertOptions(endl=args.endl, fast_io=args.fast_io, coalesce_output=args.coalesce_output,
+                             fast_input=args.fast_input)
+    tmp = args.keep or tempfile.mkdtemp(prefix="cconv-runtime-")
+    os.makedirs(tmp, exist_ok=True)
+    results = []
+    try:
+        launcher = os.path.join(tmp, "launcher")
+        with open(launcher + ".c", "w", encoding="utf-8") as f:
+            f.write(_LAUNCHER_C)
+        err = _compile(args.cc, ["-O2"], launcher + ".c", launcher)
+        if err is not None:
+            p.error(f"cannot build the launcher with {args.cc}: {err}")
+        for name in args.cases or PROGRAMS:
+            results.append(run_case(name, args, options, tmp, launcher))
+            r = results[-1]
+            sys.stderr.write(f"  {name}: {r['failure'] or 'ok'}\n")
+    finally:
+        if not args.keep:
+            shutil.rmtree(tmp, ignore_errors=True)
+
+    _print_table(results, sys.stdout)
+    if args.json:
+        report = {
+            "cconv": __version__,
+            "python": platform.python_version(),
+            "machine": platform.machine(),
+            "cflags": args.cflags,
+            "options": {"endl": args.endl, "fast_io": args.fast_io, "coalesce_output": args.coalesce_output,
+                        "fast_input": args.fast_input},
+            "results": results,
+        }
+        with open(args.json, "w", encoding="utf-8") as f:
+            json.dump(report, f, indent=2)
+            f.write("\n")
+    failed = [r for r in results if r["failure"]]
+    for r in failed:
+        sys.stdout.write(f"REGRESSION {r['name']} -> {r['target']}: {r['failure']}\n")
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -1,3 +1,4 @@
-__all__ = ["convert_c_to_cpp", "convert_cpp_to_c"]
+__all__ = ["convert", "convert_c_to_cpp", "convert_cpp_to_c", "ConversionError", "ConversionStats", "ConversionWarning", "ConvertOptions"]
+__version__ = "0.4.0"
 
-from .converter import convert_c_to_cpp, convert_cpp_to_c
+from .converter import convert, convert_c_to_cpp, convert_cpp_to_c, ConversionError, ConversionStats, ConversionWarning, ConvertOptions
@@ -1,22 +1,191 @@
 import argparse
+import os
 import sys
-from .converter import convert_c_to_cpp, convert_cpp_to_c
+import warnings
+from .converter import convert, ConversionError, ConversionStats, ConversionWarning, ConvertOptions, ENGINES, FORMAT_LIBS, IO_STYLES, OWNERSHIP_MODES, RULES, ABIS
+from .patch import EMITS
+
+
+def _options_from_args(args) -> ConvertOptions:
+    return ConvertOptions(
+        engine=args.engine,
+        disabled_rules=frozenset(args.disable_rule or ()),
+        endl=args.endl,
+        fast_io=args.fast_io,
+        io_style=args.io_style,
+        format_lib=args.format_lib,
+        ownership=args.ownership,
+        node_pool=args.node_pool,
+        constexpr=args.constexpr,
+        coalesce_output=args.coalesce_output,
+        fast_input=args.fast_input,
+        c89=args.c89,
+        pack_bools=args.pack_bools,
+        reorder_fields=args.reorder_fields,
+        abi=args.abi,
+    )
+
+
+def _write_stats(st: ConversionStats, out) -> None:
+    out.write(f"{st.target} ({st.engine}): {st.bytes_in} -> {st.bytes_out} bytes in {st.seconds * 1e3:.2f} ms "
+              f"(analysis {st.analysis_seconds * 1e3:.2f} ms); "
+              f"{st.type_map_size} typed names, {st.typedefs} typedefs; "
+              f"{st.rules_skipped} rules skipped (no trigger word)\n")
+    if st.over_budget:
+        out.write("over the time budget: the input was passed through unchanged\n")
+    out.write(f"{'pass':32} {'ms':>9} {'matches':>8}\n")
+    for name, sec in sorted(st.pass_seconds.items(), key=lambda kv: -kv[1]):
+        hits = sum(st.rule_matches.get(r, 0) for r in name.split("+"))
+        out.write(f"{name:32} {sec * 1e3:>9.3f} {hits:>8}\n")
+    # walk rewrites are counted under table rule names that never ran as passes
+    for name, hits in sorted(st.rule_matches.items()):
+        if not any(name in p.split("+") for p in st.pass_seconds):
+            out.write(f"{name:32} {'':>9} {hits:>8}\n")
+
+
+def _report(level: str, name: str, message: object) -> None:
+    sys.stderr.write(f"cconv: {level}: {name}: {message}\n")
+
+
+def _fail(name: str, e: ConversionError) -> None:
+    _report("error", name, e)
+    sys.exit(1)
+
+
+def _budgeted(name: str, run):
+    """run(), and whether it gave up on its time budget; the warning it gives
+    goes out as a `cconv: warning:` line, and a `ConversionError` ends the
+    run with status 1."""
+    over = False
+    with warnings.catch_warnings(record=True) as caught:
+        warnings.simplefilter("always", ConversionWarning)
+        try:
+            result = run()
+        except ConversionError as e:
+            _fail(name, e)
+    for w in caught:
+        if issubclass(w.category, ConversionWarning):
+            _report("warning", name, w.message)
+            over = True
+        else:
+            warnings.showwarning(w.message, w.category, w.filename, w.lineno)
+    return result, over
 
 
 def main(argv=None):
+    argv = sys.argv[1:] if argv is None else argv
+    if argv[:1] == ["serve"]:
+        from .server import main as serve
+        return serve(argv[1:])
     p = argparse.ArgumentParser(description="C <-> C++ heuristic converter")
-    p.add_argument("input", help="Input file path or '-' for stdin")
-    p.add_argument("-o", "--output", help="Output file path; default stdout")
+    p.add_argument("input", nargs="?", help="Input file path, '-' for stdin, or a directory for batch mode")
+    p.add_argument("-o", "--output", help="Output file path; default stdout. Required (a directory) in batch mode")
     p.add_argument("--to", choices=["c", "cpp"], help="Target language")
+    p.add_argument("--engine", choices=ENGINES, default="regex",
+                   help="Rewrite engine: regex passes (default), the single-pass token engine, or the "
+                        "tree-sitter parser (needs tree-sitter and tree-sitter-c; C -> C++)")
+    p.add_argument("-j", "--jobs", type=int, default=None,
+                   help="Batch mode: number of worker processes (default: CPU count)")
+    p.add_argument("--cache-dir", help="Conversion cache directory (batch default: ~/.cache/cconv)")
+    p.add_argument("--no-cache", action="store_true", help="Always convert; don't read or write the cache")
+    p.add_argument("--stream", action="store_true",
+                   help="Convert chunk by chunk at top-level boundaries; memory stays bounded on huge inputs")
+    p.add_argument("--endl", action="store_true",
+                   help="C -> C++: end printf lines with std::endl (flushes every line; pre-0.3 output)")
+    p.add_argument("--io-style", choices=IO_STYLES, default="stream",
+                   help="C -> C++: printf as std::cout chains (default) or one formatting call")
+    p.add_argument("--format-lib", choices=FORMAT_LIBS, default="std",
+                   help="--io-style=format: std::print (C++23, default), std::cout << std::format (C++20) or fmt::print")
+    p.add_argument("--ownership", choices=OWNERSHIP_MODES, default="raw",
+                   help="C -> C++ heap arrays: new[]/delete[] (default), std::vector, or "
+                        "std::make_unique_for_overwrite<T[]> for malloc'd arrays never realloc'd")
+    p.add_argument("--node-pool", action="store_true",
+                   help="Self-referential structs allocate from a free-list pool (C++ operator new/delete, or a C slab allocator)")
+    p.add_argument("--constexpr", action="store_true",
+                   help="C -> C++: numeric #define bounds/limits become constexpr, fixed global arrays std::array")
+    p.add_argument("--fast-io", action="store_true",
+                   help="C -> C++: unsync iostreams from stdio in main() when no C stdio call remains")
+    p.add_argument("--coalesce-output", action="store_true",
+                   help="Merge adjacent output statements into one call; C -> C++ print-only loops write one buffer")
+    p.add_argument("--fast-input", action="store_true",
+                   help="When stdin is only read as numbers, read it in blocks and parse by hand instead of scanf/cin")
+    p.add_argument("--c89", action="store_true",
+                   help="C++ -> C: lower bool/true/false to int/1/0 instead of keeping them with <stdbool.h>")
+    p.add_argument("--pack-bools", action="store_true",
+                   help="C++ -> C: store bool arrays of 64+ elements that are only indexed one bit per element")
+    p.add_argument("--reorder-fields", action="store_true",
+                   help="Sort struct members by alignment when that removes padding and no code depends on their order")
+    p.add_argument("--abi", choices=ABIS, default="x86-64",
+                   help="Type sizes for --reorder-fields and --layout (default x86-64 System V)")
+    p.add_argument("--layout", action="store_true",
+                   help="Print the size, alignment and padding of the converted code's structs instead of the code")
+    p.add_argument("--stats", action="store_true",
+                   help="Print per-pass time and per-rule match counts to stderr (bypasses the cache)")
+    p.add_argument("--time-budget", type=float, metavar="SECONDS",
+                   help="Give up on a file still converting after SECONDS and pass it through unchanged, "
+                        "with a warning")
+    p.add_argument("--disable-rule", action="append", metavar="NAME",
+                   help="Skip a rewrite rule (repeatable); see --list-rules")
+    p.add_argument("--list-rules", action="store_true", help="Print the rule table and exit")
+    p.add_argument("--emit", choices=EMITS, default="text",
+                   help="Output the converted text (default), a unified diff against the input, or a JSON "
+                        "list of byte-range edits (one object per file)")
+    p.add_argument("--in-place", action="store_true",
+                   help="Write the result over each input file; files that don't change are not touched")
     args = p.parse_args(argv)
 
-    # read input
-    if args.input == "-":
-        code = sys.stdin.read()
-        in_ext = None
-    else:
-        with open(args.input, "r", encoding="utf-8") as f:
-            code = f.read()
+    if args.list_rules:
+        for r in RULES:
+            state = "" if r.enabled else "  (disabled)"
+            sys.stdout.write(f"{r.direction:4} {r.stage:9} {r.name}{state}\n")
+        return
+    if args.input is None:
+        p.error("the following arguments are required: input")
+    names = {r.name for r in RULES}
+    for name in args.disable_rule or ():
+        if name not in names:
+            p.error(f"unknown rule: {name} (see --list-rules)")
+    options = _options_from_args(args)
+    if options.engine == "tree-sitter":
+        from .treesitter import _parser
+        try:
+            _parser()
+        except ImportError as e:
+            p.error(str(e))
+
+    if args.in_place and (args.output or args.input == "-" or args.emit != "text"):
+        p.error("--in-place rewrites the input files: it takes no -o, stdin or --emit")
+    if (args.in_place or args.emit != "text") and (args.stream or args.stats or args.layout):
+        p.error("--emit and --in-place don't combine with --stream, --stats or --layout")
+    if args.stats and (args.stream or os.path.isdir(args.input)):
+        p.error("--stats works on single-file conversion only")
+    if args.layout and (args.stream or os.path.isdir(args.input)):
+        p.error("--layout works on single-file conversion only")
+    if args.time_budget is not None and (args.stream or args.time_budget <= 0):
+        p.error("--time-budget takes a positive number of seconds, and is per file: not with --stream")
+
+    if os.path.isdir(args.input):
+        if not args.output and args.emit == "text" and not args.in_place:
+            p.error("batch mode needs -o/--output DIR (or --in-place, or --emit)")
+        from .batch import run_batch
+        from .cache import default_cache_dir
+        cache_dir = None if args.no_cache else (args.cache_dir or default_cache_dir())
+        if args.emit == "text":
+            failed = run_batch(args.input, args.output, args.to, options,
+                               jobs=args.jobs, cache_dir=cache_dir, budget=args.time_budget)
+        else:
+            # -o is the file the diffs or edit lists go to
+            dst = open(args.output, "w", encoding="utf-8") if args.output else sys.stdout
+            try:
+                failed = run_batch(args.input, None, args.to, options, jobs=args.jobs,
+                                   emit=args.emit, out=dst, budget=args.time_budget)
+            finally:
+                if dst is not sys.stdout:
+                    dst.close()
+        sys.exit(1 if failed else 0)
+
+    in_ext = None
+    if args.input != "-":
         in_ext = args.input.split(".")[-1].lower() if "." in args.input else None
 
     # decide direction
@@ -34,11 +203,75 @@ def main(argv=None):
         else:
             target = "c"
 
-    if target == "cpp":
-        out_code = convert_c_to_cpp(code)
+    if args.stream:
+        from .stream import convert_stream
+        src = sys.stdin if args.input == "-" else open(args.input, "r", encoding="utf-8")
+        dst = open(args.output, "w", encoding="utf-8") if args.output else sys.stdout
+        try:
+            convert_stream(src, dst, target, options)
+        except ConversionError as e:
+            _fail("<stdin>" if args.input == "-" else args.input, e)
+        finally:
+            if src is not sys.stdin:
+                src.close()
+            if dst is not sys.stdout:
+                dst.close()
+        return
+
+    # read input
+    if args.input == "-":
+        code = sys.stdin.read()
     else:
-        out_code = convert_cpp_to_c(code)
+        with open(args.input, "r", encoding="utf-8") as f:
+            code = f.read()
+
+    if args.emit != "text":
+        from .converter import convert_edits
+        from .patch import edits_json, unified_diff
+        name = "<stdin>" if args.input == "-" else args.input
+        (_, edits), _ = _budgeted(name, lambda: convert_edits(code, target, options, budget=args.time_budget))
+        if args.emit == "diff":
+            if args.input == "-" or os.path.isabs(name):
+                old, new = name, name
+            else:
+                old, new = f"a/{name}", f"b/{name}"
+            out_code = unified_diff(code, edits, old, new)
+        else:
+            out_code = edits_json(code, edits, name, target)
+        if args.output:
+            with open(args.output, "w", encoding="utf-8") as f:
+                f.write(out_code)
+        else:
+            sys.stdout.write(out_code)
+        return
+
+    cache = None
+    if args.cache_dir and not args.no_cache and not args.stats:
+        from .cache import ConversionCache, cache_key
+        cache = ConversionCache(args.cache_dir)
+        key = cache_key(code, target, options)
+    out_code = cache.get(key) if cache else None
+    if out_code is None:
+        name = "<stdin>" if args.input == "-" else args.input
+        result, over = _budgeted(name, lambda: convert(code, target, options, stats=args.stats,
+                                                     budget=args.time_budget))
+        if args.stats:
+            out_code, st = result
+            _write_stats(st, sys.stderr)
+        else:
+            out_code = result
+        # a pass-through is not the file's conversion: leave it out of the cache
+        if cache and not over:
+            cache.put(key, out_code)
 
+    if args.in_place:
+        if out_code != code:
+            with open(args.input, "w", encoding="utf-8") as f:
+                f.write(out_code)
+        return
+    if args.layout:
+        from .layout import format_report, struct_layouts
+        out_code = format_report(struct_layouts(out_code, args.abi, cpp=target == "cpp"), args.abi)
     if args.output:
         with open(args.output, "w", encoding="utf-8") as f:
             f.write(out_code)
@@ -0,0 +1,195 @@
+"""Directory/batch conversion: one interpreter, many files, a process pool."""
+from __future__ import annotations
+
+import os
+import sys
+import time
+import warnings
+from concurrent.futures import ProcessPoolExecutor
+from dataclasses import dataclass
+from typing import Callable, Iterator, List, Optional, TextIO, Tuple, TypeVar
+
+from .cache import ConversionCache, cache_key
+from .converter import ConversionError, ConversionWarning, ConvertOptions, convert, convert_edits
+from .patch import edits_json, unified_diff
+
+C_EXTS = (".c",)
+CPP_EXTS = (".cpp", ".cc", ".cxx")
+
+
+@dataclass(frozen=True)
+class FileResult:
+    src: str
+    dst: str
+    nbytes: int
+    seconds: float
+    error: Optional[str] = None
+    cached: bool = False
+    # text: False when dst already held the output and was left alone
+    written: bool = True
+    # diff / edits: this file's part of the output
+    patch: str = ""
+    # the time budget ran out and the file was passed through unchanged
+    over_budget: bool = False
+
+
+def target_for(path: str, to: Optional[str]) -> Optional[str]:
+    """Direction for one file of a tree, or None to skip it."""
+    ext = os.path.splitext(path)[1].lower()
+    if ext in C_EXTS and to in (None, "cpp"):
+        return "cpp"
+    if ext in CPP_EXTS and to in (None, "c"):
+        return "c"
+    return None
+
+
+def output_name(rel: str, target: str) -> str:
+    root = os.path.splitext(rel)[0]
+    return root + (".cpp" if target == "cpp" else ".c")
+
+
+def iter_tasks(src_dir: str, out_dir: Optional[str], to: Optional[str]) -> Iterator[Tuple[str, str, str]]:
+    """Yield (input path, output path, target) for every convertible file.
+    Without `out_dir` the output path is the input (in-place)."""
+    for dirpath, dirnames, filenames in os.walk(src_dir):
+        dirnames.sort()
+        for fn in sorted(filenames):
+            src = os.path.join(dirpath, fn)
+            target = target_for(src, to)
+            if target is None:
+                continue
+            if out_dir is None:
+                yield src, src, target
+                continue
+            rel = os.path.relpath(src, src_dir)
+            yield src, os.path.join(out_dir, output_name(rel, target)), target
+
+
+T = TypeVar("T")
+
+
+def _within_budget(run: Callable[[], T]) -> Tuple[T, bool]:
+    """run(), and whether it gave up on its time budget."""
+    with warnings.catch_warnings(record=True) as caught:
+        warnings.simplefilter("always", ConversionWarning)
+        result = run()
+    for w in caught:
+        if not issubclass(w.category, ConversionWarning):
+            warnings.showwarning(w.message, w.category, w.filename, w.lineno)
+    return result, any(issubclass(w.category, ConversionWarning) for w in caught)
+
+
+def convert_file(task: Tuple[str, str, str, ConvertOptions, Optional[str], str, str, Optional[float]]) -> FileResult:
+    src, dst, target, options, cache_dir, emit, name, budget = task
+    t0 = time.perf_counter()
+    cached = False
+    written = True
+    over = False
+    try:
+        with open(src, "r", encoding="utf-8") as f:
+            code = f.read()
+        if emit != "text":
+            # edits come from the rewrite positions, which the cache doesn't keep
+            (_, edits), over = _within_budget(lambda: convert_edits(code, target, options, budget=budget))
+            if emit == "diff":
+                patch = unified_diff(code, edits, f"a/{name}", f"b/{name}")
+            else:
+                patch = edits_json(code, edits, name, target)
+            return FileResult(src, dst, len(code.encode("utf-8")), time.perf_counter() - t0, patch=patch,
+                              over_budget=over)
+        cache = ConversionCache(cache_dir) if cache_dir else None
+        key = cache_key(code, target, options) if cache else ""
+        out = cache.get(key) if cache else None
+        if out is not None:
+            cached = True
+        else:
+            out, over = _within_budget(lambda: convert(code, target, options, budget=budget))
+            # a pass-through is not the file's conversion: leave it out of the cache
+            if cache and not over:
+                cache.put(key, out)
+        # an unchanged output keeps its mtime, so builds don't redo its unit
+        written = out != (code if dst == src else _read(dst))
+        if written:
+            os.makedirs(os.path.dirname(dst) or ".", exist_ok=True)
+            with open(dst, "w", encoding="utf-8") as f:
+                f.write(out)
+    except (OSError, UnicodeDecodeError, ConversionError) as e:
+        return FileResult(src, dst, 0, time.perf_counter() - t0, str(e))
+    return FileResult(src, dst, len(code.encode("utf-8")), time.perf_counter() - t0, cached=cached, written=written,
+                      over_budget=over)
+
+
+def _read(path: str) -> Optional[str]:
+    try:
+        with open(path, "r", encoding="utf-8") as f:
+            return f.read()
+    except (OSError, UnicodeDecodeError):
+        return None
+
+
+def run_batch(src_dir: str, out_dir: Optional[str], to: Optional[str], options: ConvertOptions,
+              jobs: Optional[int] = None, cache_dir: Optional[str] = None,
+              log: TextIO = sys.stderr, emit: str = "text", out: Optional[TextIO] = None,
+              budget: Optional[float] = None) -> int:
+    """Convert every file under `src_dir` into `out_dir`; returns the number of failures.
+
+    Without `out_dir` each file is converted in place. Only files whose
+    content changes are written. With `emit="diff"` or `"edits"` nothing is
+    written: each file's unified diff or JSON edit list goes to `out`, in
+    tree order.
+
+    With `cache_dir`, files whose content, direction and options were seen
+    before are served from the cache instead of being converted again.
+
+    With `budget`, a file still converting after that many seconds is
+    passed through unchanged; it is reported, not counted as a failure.
+    """
+    tasks = [(src, dst, target, options, cache_dir, emit, os.path.relpath(src, src_dir).replace(os.sep, "/"), budget)
+             for src, dst, target in iter_tasks(src_dir, out_dir, to)]
+    jobs = jobs or os.cpu_count() or 1
+    t0 = time.perf_counter()
+    results: List[FileResult] = []
+    if jobs == 1 or len(tasks) <= 1:
+        for r in map(convert_file, tasks):
+            _log_result(r, log, out)
+            results.append(r)
+    else:
+        # chunking keeps IPC overhead low on trees of many small files
+        chunksize = max(1, len(tasks) // (jobs * 8))
+        with ProcessPoolExecutor(max_workers=jobs) as pool:
+            for r in pool.map(convert_file, tasks, chunksize=chunksize):
+                _log_result(r, log, out)
+                results.append(r)
+    wall = time.perf_counter() - t0
+
+    failed = sum(1 for r in results if r.error)
+    nbytes = sum(r.nbytes for r in results)
+    rate = len(results) / wall if wall > 0 else 0.0
+    mbps = nbytes / 1e6 / wall if wall > 0 else 0.0
+    log.write(
+        f"{len(results)} files ({failed} failed), {nbytes / 1e6:.2f} MB in {wall:.2f}s "
+        f"with {jobs} jobs: {rate:.1f} files/s, {mbps:.2f} MB/s\n"
+    )
+    unchanged = sum(1 for r in results if not r.error and not r.written)
+    if unchanged:
+        log.write(f"{unchanged} outputs unchanged, not rewritten\n")
+    over = sum(1 for r in results if r.over_budget)
+    if over:
+        log.write(f"{over} files over the {budget:g}s time budget, passed through unchanged\n")
+    if cache_dir:
+        hits = sum(1 for r in results if r.cached)
+        log.write(f"cache: {hits} hits, {len(results) - failed - hits} misses ({cache_dir})\n")
+    return failed
+
+
+def _log_result(r: FileResult, log: TextIO, out: Optional[TextIO] = None) -> None:
+    if r.error:
+        log.write(f"FAILED {r.src}: {r.error}\n")
+        return
+    if r.patch and out is not None:
+        out.write(r.patch)
+    hit = "  (cached)" if r.cached else ""
+    same = "" if r.written else "  (unchanged)"
+    late = "  (over the time budget: passed through)" if r.over_budget else ""
+    dest = "" if r.dst == r.src else f" -> {r.dst}"
+    log.write(f"{r.seconds * 1e3:8.1f} ms  {r.src}{dest}{hit}{same}{late}\n")
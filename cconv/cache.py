@@ -0,0 +1,66 @@
+"""On-disk conversion cache keyed by content hash, direction, version and options."""
+from __future__ import annotations
+
+import dataclasses
+import hashlib
+import os
+import tempfile
+from typing import Optional
+
+from . import __version__
+from .converter import ConvertOptions
+
+
+def default_cache_dir() -> str:
+    base = os.environ.get("XDG_CACHE_HOME") or os.path.join(os.path.expanduser("~"), ".cache")
+    return os.path.join(base, "cconv")
+
+
+def _options_key(options: ConvertOptions) -> str:
+    # sets are sorted so the key doesn't depend on hash randomization
+    items = []
+    for f in dataclasses.fields(options):
+        v = getattr(options, f.name)
+        items.append((f.name, sorted(v) if isinstance(v, (set, frozenset)) else v))
+    return repr(items)
+
+
+def cache_key(code: str, target: str, options: ConvertOptions) -> str:
+    h = hashlib.sha256()
+    # anything that can change the output belongs in the key
+    h.update(f"cconv {__version__}\0{target}\0{_options_key(options)}\0".encode("utf-8"))
+    h.update(code.encode("utf-8"))
+    return h.hexdigest()
+
+
+class ConversionCache:
+    """Flat directory of converted outputs, two-level fan-out by key prefix.
+
+    Writes go through a temp file and `os.replace`, so concurrent batch
+    workers never see a partial entry.
+    """
+
+    def __init__(self, root: str) -> None:
+        self.root = root
+
+    def _path(self, key: str) -> str:
+        return os.path.join(self.root, key[:2], key[2:])
+
+    def get(self, key: str) -> Optional[str]:
+        try:
+            with open(self._path(key), "r", encoding="utf-8", newline="") as f:
+                return f.read()
+        except (OSError, UnicodeDecodeError):
+            return None
+
+    def put(self, key: str, out: str) -> None:
+        path = self._path(key)
+        try:
+            os.makedirs(os.path.dirname(path), exist_ok=True)
+            fd, tmp = tempfile.mkstemp(dir=os.path.dirname(path), prefix=".tmp-")
+            with os.fdopen(fd, "w", encoding="utf-8", newline="") as f:
+                f.write(out)
+            os.replace(tmp, path)
+        except OSError:
+            # a cache that can't be written is just a slower run
+            pass
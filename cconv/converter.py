@@ -1,13 +1,216 @@
 from __future__ import annotations
 
+import bisect
 import re
-from typing import Dict, List, Tuple, Optional, Set
+import time
+import warnings
+from dataclasses import asdict, dataclass, field, fields
+from typing import Any, Callable, Dict, FrozenSet, List, Tuple, Optional, Set, Union
+
+from .linear import LazyPattern
+from .patch import Edit, EditMap, line_edits
+
+
+ENGINES = ("regex", "tokens", "tree-sitter")
+IO_STYLES = ("stream", "format")
+FORMAT_LIBS = ("std", "std-format", "fmt")
+OWNERSHIP_MODES = ("raw", "vector", "unique")
+ABIS = ("x86-64", "i386", "win64")
+
+
+@dataclass(frozen=True)
+class ConvertOptions:
+    """Settings for one conversion. The defaults give the plain rewrite:
+    printf -> std::cout ending lines with '\\n' (not std::endl), raw
+    new/delete, and no optional rewrite turned on.
+
+    engine: "regex" runs the pass pipeline below; "tokens" uses the
+      single-pass engine in `cconv.tokens` and "tree-sitter" the parser in
+      `cconv.treesitter` (both C -> C++ only; the C++ -> C direction always
+      uses the regex passes).
+    """
+    engine: str = "regex"
+    # names of RULES entries to skip for this conversion (see `rule_names()`)
+    disabled_rules: FrozenSet[str] = frozenset()
+    # printf -> cout: end lines with std::endl (flushes every line, the
+    # pre-0.3 output) instead of '\n' plus an explicit flush where needed
+    endl: bool = False
+    # C -> C++: start main() with sync_with_stdio(false) / cin.tie(nullptr)
+    # when no C stdio call survives the conversion
+    fast_io: bool = False
+    # C -> C++: "stream" turns printf into std::cout chains, "format" into a
+    # single formatting call with the width/precision kept; `format_lib`
+    # picks std::print (C++23), std::cout << std::format (C++20) or fmt::print
+    io_style: str = "stream"
+    format_lib: str = "std"
+    # C -> C++ heap arrays: "raw" gives new[]/delete[]; "vector" turns arrays
+    # that are only ever indexed into std::vector<T> (free goes away, realloc
+    # becomes resize); "unique" uses std::make_unique_for_overwrite<T[]> for
+    # the malloc'd ones that are never realloc'd
+    ownership: str = "raw"
+    # self-referential structs (list/tree nodes) get a free-list pool:
+    # C -> C++ routes new/delete through class operator new/delete, C++ -> C
+    # emits a slab allocator per type and calls it instead of malloc/free
+    node_pool: bool = False
+    # C -> C++: numeric #define array bounds / loop limits become constexpr
+    # constants and fixed global arrays std::array (C++ -> C always lowers
+    # both back to #define and plain arrays)
+    constexpr: bool = False
+    # both directions: adjacent output statements of a block become one call;
+    # C -> C++ loops that only print write through one std::string buffer
+    coalesce_output: bool = False
+    # both directions: when stdin is only read as numbers (scanf of %d/%f...,
+    # std::cin >> int/double variables), reads go through a generated
+    # reader that pulls 64 KiB blocks and parses the digits by hand
+    fast_input: bool = False
+    # C++ -> C: bool stays bool with <stdbool.h> (C99); c89 lowers it to int
+    # and true/false to 1/0
+    c89: bool = False
+    # C++ -> C: bool arrays of 64 elements or more that are only indexed are
+    # stored one bit per element, through the CCONV_BIT_* macros
+    pack_bools: bool = False
+    # both directions: struct members sorted by alignment when that removes
+    # padding and nothing depends on their order; sizes follow `abi`
+    reorder_fields: bool = False
+    abi: str = "x86-64"
+
+
+class ConversionWarning(UserWarning):
+    """A conversion gave up on its time budget and returned its input."""
+
+
+class ConversionError(ValueError):
+    """The input can't be converted into valid code, so the conversion stops:
+    a C++ -> C template use whose template arguments can't be worked out
+    would leave template syntax in the C output."""
+
+
+class _OverBudget(Exception):
+    pass
+
+
+@dataclass
+class ConversionStats:
+    """What one conversion did; returned by `convert(..., stats=True)`.
+
+    pass_seconds has one entry per rule that ran (per-line rule groups are
+    timed together as "a+b"), plus "token-walk" for the token engine. Rules
+    the trigger prefilter skipped have no entry.
+    rule_matches counts the matches each rule actually rewrote.
+    """
+    target: str = ""
+    engine: str = ""
+    bytes_in: int = 0
+    bytes_out: int = 0
+    seconds: float = 0.0
+    analysis_seconds: float = 0.0
+    pass_seconds: Dict[str, float] = field(default_factory=dict)
+    rule_matches: Dict[str, int] = field(default_factory=dict)
+    # rules the trigger prefilter skipped: none of their words was in the code
+    rules_skipped: int = 0
+    type_map_size: int = 0
+    typedefs: int = 0
+    # the time budget ran out: the output is the input unchanged
+    over_budget: bool = False
+
+    def add_pass(self, name: str, seconds: float) -> None:
+        self.pass_seconds[name] = self.pass_seconds.get(name, 0.0) + seconds
+
+    def count(self, rule: str, n: int = 1) -> None:
+        self.rule_matches[rule] = self.rule_matches.get(rule, 0) + n
+
+    def to_dict(self) -> Dict[str, object]:
+        return asdict(self)
 
 
 # Basic regex helpers
-_include_stdio = re.compile(r"^\s*#\s*include\s*<stdio\.h>\s*$", re.MULTILINE)
-_include_iostream = re.compile(r"^\s*#\s*include\s*<iostream>\s*$", re.MULTILINE)
-_include_stdlib = re.compile(r"^\s*#\s*include\s*<stdlib\.h>\s*$", re.MULTILINE)
+# [ \t] rather than \s: the line's newline (and blank lines around it) stay,
+# so a streamed chunk that ends in an include doesn't run into the next one
+_include_stdio = re.compile(r"^[ \t]*#[ \t]*include[ \t]*<stdio\.h>[ \t]*$", re.MULTILINE)
+_include_iostream = re.compile(r"^[ \t]*#[ \t]*include[ \t]*<iostream>[ \t]*$", re.MULTILINE)
+_include_stdlib = re.compile(r"^[ \t]*#[ \t]*include[ \t]*<stdlib\.h>[ \t]*$", re.MULTILINE)
+
+# Analysis patterns (typedef/declaration scans, expression shapes)
+_typedef_struct_alias = re.compile(r"typedef\s+struct\s+([A-Za-z_]\w*)\s+([A-Za-z_]\w*)\s*;")
+_typedef_struct_body = LazyPattern(r"typedef\s+struct\s+([A-Za-z_]\w*)\s*\{", r"\}\s*([A-Za-z_]\w*)\s*;", stop="}")
+_typedef_plain = re.compile(r"typedef\s+((?:struct\s+)?[A-Za-z_]\w*)\s+([A-Za-z_]\w*)\s*;")
+_struct_def = re.compile(r"struct\s+([A-Za-z_]\w*)\s*\{")
+# a whole struct definition whose body has no nested braces, up to its ';'
+_struct_full = re.compile(r"\bstruct\s+(?P<name>[A-Za-z_]\w*)\s*\{(?P<body>[^{}]*)\}(?P<tail>[^;{}]*);")
+# constexpr mode: numeric object-like macros and file-scope fixed arrays
+_numeric_define = re.compile(
+    r"^[ \t]*#[ \t]*define[ \t]+(?P<name>[A-Za-z_]\w*)[ \t]+"
+    r"(?P<val>\(?-?(?:0[xX][0-9a-fA-F]+|\d+)[uUlL]*\)?)"
+    r"(?P<rest>[ \t]*(?://[^\n]*|/\*[^\n]*?\*/)?)[ \t]*$",
+    re.MULTILINE,
+)
+# an unclosed comment runs to the end of the file, as it does for the compiler
+_comment_or_literal = re.compile(r"//[^\n]*|/\*.*?(?:\*/|\Z)|\"(?:[^\"\\\n]|\\.)*\"|'(?:[^'\\\n]|\\.)*'", re.DOTALL)
+_pp_line = re.compile(r"^[ \t]*#[^\n]*", re.MULTILINE)
+# a brace initializer, one level of nested braces deep (`{{1, 2}, {3, 4}}`).
+# Every run stops at a brace or `;`, so an initializer left open is given up
+# at the next declaration's `{` instead of rescanning the rest of the file
+# from each line that starts one.
+_BRACE_INIT = r"\{[^;{}]*(?:\{[^;{}]*\}[^;{}]*)*\}"
+_global_array = re.compile(
+    r"^(?P<q>(?:(?:static|const)\s+)*)(?P<T>(?:(?:unsigned|signed|short|long|struct)\s+)*[A-Za-z_]\w*)"
+    rf"[ \t]+(?P<name>[A-Za-z_]\w*)[ \t]*\[(?P<n>[^\[\]\n]+)\](?P<init>[ \t]*=[ \t]*{_BRACE_INIT})?[ \t]*;",
+    re.MULTILINE,
+)
+_std_array_decl = re.compile(
+    r"^(?P<q>(?:(?:static|const)\s+)*)std::array\s*<\s*(?P<T>[^,<>]+?)\s*,\s*(?P<n>[^<>;]+?)\s*>\s*"
+    rf"(?P<name>[A-Za-z_]\w*)(?P<init>\s*=?\s*{_BRACE_INIT})?\s*;",
+    re.MULTILINE,
+)
+# the leading run of preprocessor, // comment and blank lines
+_leading_block = re.compile(r"\A(?:[ \t]*(?:#|//)[^\n]*\n|[ \t]*\n)*")
+_decl = re.compile(r"^[ \t]*(?P<type>(?:struct\s+)?[A-Za-z_]\w*)\s+(?P<rest>[^;{}]+);", re.MULTILINE)
+_ident_prefix = re.compile(r"([A-Za-z_][A-Za-z0-9_]*)")
+_realloc_call = re.compile(r"realloc\s*\(\s*([A-Za-z_][A-Za-z0-9_]*)\s*,")
+# ownership mode: the statements an owned heap array may appear in
+_own_alloc = LazyPattern(
+    r"(?:(?P<lead>(?:^|(?<=[;{}]))[ \t]*)(?P<decl>(?:struct\s+)?(?P<T>[A-Za-z_]\w*)\s*\*\s*))?"
+    r"(?<![\w.>])(?P<name>[A-Za-z_]\w*)\s*=\s*(?:\(\s*(?:struct\s+)?[A-Za-z_]\w*\s*\*\s*\)\s*)?"
+    r"(?P<fn>malloc|calloc|realloc)\s*\(",
+    r"\)\s*;", stop=";", group="args", flags=re.MULTILINE,
+)
+_own_decl = re.compile(
+    r"^(?P<indent>[ \t]*)(?:struct\s+)?(?P<T>[A-Za-z_]\w*)\s*\*\s*(?P<name>[A-Za-z_]\w*)\s*"
+    r"(?:=\s*(?:NULL|0)\s*)?;",
+    re.MULTILINE,
+)
+_own_free = re.compile(r"(?P<lead>[ \t]*)\bfree\s*\(\s*(?P<name>[A-Za-z_]\w*)\s*\)\s*;(?P<eol>[ \t]*\n)?")
+_sizeof_times = re.compile(r"\s*sizeof\s*\([^()]*\)\s*\*\s*(?P<n>.+?)\s*")
+_times_sizeof = re.compile(r"\s*(?P<n>.+?)\s*\*\s*sizeof\s*\([^()]*\)\s*")
+_sizeof_only = re.compile(r"\s*sizeof\s*\([^()]*\)\s*")
+_subscript_after = re.compile(r"\s*\[")
+_expr_var = re.compile(r"[A-Za-z_][A-Za-z0-9_]*")
+_expr_deref = re.compile(r"\*\s*\(?\s*([A-Za-z_][A-Za-z0-9_]*)\s*\)?")
+_expr_index = re.compile(r"([A-Za-z_][A-Za-z0-9_]*)\s*\[.+\]")
+_expr_member = re.compile(r"[A-Za-z_][A-Za-z0-9_]*(?:\s*(?:->|\.)\s*[A-Za-z_][A-Za-z0-9_]*)+")
+_expr_call = re.compile(r"([A-Za-z_][A-Za-z0-9_]*)\s*\((?:[^()]|\([^()]*\))*\)")
+_ws = re.compile(r"\s+")
+_printf_call = re.compile(r"printf\s*\((.*)\)\s*;\s*", re.DOTALL)
+_scanf_call = re.compile(r"scanf\s*\((.*)\)\s*;\s*", re.DOTALL)
+# `%%` is its own token so it's never read as the start of a spec
+_printf_spec_split = re.compile(r"(%%|%[0-9]*\.?[0-9]*[dlfcsg])")
+# a stdin read right after an output statement; the prompt must be flushed
+_read_after = re.compile(r"\s*(?:scanf|getchar|gets|fgets)\s*\(")
+# C stdio calls that share buffers with std::cout/std::cin; unbuffered
+# stderr output (fprintf(stderr, ...), perror) doesn't care about syncing
+_c_stdio_call = re.compile(
+    r"\b(?:printf|scanf|puts|putchar|getchar|gets|fgets|fputs|fputc|putc|getc|fgetc|"
+    r"fread|fwrite|fflush|vprintf|fscanf|fprintf\s*\(\s*stdout|std::print|fmt::print)\s*\("
+)
+_main_body_open = re.compile(r"\bint\s+main\s*\([^)]*\)\s*\{[^\S\n]*\n?([ \t]*)")
+# one printf conversion spec: %[flags][width][.precision][length]conversion
+_printf_spec = re.compile(
+    r"%(?P<flags>[-+ #0]*)(?P<width>\*|\d+)?(?:\.(?P<prec>\*|\d*))?"
+    r"(?P<len>hh|h|ll|l|j|z|t|L|q)?(?P<conv>[diouxXeEfFgGaAcspn%])"
+)
+_c_string = re.compile(r'"(?:[^"\\\n]|\\.)*"')
+_stream_shift_out = re.compile(r"<<")
+_stream_shift_in = re.compile(r">>")
 
 
 def _collect_typedefs(code: str) -> Dict[str, str]:
@@ -20,35 +223,36 @@ def _collect_typedefs(code: str) -> Dict[str, str]:
     """
     tdefs: Dict[str, str] = {}
     # typedef struct Name Alias;
-    for m in re.finditer(r"typedef\s+struct\s+([A-Za-z_]\w*)\s+([A-Za-z_]\w*)\s*;", code):
+    for m in _typedef_struct_alias.finditer(code):
         base, alias = m.group(1), m.group(2)
         tdefs[alias] = f"struct {base}"
     # typedef struct Name { ... } Alias;
-    for m in re.finditer(r"typedef\s+struct\s+([A-Za-z_]\w*)\s*\{[^}]*\}\s*([A-Za-z_]\w*)\s*;", code, re.DOTALL):
+    for m in _typedef_struct_body.finditer(code):
         base, alias = m.group(1), m.group(2)
         tdefs[alias] = f"struct {base}"
     # typedef base Alias;
-    for m in re.finditer(r"typedef\s+((?:struct\s+)?[A-Za-z_]\w*)\s+([A-Za-z_]\w*)\s*;", code):
+    for m in _typedef_plain.finditer(code):
         base, alias = m.group(1), m.group(2)
         tdefs.setdefault(alias, base)
     return tdefs
 
 
-def _infer_decl_types(code: str) -> Dict[str, str]:
+def _infer_decl_types(code: str, typedefs: Optional[Dict[str, str]] = None) -> Dict[str, str]:
     """Infer simple variable types including primitives, struct types, and typedef aliases.
     Returns var->ctype; pointer stars included if declared as pointer.
+    Pass `typedefs` when they were already collected to avoid a second scan.
     """
     types: Dict[str, str] = {}
-    typedefs = _collect_typedefs(code)
+    if typedefs is None:
+        typedefs = _collect_typedefs(code)
     # discover declared struct names to accept 'struct Name'
-    struct_names = set(re.findall(r"struct\s+([A-Za-z_]\w*)\s*\{", code))
+    struct_names = set(_struct_def.findall(code))
 
     # Build a set of acceptable type tokens
     base_types = {"int", "long", "float", "double", "char", *{f"struct {s}" for s in struct_names}, *set(typedefs.keys())}
 
     # Match lines like: TYPE declarators;
-    decl_re = re.compile(r"^(?P<type>(?:struct\s+)?[A-Za-z_]\w*)\s+(?P<rest>[^;]+);", re.MULTILINE)
-    for m in decl_re.finditer(code):
+    for m in _decl.finditer(code):
         t = m.group("type")
         if t not in base_types:
             # also allow typedef that maps to struct/base
@@ -65,7 +269,7 @@ def _infer_decl_types(code: str) -> Dict[str, str]:
             while q.startswith("*"):
                 stars += 1
                 q = q[1:].lstrip()
-            name_match = re.match(r"([A-Za-z_][A-Za-z0-9_]*)", q)
+            name_match = _ident_prefix.match(q)
             if not name_match:
                 continue
             name = name_match.group(1)
@@ -75,6 +279,252 @@ def _infer_decl_types(code: str) -> Dict[str, str]:
     return types
 
 
+def _blank_comments(code: str) -> str:
+    """`code` with comments and literals blanked out; offsets and lines are kept."""
+    return _comment_or_literal.sub(lambda m: re.sub(r"[^\n]", " ", m.group(0)), code)
+
+
+def _text_before(code: str, pos: int, width: int = 64) -> str:
+    """The end of code[:pos].rstrip(), at most `width` characters: enough for
+    the checks on what precedes a match, without copying the file per match."""
+    end = pos
+    while end and code[end - 1].isspace():
+        end -= 1
+    return code[max(0, end - width):end]
+
+
+def _text_after(code: str, pos: int, width: int = 8) -> str:
+    """The start of code[pos:].lstrip(), at most `width` characters."""
+    start, n = pos, len(code)
+    while start < n and code[start].isspace():
+        start += 1
+    return code[start:start + width]
+
+
+def _alloc_count(m: re.Match) -> Optional[str]:
+    """Element count of an `_own_alloc` statement, or None if it isn't an array."""
+    args = _split_printf_args(m.group("args"))
+    fn = m.group("fn")
+    if fn == "calloc":
+        if len(args) == 2 and _sizeof_only.fullmatch(args[1]):
+            return args[0]
+        return None
+    if fn == "realloc":
+        if len(args) != 2 or args[0] != m.group("name") or m.group("decl"):
+            return None
+        args = args[1:]
+    if len(args) != 1:
+        return None
+    c = _sizeof_times.fullmatch(args[0]) or _times_sizeof.fullmatch(args[0])
+    return c.group("n") if c else None
+
+
+def _owned_arrays(code: str, mode: str) -> Dict[str, Tuple[str, str]]:
+    """Heap arrays the ownership mode can hand to a container: name -> (kind, T).
+
+    A pointer qualifies when it is declared on its own (`T *p;`, `T *p = NULL;`
+    or `T *p = malloc(...)`), every allocation of it has an element count,
+    and every other mention is a subscript or a `free(p)`. Anything else,
+    such as passing it on, pointer arithmetic or a second declarator, keeps
+    the raw new[]. kind is "unique" for malloc-only arrays in "unique" mode,
+    otherwise "vector".
+    """
+    code = _blank_comments(code)
+    fns: Dict[str, Set[str]] = {}
+    elem: Dict[str, str] = {}
+    bad: Set[str] = set()
+    # (start, end, name) of the statements where a mention of name is fine
+    spans: List[Tuple[int, int, str]] = []
+    for m in _own_alloc.finditer(code):
+        name = m.group("name")
+        if _alloc_count(m) is None:
+            bad.add(name)
+            continue
+        fns.setdefault(name, set()).add(m.group("fn"))
+        if m.group("T"):
+            if elem.setdefault(name, m.group("T")) != m.group("T"):
+                bad.add(name)
+        spans.append((m.start(), m.end(), name))
+    if not fns:
+        return {}
+    for m in _own_decl.finditer(code):
+        name = m.group("name")
+        if name in fns:
+            if elem.setdefault(name, m.group("T")) != m.group("T"):
+                bad.add(name)
+            spans.append((m.start(), m.end(), name))
+    for m in _own_free.finditer(code):
+        spans.append((m.start(), m.end(), m.group("name")))
+    spans.sort()
+    starts = [a for a, _, _ in spans]
+    names = [n for n in fns if n in elem and n not in bad]
+    if not names:
+        return {}
+    for m in re.finditer(r"\b(?:" + "|".join(map(re.escape, names)) + r")\b", code):
+        name = m.group(0)
+        if name in bad or _subscript_after.match(code, m.end()):
+            continue
+        i = bisect.bisect_right(starts, m.start()) - 1
+        if i < 0 or spans[i][1] < m.end() or spans[i][2] != name:
+            bad.add(name)
+    owned = {}
+    for name in names:
+        if name not in bad:
+            unique = mode == "unique" and fns[name] == {"malloc"}
+            owned[name] = ("unique" if unique else "vector", elem[name])
+    return owned
+
+
+def _self_referential_structs(code: str, typedefs: Dict[str, str]) -> Set[str]:
+    """Tags of structs with a pointer to their own type among the members."""
+    found: Set[str] = set()
+    for m in _struct_full.finditer(code):
+        name = m.group("name")
+        spellings = [name] + [a for a, t in typedefs.items() if t == f"struct {name}"]
+        own_ptr = r"\b(?:struct\s+)?(?:" + "|".join(map(re.escape, spellings)) + r")\s*\*"
+        if re.search(own_ptr, m.group("body")):
+            found.add(name)
+    return found
+
+
+def _pointer_vars(code: str, tags: Set[str], typedefs: Dict[str, str]) -> Dict[str, Optional[str]]:
+    """name -> struct tag for every `T *name` declared with one of `tags`.
+
+    Covers parameters and declarations the line-anchored scan misses; a
+    name declared with two different types maps to None.
+    """
+    spell = {t: t for t in tags}
+    spell.update({a: t[len("struct "):] for a, t in typedefs.items()
+                  if t.startswith("struct ") and t[len("struct "):] in tags})
+    decl = re.compile(r"\b(?:struct\s+)?(" + "|".join(map(re.escape, spell)) + r")\s*\*\s*([A-Za-z_]\w*)")
+    out: Dict[str, Optional[str]] = {}
+    for m in decl.finditer(code):
+        tag = spell[m.group(1)]
+        name = m.group(2)
+        if out.setdefault(name, tag) != tag:
+            out[name] = None
+    return out
+
+
+def _constexpr_macros(code: str) -> Set[str]:
+    """Numeric macros that can become constexpr constants.
+
+    The macro must be used as an array bound or next to a comparison (a
+    loop limit), and must not appear in any other preprocessor line: #if
+    can't see a constexpr, and #undef or a redefinition changes its meaning.
+    """
+    names = {m.group("name") for m in _numeric_define.finditer(code)}
+    if not names:
+        return set()
+    pp_words: Dict[str, int] = {}
+    for line in _pp_line.findall(code):
+        for w in set(_expr_var.findall(line)):
+            pp_words[w] = pp_words.get(w, 0) + 1
+    out = set()
+    for name in names:
+        if pp_words.get(name, 0) != 1:
+            continue
+        n = re.escape(name)
+        if re.search(rf"\[\s*{n}\b|[<>]=?\s*{n}\b|\b{n}\s*[<>]", code):
+            out.add(name)
+    return out
+
+
+def _std_arrays(code: str) -> Set[str]:
+    """File-scope fixed arrays that are only ever indexed, so std::array fits."""
+    names = {m.group("name"): m for m in _global_array.finditer(code)}
+    if not names:
+        return set()
+    code = _blank_comments(code)
+    bad: Set[str] = set()
+    decls = {m.start("name") for m in names.values()}
+    for m in re.finditer(r"(?<![\w.>])(?:" + "|".join(map(re.escape, names)) + r")\b", code):
+        if m.start() not in decls and not _subscript_after.match(code, m.end()):
+            bad.add(m.group(0))
+    return set(names) - bad
+
+
+class _ConversionContext:
+    """Symbol/type state shared by every pass of a single conversion.
+
+    Built once from the input so helpers like `cout_repl` don't rescan the
+    whole file per match; passes record what they learn (e.g. array vs scalar
+    allocations) on it as they rewrite the code.
+    """
+
+    def __init__(self, code: str = "", options: Optional[ConvertOptions] = None) -> None:
+        self.options = options or ConvertOptions()
+        self.typedefs: Dict[str, str] = {}
+        self.types: Dict[str, str] = {}
+        # var -> 'array' | 'scalar', filled by the allocation passes
+        self.allocs: Dict[str, str] = {}
+        # names that use realloc; their allocations are left alone
+        self.realloc_names: Set[str] = set()
+        # ownership mode: heap arrays that become containers, name -> (kind, T)
+        self.owned: Dict[str, Tuple[str, str]] = {}
+        # node_pool: struct tags that get a pool, and their pointer variables
+        self.pools: Set[str] = set()
+        self.pool_vars: Dict[str, Optional[str]] = {}
+        # constexpr: macros and global arrays to lower; std::array sizes (C++ -> C)
+        self.constants: Set[str] = set()
+        self.std_arrays: Set[str] = set()
+        self.array_sizes: Dict[str, str] = {}
+        # coalesce_output: printf arguments -> the C type their spec prints
+        self.printed: Dict[str, str] = {}
+        # fast_input: every stdin read can go through the block reader
+        self.bulk_input: Optional[bool] = None
+        # pack_bools: bool arrays stored as bitsets
+        self.bit_arrays: Set[str] = set()
+        # filled by the passes when the caller asked for stats
+        self.stats: Optional[ConversionStats] = None
+        # whole-code checks a callback makes, by name: (code, answer), so
+        # the matches of one pass share a single scan
+        self.scans: Dict[str, Tuple[str, bool]] = {}
+        # perf_counter() time past which the passes give up (convert's budget)
+        self.deadline: Optional[float] = None
+        # the code being converted starts the file; streaming clears it
+        # after the first chunk so `head` rules don't repeat mid-file
+        self.at_head = True
+        if code:
+            self.update(code)
+
+    def check_time(self) -> None:
+        if self.deadline is not None and time.perf_counter() > self.deadline:
+            raise _OverBudget
+
+    def update(self, code: str) -> None:
+        """Merge declarations from another piece of the same translation unit.
+
+        Streaming conversion calls this per chunk so the maps carry forward
+        without holding the whole input.
+        """
+        self.typedefs.update(_collect_typedefs(code))
+        self.types.update(_infer_decl_types(code, self.typedefs))
+        self.realloc_names.update(_realloc_call.findall(code))
+        if self.options.ownership != "raw":
+            self.owned.update(_owned_arrays(code, self.options.ownership))
+        if self.options.constexpr:
+            self.constants.update(_constexpr_macros(code))
+            self.std_arrays.update(_std_arrays(code))
+        if "std::array" in code:
+            for m in _std_array_decl.finditer(code):
+                self.array_sizes[m.group("name")] = m.group("n")
+        if self.options.node_pool:
+            self.pools.update(_self_referential_structs(code, self.typedefs))
+            if self.pools:
+                for name, tag in _pointer_vars(code, self.pools, self.typedefs).items():
+                    if self.pool_vars.setdefault(name, tag) != tag:
+                        self.pool_vars[name] = None
+        if self.options.pack_bools:
+            self.bit_arrays.update(_packable_bool_arrays(code))
+        if self.options.fast_input:
+            # a later piece (generated template code) can only rule it out
+            self.bulk_input = self.bulk_input is not False and _bulk_input(code, self.types)
+
+    def note_alloc(self, name: str, kind: str) -> None:
+        self.allocs[name] = kind
+
+
 def _fmt_for_type(ctype: str) -> str:
     base = ctype.replace("*", "")
     return {
@@ -96,11 +546,11 @@ def _fmt_for_type(ctype: str) -> str:
 def _expr_ctype(expr: str, types: Dict[str, str]) -> Optional[str]:
     expr = expr.strip()
     # var
-    m = re.fullmatch(r"[A-Za-z_][A-Za-z0-9_]*", expr)
+    m = _expr_var.fullmatch(expr)
     if m:
         return types.get(expr)
     # *var or *(var)
-    m = re.fullmatch(r"\*\s*\(?\s*([A-Za-z_][A-Za-z0-9_]*)\s*\)?", expr)
+    m = _expr_deref.fullmatch(expr)
     if m:
         v = m.group(1)
         t = types.get(v)
@@ -108,13 +558,20 @@ def _expr_ctype(expr: str, types: Dict[str, str]) -> Optional[str]:
             return t[:-1]
         return None
     # arr[i] or *(arr + i)
-    m = re.fullmatch(r"([A-Za-z_][A-Za-z0-9_]*)\s*\[.+\]", expr)
+    m = _expr_index.fullmatch(expr)
     if m:
         v = m.group(1)
         t = types.get(v)
         if t and t.endswith("*"):
             return t[:-1]
         return None
+    # a->b, a.b: recorded as is (see templates.py)
+    if _expr_member.fullmatch(expr):
+        return types.get(_ws.sub("", expr))
+    # f(...): return types are recorded under "f()"
+    m = _expr_call.fullmatch(expr)
+    if m:
+        return types.get(m.group(1) + "()")
     return None
 
 
@@ -147,9 +604,14 @@ def _split_printf_args(args: str) -> List[str]:
     return parts
 
 
-def _convert_printf_to_cout(call: str) -> str:
-    # call like: printf("x=%d\n", x);
-    m = re.match(r"printf\s*\((.*)\)\s*;\s*", call, re.DOTALL)
+def _convert_printf_to_cout(call: str, endl: bool = True, flush: bool = False) -> str:
+    """printf("x=%d\\n", x); -> std::cout << "x=" << (x) << ...;
+
+    A trailing newline becomes `std::endl` when `endl` is set, otherwise
+    '\\n'. `flush` asks for the output to be flushed (the next statement
+    reads stdin): std::endl for a trailing newline, std::flush otherwise.
+    """
+    m = _printf_call.match(call)
     if not m:
         return call
     args = _split_printf_args(m.group(1))
@@ -160,35 +622,154 @@ def _convert_printf_to_cout(call: str) -> str:
         return call
     fmt_str = fmt.strip().strip('"')
     out = "std::cout"
-    # replace format specifiers with stream insertions
-    specs = re.findall(r"%[0-9]*\.?[0-9]*[dlfcsg]", fmt_str)
-    # Split on specifiers to interleave literals and vars
-    tokens = re.split(r"(%[0-9]*\.?[0-9]*[dlfcsg])", fmt_str)
+    # Split on specifiers to interleave literals and vars; a %% joins the
+    # literal text around it as a plain %
+    tokens: List[Tuple[bool, str]] = []  # (is a spec, text)
+    for j, tok in enumerate(_printf_spec_split.split(fmt_str)):
+        spec = j % 2 == 1 and tok != "%%"
+        if not spec:
+            tok = "%" if tok == "%%" else tok
+            if tokens and not tokens[-1][0]:
+                tokens[-1] = (False, tokens[-1][1] + tok)
+                continue
+        if tok:
+            tokens.append((spec, tok))
     var_iter = iter(args[1:])
     newline = False
-    for tok in tokens:
-        if tok == '':
-            continue
-        if tok.startswith('%'):
+    for i, (spec, tok) in enumerate(tokens):
+        if spec:
             v = next(var_iter, None)
             if v is None:
                 out += " << \"%s\"" % tok
             else:
                 out += " << (" + v + ")"
         else:
-            if tok.endswith("\\n"):
+            # only the newline that ends the format becomes endl/'\n'
+            if i == len(tokens) - 1 and tok.endswith("\\n"):
                 tok = tok[:-2]
                 newline = True
             if tok:
-                out += " << \"" + tok.replace("\\", "\\\\").replace("\"", "\\\"") + "\""
+                # the literal is already escaped C source
+                out += " << \"" + tok + "\""
     if newline:
-        out += " << std::endl"
+        out += " << std::endl" if endl or flush else " << '\\n'"
+    elif flush:
+        out += " << std::flush"
     return out + ";"
 
 
+# printf converts the argument of %u/%o/%x/%X to the unsigned type of its
+# length modifier; std::format prints the value as it is, sign and all
+_UNSIGNED_FOR_LEN = {
+    "": ("unsigned", "unsigned int"),
+    "hh": ("unsigned char",),
+    "h": ("unsigned short", "unsigned short int"),
+    "l": ("unsigned long", "unsigned long int"),
+    "ll": ("unsigned long long", "unsigned long long int"),
+    "z": ("std::size_t", "size_t"),
+}
+
+
+def _format_spec(spec: re.Match, args: List[str],
+                 types: Dict[str, str]) -> Optional[Tuple[str, List[str]]]:
+    """One printf spec as a std::format replacement field, or None.
+
+    Consumes the spec's arguments from the front of `args` (a `*` width or
+    precision comes first, as printf takes them) and returns them in
+    std::format order: the value, then the nested width and precision.
+    """
+    flags, width, prec = spec.group("flags"), spec.group("width"), spec.group("prec")
+    length, conv = spec.group("len") or "", spec.group("conv")
+    if conv == "n" or conv in "aA" or (length == "l" and conv in "cs"):
+        return None
+    if conv in "diouxXcp" and prec is not None:
+        return None  # integer precision (minimum digits) has no std::format spelling
+    taken = []
+    for part in (width, prec):
+        if part == "*":
+            if not args:
+                return None
+            taken.append(args.pop(0))
+    if not args:
+        return None
+    value = args.pop(0)
+    if conv == "p":
+        value = f"static_cast<const void*>({value})"
+    elif conv in "ouxX":
+        unsigned = _UNSIGNED_FOR_LEN.get(length)
+        if unsigned is None:
+            return None
+        ctype = (_expr_ctype(value, types) or "").replace("const ", "").strip()
+        if ctype not in unsigned:
+            value = f"static_cast<{unsigned[0]}>({value})"
+    out = ""
+    if "-" in flags:
+        out += "<"
+    elif width and conv in "sc":
+        out += ">"  # printf right-aligns everything; std::format left-aligns text
+    if conv not in "scp":
+        out += "+" if "+" in flags else " " if " " in flags else ""
+        if "#" in flags:
+            out += "#"
+        if "0" in flags and "-" not in flags:
+            out += "0"
+    if width:
+        out += "{}" if width == "*" else width
+    if prec is not None:
+        out += ".{}" if prec == "*" else "." + (prec or "0")
+    if conv in "di" or conv == "u":
+        # a char argument would print as a character under the default type
+        if length == "hh" or _expr_ctype(value, types) == "char":
+            out += "d"
+    elif conv != "s":
+        out += conv
+    return ("{:" + out + "}" if out else "{}"), [value] + taken
+
+
+def _convert_printf_to_format(call: str, lib: str = "std", types: Optional[Dict[str, str]] = None,
+                              flush: bool = False) -> str:
+    """printf("%5.2f\n", x); -> std::print("{:5.2f}\n", x);
+
+    `lib` is "std" (std::print), "std-format" (std::cout << std::format) or
+    "fmt" (fmt::print). Returns `call` unchanged when the format isn't a
+    single literal or uses a spec with no std::format equivalent.
+    """
+    m = _printf_call.match(call)
+    if not m:
+        return call
+    args = _split_printf_args(m.group(1))
+    if not args or not _c_string.fullmatch(args[0]):
+        return call
+    fmt_str = args[0][1:-1]
+    rest = args[1:]
+    out_args: List[str] = []
+    pieces = []
+    pos = 0
+    for spec in _printf_spec.finditer(fmt_str):
+        pieces.append(fmt_str[pos:spec.start()].replace("{", "{{").replace("}", "}}"))
+        pos = spec.end()
+        if spec.group("conv") == "%":
+            pieces.append("%")
+            continue
+        field = _format_spec(spec, rest, types or {})
+        if field is None:
+            return call
+        pieces.append(field[0])
+        out_args.extend(field[1])
+    if "%" in fmt_str[pos:] or rest:
+        return call  # a malformed spec, or more arguments than specs
+    pieces.append(fmt_str[pos:].replace("{", "{{").replace("}", "}}"))
+    inner = ", ".join(['"' + "".join(pieces) + '"'] + out_args)
+    if lib == "fmt":
+        return f"fmt::print({inner});"
+    if lib == "std-format":
+        return f"std::cout << std::format({inner})" + (" << std::flush;" if flush else ";")
+    return f"std::print({inner});"
+
+
 def _convert_scanf_to_cin(call: str, types: Dict[str, str]) -> str:
     # scanf("%d %f", &x, &y);
-    m = re.match(r"scanf\s*\((.*)\)\s*;\s*", call, re.DOTALL)
+    m = _scanf_call.match(call)
     if not m:
         return call
     args = _split_printf_args(m.group(1))
@@ -197,8 +778,6 @@ def _convert_scanf_to_cin(call: str, types: Dict[str, str]) -> str:
     fmt = args[0]
     if not (fmt.startswith('"') or fmt.startswith("'")):
         return call
-    fmt_str = fmt.strip().strip('"')
-    specs = re.findall(r"%[0-9]*\.?[0-9]*[dlfcs]", fmt_str)
     vars = [a.lstrip('&').strip() for a in args[1:]]
     out = "std::cin"
     # pair vars up to specs
@@ -208,239 +787,1646 @@ def _convert_scanf_to_cin(call: str, types: Dict[str, str]) -> str:
     return out
 
 
-def _convert_new_delete_to_malloc_free(code: str) -> str:
-    # new T[n] -> (T*)malloc(sizeof(T) * n)
-    code = re.sub(r"new\s+([A-Za-z_][A-Za-z0-9_]*)\s*\[\s*([^\]]+)\s*\]",
-                  r"(\1*)malloc(sizeof(\1) * (\2))", code)
-    # new T -> (T*)malloc(sizeof(T))
-    code = re.sub(r"new\s+([A-Za-z_][A-Za-z0-9_]*)\b(?!\s*\[)",
-                  r"(\1*)malloc(sizeof(\1))", code)
-    # delete[] p -> free(p)
-    code = re.sub(r"delete\s*\[\s*\]\s*([A-Za-z_][A-Za-z0-9_]*)\s*;", r"free(\1);", code)
-    # delete p -> free(p)
-    code = re.sub(r"delete\s+([A-Za-z_][A-Za-z0-9_]*)\s*;", r"free(\1);", code)
-    return code
+# fast_input: when stdin only holds numbers, every read goes through a
+# generated block reader instead of scanf / std::cin >>
+_bulk_spec = re.compile(r"\s*%(?:(?:hh|h|ll|l|j|z)?[diu]|(?P<real>L?l?[fegFEG]))")
+_bulk_format = re.compile(r"(?:\s*%(?:(?:hh|h|ll|l|j|z)?[diu]|L?l?[fegFEG]))+\s*")
+_bulk_integer = re.compile(
+    r"(?:(?:unsigned|signed|short|long|int)\b\s*)+|(?:std::)?(?:size_t|ptrdiff_t|u?int(?:8|16|32|64)_t)")
+# stdin read some other way (getchar, fgets(..., stdin), std::cin.get, bare cin)
+_other_input = re.compile(r"\b(?:getchar|gets|vscanf|scanf_s|stdin)\b|\bcin\s*\.|(?<!::)\bcin\b")
+_cin_stmt = re.compile(r"std::cin\s*>>(.*?);", re.DOTALL)
 
 
-def _convert_malloc_free_to_new_delete(code: str, types: Dict[str, str] | None = None) -> str:
-    # Track array allocations for delete[]
-    allocs: Dict[str, str] = {}
-    types = types or {}
+def _bulk_lvalue(arg: str) -> str:
+    arg = arg.strip()
+    if arg.startswith("&"):
+        return arg[1:].strip()
+    return "*" + arg if _expr_var.fullmatch(arg) else f"*({arg})"
 
-    # Avoid converting allocations for variables that use realloc
-    realloc_names: Set[str] = set(re.findall(r"realloc\s*\(\s*([A-Za-z_][A-Za-z0-9_]*)\s*,", code))
 
-    def repl_array(m: re.Match) -> str:
-        name, T, n = m.group(1), m.group(2), m.group(3)
-        if name in realloc_names:
-            return m.group(0)
-        allocs[name] = 'array'
-        return f"{name} = new {T}[{n}];"
+def _bulk_scanf(call: str) -> Optional[List[Tuple[str, str]]]:
+    """(lvalue, "integer" | "real") per argument of a scanf of numbers only."""
+    m = _scanf_call.match(call)
+    args = _split_printf_args(m.group(1)) if m else []
+    if not args or not _c_string.fullmatch(args[0]) or not _bulk_format.fullmatch(args[0][1:-1]):
+        return None
+    kinds = ["real" if s.group("real") else "integer" for s in _bulk_spec.finditer(args[0][1:-1])]
+    if len(kinds) != len(args) - 1:
+        return None
+    return [(_bulk_lvalue(a), k) for a, k in zip(args[1:], kinds)]
 
-    def repl_scalar(m: re.Match) -> str:
-        name, T = m.group(1), m.group(2)
-        if name in realloc_names:
-            return m.group(0)
-        allocs[name] = 'scalar'
+
+def _bulk_cin(expr: str, types: Dict[str, str]) -> Optional[List[Tuple[str, str]]]:
+    """Same for the right side of `std::cin >> ...;`, from the declared types."""
+    reads = []
+    for v in (p.strip() for p in _stream_shift_in.split(expr)):
+        t = (_expr_ctype(v, types) or "").replace("const ", "").strip()
+        if t in ("float", "double", "long double"):
+            reads.append((v, "real"))
+        elif t and _bulk_integer.fullmatch(t):
+            reads.append((v, "integer"))
+        else:
+            return None
+    return reads
+
+
+def _bulk_input(code: str, types: Dict[str, str]) -> bool:
+    """fast_input: stdin is only read by whole scanf / std::cin >> statements
+    of numbers, so one reader can take over all of them."""
+    mask = _blank_comments(code)
+    if _other_input.search(mask):
+        return False
+    for m in re.finditer(r"\bscanf\b|\bstd::cin\b", mask):
+        before = _text_before(mask, m.start())
+        if before and before[-1] not in ";{})" and not re.search(r"\b(?:else|do)$", before):
+            return False  # the read is part of an expression (its result is used)
+        end = mask.find(";", m.end())
+        if end < 0:
+            return False
+        stmt = code[m.start():end + 1]
+        if m.group(0) == "scanf":
+            if _bulk_scanf(stmt) is None:
+                return False
+        else:
+            cin = _cin_stmt.fullmatch(stmt)
+            if not cin or _bulk_cin(cin.group(1), types) is None:
+                return False
+    return True
+
+
+def _bulk_reads(reads: List[Tuple[str, str]]) -> str:
+    # one statement, so it stays the body of a braceless if/loop
+    return ", ".join(f"{v} = cconv_read_{kind}()" for v, kind in reads) + ";"
+
+
+def _scanf_statement(call: str, ctx: _ConversionContext) -> str:
+    """C -> C++ for one `scanf(...);`: std::cin >>, or the fast_input reader.
+    Shared by the regex, tokens and tree-sitter engines."""
+    if ctx.options.fast_input and ctx.bulk_input:
+        reads = _bulk_scanf(call)
+        if reads:
+            return _bulk_reads(reads)
+    return _convert_scanf_to_cin(call, ctx.types)
+
+
+# ---------------------------------------------------------------------------
+# Rule table
+#
+# Every rewrite is one `Rule`: a precompiled pattern plus either a
+# replacement template or a callback `(match, ctx) -> str`. Rules run in
+# table order for their direction ("cpp" = C -> C++, "c" = C++ -> C), so the
+# table *is* the pipeline: includes, I/O, memory, idioms. Patterns compile
+# once at import, which keeps long-lived processes (web app, batch workers)
+# out of the `re` module cache.
+# ---------------------------------------------------------------------------
+
+Replacement = Union[str, Callable[[re.Match, _ConversionContext], str]]
+
+
+@dataclass
+class Rule:
+    name: str
+    direction: str          # target language: "cpp" or "c"
+    stage: str              # "templates" | "includes" | "io" | "ownership" | "memory" | "idioms" | "finish"
+    pattern: Union[re.Pattern, LazyPattern]  # LazyPattern for `start .*? close` shapes
+    repl: Replacement
+    per_line: bool = False  # match each line on its own (keeps lazy patterns on one line)
+    enabled: bool = True
+    # only run when this returns true for the conversion (None: always)
+    when: Optional[Callable[[_ConversionContext], bool]] = None
+    # words every match contains; the rule is skipped when none is in the
+    # code, and a per-line rule only visits lines holding one (): always run
+    triggers: Tuple[str, ...] = ()
+    # inserts at the top of the file (includes, helper code): a streamed
+    # conversion only runs it on the first chunk
+    head: bool = False
+
+
+# C -> C++ memory rules: malloc/calloc/free -> new/delete[/[]]
+# Each allocation records array vs scalar on ctx.allocs for the free rule,
+# and leaves names that are later realloc'd untouched.
+
+def _repl_cast_array(m: re.Match, ctx: _ConversionContext) -> str:
+    name, T, n = m.group(1), m.group(2), m.group(3)
+    if name in ctx.realloc_names:
+        return m.group(0)
+    ctx.note_alloc(name, 'array')
+    return f"{name} = new {T}[{n}];"
+
+
+def _repl_cast_scalar(m: re.Match, ctx: _ConversionContext) -> str:
+    name, T = m.group(1), m.group(2)
+    if name in ctx.realloc_names:
+        return m.group(0)
+    ctx.note_alloc(name, 'scalar')
+    return f"{name} = new {T};"
+
+
+def _repl_sizeof_ptr(m: re.Match, ctx: _ConversionContext) -> str:
+    name, T, n = m.group(1), m.group(2), m.group(3)
+    if name in ctx.realloc_names:
+        return m.group(0)
+    # If cast type T missing, try from declared type map
+    if not T:
+        decl = ctx.types.get(name)
+        if decl:
+            base = decl.replace('*', '').replace(' ', '')
+            T = base
+    if not T:
+        T = "int"  # fallback
+    if n:
+        ctx.note_alloc(name, 'array')
+        return f"{name} = new {T}[{n}];"
+    else:
+        ctx.note_alloc(name, 'scalar')
         return f"{name} = new {T};"
 
-    # p = (T*)malloc(sizeof(T) * n) with optional 'struct'
-    code = re.sub(
-        r"([A-Za-z_][A-Za-z0-9_]*)\s*=\s*\(\s*(?:struct\s+)?([A-Za-z_][A-Za-z0-9_]*)\s*\*\s*\)\s*malloc\s*\(\s*sizeof\(\s*(?:struct\s+)?\2\s*\)\s*\*\s*([^\)]+)\)\s*;",
-        repl_array,
-        code,
-    )
-    # p = (T*)malloc(sizeof(T)) with optional 'struct'
-    code = re.sub(
-        r"([A-Za-z_][A-Za-z0-9_]*)\s*=\s*\(\s*(?:struct\s+)?([A-Za-z_][A-Za-z0-9_]*)\s*\*\s*\)\s*malloc\s*\(\s*sizeof\(\s*(?:struct\s+)?\2\s*\)\s*\)\s*;",
-        repl_scalar,
-        code,
-    )
 
-    # With sizeof(*p) forms (cast optional)
-    def repl_sizeof_ptr(m: re.Match) -> str:
-        name, T, n = m.group(1), m.group(2), m.group(3)
-        if name in realloc_names:
-            return m.group(0)
-        # If cast type T missing, try from declared type map
-        if not T:
-            decl = types.get(name)
-            if decl:
-                base = decl.replace('*', '').replace(' ', '')
-                T = base
-        if not T:
-            T = "int"  # fallback
-        if n:
-            allocs[name] = 'array'
-            return f"{name} = new {T}[{n}];"
+# group 1 keeps the ';' and indentation before the declaration
+def _repl_lhs_type_array(m: re.Match, ctx: _ConversionContext) -> str:
+    lead, T, name, n = m.group(1), m.group(2), m.group(3), m.group(4)
+    if name in ctx.realloc_names:
+        return m.group(0)
+    ctx.note_alloc(name, 'array')
+    return f"{lead}{T}* {name} = new {T}[{n}];"
+
+
+def _repl_lhs_type_scalar(m: re.Match, ctx: _ConversionContext) -> str:
+    lead, T, name = m.group(1), m.group(2), m.group(3)
+    if name in ctx.realloc_names:
+        return m.group(0)
+    ctx.note_alloc(name, 'scalar')
+    return f"{lead}{T}* {name} = new {T};"
+
+
+def _repl_calloc_cast(m: re.Match, ctx: _ConversionContext) -> str:
+    name, T, n = m.group(1), m.group(2), m.group(3)
+    if name in ctx.realloc_names:
+        return m.group(0)
+    # calloc zero-fills; value-initialize to keep that
+    if n.strip() == '1':
+        ctx.note_alloc(name, 'scalar')
+        return f"{name} = new {T}();"
+    else:
+        ctx.note_alloc(name, 'array')
+        return f"{name} = new {T}[{n}]();"
+
+
+def _repl_calloc_sizeof_ptr(m: re.Match, ctx: _ConversionContext) -> str:
+    name, n = m.group(1), m.group(2)
+    if name in ctx.realloc_names:
+        return m.group(0)
+    decl = ctx.types.get(name, 'int')
+    T = decl.replace('*', '').replace(' ', '') or 'int'
+    # calloc zero-fills; value-initialize to keep that
+    if n.strip() == '1':
+        ctx.note_alloc(name, 'scalar')
+        return f"{name} = new {T}();"
+    else:
+        ctx.note_alloc(name, 'array')
+        return f"{name} = new {T}[{n}]();"
+
+
+def _printf_statement(call: str, ctx: _ConversionContext, read_next: bool) -> str:
+    """The C++ for one printf statement; `read_next` if a stdin read follows."""
+    opts = ctx.options
+    flush = not opts.endl and read_next
+    if opts.coalesce_output:
+        _note_printf_types(call, ctx.printed)
+    if opts.io_style == "format":
+        # std::print/fmt::print write to stdout, which stdin reads flush as in C
+        new = _convert_printf_to_format(call, opts.format_lib, ctx.types, flush)
+        if new != call:
+            return new
+    return _convert_printf_to_cout(call, endl=opts.endl, flush=flush)
+
+
+def _stdio_include(ctx: _ConversionContext) -> str:
+    opts = ctx.options
+    if opts.io_style != "format":
+        return "#include <iostream>"
+    header = {"std": "<print>", "std-format": "<format>", "fmt": "<fmt/core.h>"}[opts.format_lib]
+    # <iostream> stays for std::cin and printf calls kept as stream output
+    return f"#include {header}\n#include <iostream>"
+
+
+def _fflush_stdout(ctx: _ConversionContext) -> Optional[str]:
+    """Replacement for fflush(stdout);, or None to keep it."""
+    opts = ctx.options
+    if opts.endl or (opts.io_style == "format" and opts.format_lib != "std-format"):
+        return None
+    return "std::cout << std::flush;"
+
+
+def _repl_printf(m: re.Match, ctx: _ConversionContext) -> str:
+    return _printf_statement(m.group(0), ctx, bool(_read_after.match(m.string, m.end())))
+
+
+def _repl_fflush_stdout(m: re.Match, ctx: _ConversionContext) -> str:
+    return _fflush_stdout(ctx) or m.group(0)
+
+
+def _scan_once(ctx: _ConversionContext, name: str, code: str, check: Callable[[str], bool]) -> bool:
+    """check(code), worked out once for all the matches of a pass over `code`."""
+    seen = ctx.scans.get(name)
+    if seen is None or seen[0] is not code:
+        seen = ctx.scans[name] = (code, check(code))
+    return seen[1]
+
+
+def _repl_fast_io(m: re.Match, ctx: _ConversionContext) -> str:
+    mixed = _scan_once(ctx, "fast-io", m.string,
+                       lambda code: "sync_with_stdio" in code or bool(_c_stdio_call.search(code)))
+    if not ctx.options.fast_io or mixed:
+        return m.group(0)
+    indent = m.group(1) or "    "
+    setup = f"{indent}std::ios::sync_with_stdio(false);\n"
+    # untying cin is only safe when prompts are flushed before reads,
+    # which the '\n' output mode guarantees; with --endl they aren't
+    if not ctx.options.endl:
+        setup += f"{indent}std::cin.tie(nullptr);\n"
+    head = m.group(0)[:m.start(1) - m.start()]
+    if not head.endswith("\n"):
+        head += "\n"
+    return head + setup + m.group(1)
+
+
+# coalesce_output: the C type a plain printf spec prints, by length and conversion
+_SPEC_CTYPES = {
+    ("", "d"): "int", ("", "i"): "int", ("l", "d"): "long", ("l", "i"): "long",
+    ("ll", "d"): "long long", ("ll", "i"): "long long", ("", "u"): "unsigned",
+    ("l", "u"): "unsigned long", ("ll", "u"): "unsigned long long", ("z", "u"): "size_t",
+    ("", "c"): "char", ("", "s"): "char*",
+}
+# the expression types a print loop can append to a std::string
+_BUFFERABLE = {
+    "int": 11, "short": 6, "long": 20, "long long": 20, "unsigned": 10, "unsigned int": 10,
+    "unsigned short": 5, "unsigned long": 20, "unsigned long long": 20, "size_t": 20,
+    "char": 1, "char*": 16, "const char*": 16,
+}
+_literal = re.compile(r'"(?:[^"\\\n]|\\.)*"|\'(?:[^\'\\\n]|\\.)+\'')
+_cout_run = re.compile(r"(?:^[ \t]*std::cout\b[^\n]*(?:\n|\Z))+", re.MULTILINE)
+_printf_run = re.compile(r"(?:^[ \t]*printf[ \t]*\([^\n]*(?:\n|\Z)){2,}", re.MULTILINE)
+_cout_line = re.compile(r"^(?P<indent>[ \t]*)std::cout[ \t]*<<(?P<chain>.*);[ \t]*$")
+_printf_line = re.compile(r'^(?P<indent>[ \t]*)printf[ \t]*\((?P<args>.*)\)[ \t]*;[ \t]*$')
+# an argument or item that changes state or calls out (evaluation order)
+_side_effect = re.compile(r"\+\+|--|[A-Za-z_]\w*\s*\(|(?<![=!<>])=(?!=)")
+# a literal ending in a numeric escape would absorb the digits of the next one
+_numeric_escape_end = re.compile(r'\\(?:x[0-9A-Fa-f]+|[0-7]{1,3})"$')
+# a format ending in a lone '%' would start a spec in the next one
+_dangling_percent = re.compile(r'(?<!%)(?:%%)*%"$')
+_print_loop = re.compile(
+    r"^(?P<indent>[ \t]*)(?P<head>(?:for|while)[ \t]*\((?P<cond>[^(){}\n]*)\))[ \t]*"
+    r"(?P<body>\{[^{}]*\}|\n?[ \t]*std::cout\b[^;{}\n]*;)", re.MULTILINE)
+_count_loop = re.compile(r"^\s*(?:int|long|unsigned|size_t|std::size_t)?\s*(?P<i>[A-Za-z_]\w*)\s*=\s*0\s*;"
+                         r"\s*(?P=i)\s*<\s*(?P<n>[A-Za-z_]\w*|\d+)\s*;")
+_impure_stmt = re.compile(r"[(]|\bstd::|\b(?:return|goto|throw|case|default)\b")
+
+
+def _note_printf_types(call: str, printed: Dict[str, str]) -> None:
+    """Record the type of each plain `%d`/`%s`/... argument of a printf."""
+    m = _printf_call.match(call)
+    args = _split_printf_args(m.group(1)) if m else []
+    if not args or not _c_string.fullmatch(args[0]):
+        return
+    values = iter(args[1:])
+    for spec in _printf_spec.finditer(args[0][1:-1]):
+        if spec.group("conv") == "%":
+            continue
+        if "*" in (spec.group("width") or "") + (spec.group("prec") or ""):
+            return  # the arguments no longer line up with the specs
+        value = next(values, None)
+        if value is None:
+            return
+        ctype = _SPEC_CTYPES.get((spec.group("len") or "", spec.group("conv")))
+        if ctype and not (spec.group("flags") or spec.group("width") or spec.group("prec") is not None):
+            printed[_ws.sub("", value)] = ctype
+
+
+def _starts_block_statement(code: str, i: int) -> bool:
+    """The line at `i` is a statement of its block, not the body of a
+    braceless if/else/loop (or the rest of a longer statement)."""
+    end = code.rfind("\n", 0, i)
+    while end >= 0:
+        start = code.rfind("\n", 0, end) + 1
+        line = code[start:end]
+        cut = line.find("//")
+        line = (line if cut < 0 else line[:cut]).strip()
+        if line and not line.startswith(("/*", "*")):
+            return line[-1] in ";{}"
+        end = start - 1
+    return True
+
+
+def _top_split(text: str, sep: str) -> List[str]:
+    """`text` split at `sep` outside brackets and literals."""
+    mask = _blank_comments(text)
+    parts = []
+    depth = last = j = 0
+    while j < len(mask):
+        ch = mask[j]
+        if ch in "([{":
+            depth += 1
+        elif ch in ")]}":
+            depth -= 1
+        elif depth == 0 and mask.startswith(sep, j):
+            parts.append(text[last:j].strip())
+            last = j = j + len(sep)
+            continue
+        j += 1
+    parts.append(text[last:].strip())
+    return parts
+
+
+def _as_string(item: str) -> Optional[str]:
+    """A string or char literal item as a string literal, else None."""
+    if _c_string.fullmatch(item):
+        return item
+    if _literal.fullmatch(item) and item.startswith("'"):
+        inner = item[1:-1]
+        return '"' + {'"': '\\"', "\\'": "'"}.get(inner, inner) + '"'
+    return None
+
+
+_HEX_DIGITS = "0123456789abcdefABCDEF"
+
+
+class _FormatEnd:
+    """How the format literal being merged onto ends (`_numeric_escape_end`,
+    `_dangling_percent`), kept up to date as literals are appended so the
+    growing literal is never rescanned."""
+
+    def __init__(self, text: str) -> None:
+        self.percents = 0  # trailing '%'
+        self.digits = 0    # trailing hex digits
+        self.before = ""   # the two characters before those digits
+        self.last = ""     # the last three characters
+        self.add(text)
+
+    def add(self, text: str) -> None:
+        p = len(text) - len(text.rstrip("%"))
+        self.percents = self.percents + p if p == len(text) else p
+        d = len(text) - len(text.rstrip(_HEX_DIGITS))
+        if d < len(text):
+            self.before = (self.last + text[:len(text) - d])[-2:]
+            self.digits = d
         else:
-            allocs[name] = 'scalar'
-            return f"{name} = new {T};"
+            self.digits += d
+        self.last = (self.last + text)[-3:]
 
-    code = re.sub(
-        r"([A-Za-z_][A-Za-z0-9_]*)\s*=\s*(?:\(\s*(?:struct\s+)?([A-Za-z_][A-Za-z0-9_]*)\s*\*\s*\)\s*)?malloc\s*\(\s*sizeof\s*\(\s*\*\s*\1\s*\)\s*(?:\*\s*([^\)]+))?\)\s*;",
-        repl_sizeof_ptr,
-        code,
-    )
+    def escaped(self) -> bool:
+        """It ends in a numeric escape, which the next literal's digits would extend."""
+        d = self.digits
+        return ((d > 0 and self.before.endswith("\\x"))
+                or (0 < d <= 3 and self.before.endswith("\\") and all(c in "01234567" for c in self.last[-d:])))
 
-    # No-cast forms with explicit type on LHS: T* p = malloc(sizeof(T) * n) / sizeof(T)
-    def repl_lhs_type_array(m: re.Match) -> str:
-        T, name, n = m.group(1), m.group(2), m.group(3)
-        if name in realloc_names:
-            return m.group(0)
-        allocs[name] = 'array'
-        return f"{T}* {name} = new {T}[{n}];"
+    def open(self) -> bool:
+        """The next literal would extend an escape or start a spec."""
+        return self.percents % 2 == 1 or self.escaped()
 
-    def repl_lhs_type_scalar(m: re.Match) -> str:
-        T, name = m.group(1), m.group(2)
-        if name in realloc_names:
-            return m.group(0)
-        allocs[name] = 'scalar'
-        return f"{T}* {name} = new {T};"
 
-    code = re.sub(
-        r"(?:^|;)\s*(?:struct\s+)?([A-Za-z_][A-Za-z0-9_]*)\s*\*\s*([A-Za-z_][A-Za-z0-9_]*)\s*=\s*malloc\s*\(\s*sizeof\(\s*(?:struct\s+)?\1\s*\)\s*\*\s*([^\)]+)\)\s*;",
-        repl_lhs_type_array,
-        code,
-    )
-    code = re.sub(
-        r"(?:^|;)\s*(?:struct\s+)?([A-Za-z_][A-Za-z0-9_]*)\s*\*\s*([A-Za-z_][A-Za-z0-9_]*)\s*=\s*malloc\s*\(\s*sizeof\(\s*(?:struct\s+)?\1\s*\)\s*\)\s*;",
-        repl_lhs_type_scalar,
-        code,
-    )
+def _join_literals(items: List[str]) -> List[str]:
+    """Adjacent literal items as one: "a" << '\\n' -> "a\\n"."""
+    out: List[str] = []
+    # the pieces of the string out[-1] is becoming, without its closing quote
+    joined: List[str] = []
+    end: Optional[_FormatEnd] = None
+    for it in items:
+        lit = _as_string(it)
+        if lit is not None and end is not None and not end.escaped():
+            joined.append(lit[1:-1])
+            end.add(joined[-1])
+            continue
+        if len(joined) > 1:
+            out[-1] = "".join(joined) + '"'
+        out.append(it)
+        joined = [lit[:-1]] if lit is not None else []
+        end = _FormatEnd(joined[0]) if lit is not None else None
+    if len(joined) > 1:
+        out[-1] = "".join(joined) + '"'
+    return out
 
-    # calloc forms: (T*)calloc(n, sizeof(T)) or calloc(1, sizeof(T)) and sizeof(*p)
-    def repl_calloc_cast(m: re.Match) -> str:
-        name, T, n = m.group(1), m.group(2), m.group(3)
-        if name in realloc_names:
-            return m.group(0)
-        if n.strip() == '1':
-            allocs[name] = 'scalar'
-            return f"{name} = new {T};"
+
+def _pure(text: str) -> bool:
+    return not _side_effect.search(_blank_comments(text))
+
+
+def _coalesce_run(m: re.Match, parse, merge) -> str:
+    """Merge the adjacent statements of a run of output lines. `parse(line)`
+    gives (indent, parts) or None; `merge(indent, [parts, ...])` the statement.
+    A statement with side effects in its arguments stays on its own."""
+    out: List[str] = []
+    group: List[List[str]] = []
+    indent = ""
+    mergeable = False
+    at = m.start()
+    for k, ln in enumerate(m.group(0).split("\n")):
+        parsed = parse(ln) if ln.strip() else None
+        # the first line may be the body of a braceless if/loop
+        alone = k == 0 and not _starts_block_statement(m.string, at)
+        at += len(ln) + 1
+        pure = parsed is not None and not alone and _pure(" ".join(parsed[1]))
+        if group and not (pure and mergeable and parsed[0] == indent):
+            out.append(merge(indent, group))
+            group = []
+        if parsed is None:
+            out.append(ln)
+        elif alone:
+            out.append(merge(parsed[0], [parsed[1]]))
         else:
-            allocs[name] = 'array'
-            return f"{name} = new {T}[{n}];"
+            if not group:
+                indent, mergeable = parsed[0], pure
+            group.append(parsed[1])
+    if group:
+        out.append(merge(indent, group))
+    return "\n".join(out)
 
-    code = re.sub(
-        r"([A-Za-z_][A-Za-z0-9_]*)\s*=\s*\(\s*(?:struct\s+)?([A-Za-z_][A-Za-z0-9_]*)\s*\*\s*\)\s*calloc\s*\(\s*([^,]+)\s*,\s*sizeof\(\s*(?:struct\s+)?\2\s*\)\s*\)\s*;",
-        repl_calloc_cast,
-        code,
-    )
 
-    def repl_calloc_sizeof_ptr(m: re.Match) -> str:
-        name, n = m.group(1), m.group(2)
-        if name in realloc_names:
-            return m.group(0)
-        decl = types.get(name, 'int')
-        T = decl.replace('*', '').replace(' ', '') or 'int'
-        if n.strip() == '1':
-            allocs[name] = 'scalar'
-            return f"{name} = new {T};"
+def _parse_cout(line: str):
+    lm = _cout_line.match(line)
+    if not lm or _blank_comments(lm.group("chain")).count(";"):
+        return None
+    return lm.group("indent"), _top_split(lm.group("chain"), "<<")
+
+
+def _merge_cout(indent: str, chains: List[List[str]]) -> str:
+    items = _join_literals([it for chain in chains for it in chain])
+    return f"{indent}std::cout << {' << '.join(items)};"
+
+
+def _parse_printf(line: str):
+    lm = _printf_line.match(line)
+    if not lm or _blank_comments(lm.group("args")).count(";"):
+        return None
+    args = _top_split(lm.group("args"), ",")
+    if not _c_string.fullmatch(args[0]):
+        return None
+    return lm.group("indent"), args
+
+
+def _merge_printf(indent: str, calls: List[List[str]]) -> str:
+    fmt: List[str] = []
+    # the literal being built, without its closing quote
+    parts = [calls[0][0][:-1]]
+    end = _FormatEnd(parts[0])
+    args = list(calls[0][1:])
+    for call in calls[1:]:
+        if end.open():
+            fmt.append("".join(parts) + '"')
+            parts = [call[0][:-1]]
+            end = _FormatEnd(parts[0])
         else:
-            allocs[name] = 'array'
-            return f"{name} = new {T}[{n}];"
+            parts.append(call[0][1:-1])
+            end.add(parts[-1])
+        args.extend(call[1:])
+    fmt.append("".join(parts) + '"')
+    return f"{indent}printf({' '.join(fmt)}{''.join(', ' + a for a in args)});"
+
+
+def _repl_coalesce_cout(m: re.Match, ctx: _ConversionContext) -> str:
+    return _coalesce_run(m, _parse_cout, _merge_cout)
+
+
+def _repl_coalesce_printf(m: re.Match, ctx: _ConversionContext) -> str:
+    return _coalesce_run(m, _parse_printf, _merge_printf)
+
+
+def _unparen(item: str) -> str:
+    """`item` without the parentheses printf-to-cout puts around values."""
+    while item.startswith("(") and item.endswith(")") and _top_split(item[1:-1], ")") == [item[1:-1].strip()]:
+        item = item[1:-1].strip()
+    return item
+
+
+def _repl_print_loop(m: re.Match, ctx: _ConversionContext) -> str:
+    """A loop whose body only prints (and updates plain variables) appends
+    to a local std::string and writes it once after the loop."""
+    if not _starts_block_statement(m.string, m.start()) and _text_before(m.string, m.start()):
+        return m.group(0)
+    body = m.group("body").strip()
+    inner = body[1:-1] if body.startswith("{") else body
+    if "//" in _literal.sub('""', inner) or "/*" in _literal.sub('""', inner):
+        return m.group(0)
+    indent = m.group("indent")
+    step = indent + "        "
+    lines: List[str] = []
+    per_iteration = 0
+    printed = False
+    for stmt in _top_split(inner, ";"):
+        if not stmt:
+            continue
+        if not stmt.startswith("std::cout"):
+            if _impure_stmt.search(_blank_comments(stmt)):
+                return m.group(0)
+            lines.append(f"{step}{stmt};")
+            continue
+        pm = _parse_cout(stmt + ";")
+        if pm is None:
+            return m.group(0)
+        printed = True
+        for item in _join_literals(pm[1]):
+            if _as_string(item) is not None:
+                lines.append(f"{step}cconv_out += {item};")
+                per_iteration += len(item) - 2
+                continue
+            item = _unparen(item)
+            ctype = ctx.printed.get(_ws.sub("", item)) or _expr_ctype(item, ctx.types)
+            if ctype not in _BUFFERABLE:
+                return m.group(0)
+            per_iteration += _BUFFERABLE[ctype]
+            value = item if ctype in ("char", "char*", "const char*") else f"std::to_string({item})"
+            lines.append(f"{step}cconv_out += {value};")
+    if not printed:
+        return m.group(0)
+    out = [f"{indent}{{", f"{indent}    std::string cconv_out;"]
+    cm = _count_loop.match(m.group("cond")) if m.group("head").startswith("for") else None
+    if cm:
+        n = cm.group("n")
+        size = str(int(n) * per_iteration) if n.isdigit() else \
+            f"{n} > 0 ? static_cast<std::size_t>({n}) * {per_iteration} : 0"
+        out.append(f"{indent}    cconv_out.reserve({size});")
+    out.append(f"{indent}    {m.group('head')} {{")
+    out.extend(lines)
+    out += [f"{indent}    }}", f"{indent}    std::cout << cconv_out;", f"{indent}}}"]
+    return "\n".join(out)
+
+
+def _repl_string_include(m: re.Match, ctx: _ConversionContext) -> str:
+    code = m.string
+    if "std::string cconv_out;" not in code:
+        return m.group(0)
+    return _after_includes(m.group(0), _missing_includes(code, ["<string>"]))
+
+
+def _repl_free(m: re.Match, ctx: _ConversionContext) -> str:
+    name = m.group(1)
+    kind = ctx.allocs.get(name)
+    if kind == 'array':
+        return f"delete[] {name};"
+    return f"delete {name};"
+
+
+# C -> C++ ownership rules: owned heap arrays (see `_owned_arrays`) become
+# std::vector<T> or std::unique_ptr<T[]>; they run before the memory stage,
+# which handles everything else.
+
+def _repl_own_decl(m: re.Match, ctx: _ConversionContext) -> str:
+    own = ctx.owned.get(m.group("name"))
+    if not own:
+        return m.group(0)
+    kind, T = own
+    holder = f"std::vector<{T}>" if kind == "vector" else f"std::unique_ptr<{T}[]>"
+    return f"{m.group('indent')}{holder} {m.group('name')};"
 
-    code = re.sub(
-        r"([A-Za-z_][A-Za-z0-9_]*)\s*=\s*calloc\s*\(\s*([^,]+)\s*,\s*sizeof\(\s*\*\s*\1\s*\)\s*\)\s*;",
-        repl_calloc_sizeof_ptr,
-        code,
+
+def _repl_own_alloc(m: re.Match, ctx: _ConversionContext) -> str:
+    name = m.group("name")
+    own = ctx.owned.get(name)
+    n = _alloc_count(m) if own else None
+    if n is None:
+        return m.group(0)
+    kind, T = own
+    fn = m.group("fn")
+    if m.group("decl"):
+        lead = m.group("lead") or ""
+        if kind == "unique":
+            return f"{lead}auto {name} = std::make_unique_for_overwrite<{T}[]>({n});"
+        return f"{lead}std::vector<{T}> {name}({n});"
+    if kind == "unique":
+        return f"{name} = std::make_unique_for_overwrite<{T}[]>({n});"
+    if fn == "calloc":
+        # calloc promises zeros even when the vector already held elements
+        return f"{name}.assign({n}, {T}());"
+    return f"{name}.resize({n});"
+
+
+def _repl_own_free(m: re.Match, ctx: _ConversionContext) -> str:
+    if m.group("name") not in ctx.owned:
+        return m.group(0)
+    # the container frees itself; drop the statement (and its line if alone)
+    code, start = m.string, m.start()
+    prev = code[start - 1] if start else "\n"
+    eol = m.group("eol") or ""
+    if prev == "\n":
+        return "" if eol else m.group("lead")
+    if prev in ";{}":
+        return eol
+    return m.group("lead") + "{}" + eol
+
+
+def _after_includes(block: str, text: str) -> str:
+    """Insert `text` after the last #include of the leading `block`."""
+    last = block.rfind("#include")
+    at = block.index("\n", last) + 1 if last >= 0 else 0
+    return block[:at] + text + block[at:]
+
+
+def _missing_includes(code: str, headers: List[str]) -> str:
+    return "".join(f"#include {h}\n" for h in headers if f"#include {h}" not in code)
+
+
+def _repl_own_includes(m: re.Match, ctx: _ConversionContext) -> str:
+    code = m.string
+    headers = []
+    if "std::unique_ptr<" in code or "std::make_unique_for_overwrite<" in code:
+        headers.append("<memory>")
+    if "std::vector<" in code:
+        headers.append("<vector>")
+    return _after_includes(m.group(0), _missing_includes(code, headers))
+
+
+# node_pool: the pool behind the class operator new/delete of node structs
+_NODE_POOL_CPP = """
+// Free-list pool for node structs: objects are carved from blocks of 256
+// and recycled on delete; blocks live until exit. Not thread-safe.
+template <class T>
+class cconv_node_pool {
+public:
+    static void* allocate() {
+        cconv_node_pool& p = get();
+        if (Slot* s = p.free_) {
+            p.free_ = s->next;
+            return s;
+        }
+        if (p.left_ == 0) {
+            p.blocks_.emplace_back(new Slot[kBlock]);
+            p.cur_ = p.blocks_.back().get();
+            p.left_ = kBlock;
+        }
+        --p.left_;
+        return p.cur_++;
+    }
+    static void release(void* ptr) noexcept {
+        if (!ptr)
+            return;
+        cconv_node_pool& p = get();
+        Slot* s = static_cast<Slot*>(ptr);
+        s->next = p.free_;
+        p.free_ = s;
+    }
+
+private:
+    union Slot {
+        Slot* next;
+        alignas(T) unsigned char bytes[sizeof(T)];
+    };
+    static constexpr std::size_t kBlock = 256;
+    static cconv_node_pool& get() {
+        static cconv_node_pool pool;
+        return pool;
+    }
+    std::vector<std::unique_ptr<Slot[]>> blocks_;
+    Slot* free_ = nullptr;
+    Slot* cur_ = nullptr;
+    std::size_t left_ = 0;
+};
+"""
+
+
+def _repl_pool_members(m: re.Match, ctx: _ConversionContext) -> str:
+    name = m.group("name")
+    if name not in ctx.pools:
+        return m.group(0)
+    body = m.group("body")
+    indent = re.search(r"\n([ \t]*)\S", body)
+    indent = indent.group(1) if indent else "    "
+    head = body.rstrip(" \t")
+    if not head.endswith("\n"):
+        head += "\n"
+    members = (
+        f"{indent}static void* operator new(std::size_t) {{ return cconv_node_pool<{name}>::allocate(); }}\n"
+        f"{indent}static void operator delete(void* p) noexcept {{ cconv_node_pool<{name}>::release(p); }}\n"
     )
+    return f"struct {name} {{{head}{members}}}{m.group('tail')};"
 
-    # free(p) -> delete or delete[]
-    def repl_free(m: re.Match) -> str:
-        name = m.group(1)
-        kind = allocs.get(name)
-        if kind == 'array':
-            return f"delete[] {name};"
-        return f"delete {name};"
-
-    code = re.sub(r"free\s*\(\s*([A-Za-z_][A-Za-z0-9_]*)\s*\)\s*;", repl_free, code)
-    return code
 
+def _repl_pool_template(m: re.Match, ctx: _ConversionContext) -> str:
+    code = m.string
+    if "cconv_node_pool<" not in code or "class cconv_node_pool" in code:
+        return m.group(0)
+    text = _missing_includes(code, ["<cstddef>", "<memory>", "<vector>"]) + _NODE_POOL_CPP
+    return _after_includes(m.group(0), text)
 
-def convert_c_to_cpp(code: str) -> str:
-    # includes
-    if _include_stdio.search(code):
-        code = _include_stdio.sub("#include <iostream>", code)
-    # don't remove stdlib.h by default; harmless in C++
 
-    # printf / scanf
-    # convert line-by-line to keep semi-colons intact
-    types = _infer_decl_types(code)
-    lines = code.splitlines()
-    out_lines: List[str] = []
-    for ln in lines:
-        l = ln
-        l = re.sub(r"printf\s*\(.*?\)\s*;", lambda m: _convert_printf_to_cout(m.group(0)), l)
-        l = re.sub(r"scanf\s*\(.*?\)\s*;", lambda m: _convert_scanf_to_cin(m.group(0), types), l)
-        out_lines.append(l)
-    code = "\n".join(out_lines)
-
-    # malloc/free -> new/delete
-    code = _convert_malloc_free_to_new_delete(code, types)
+# fast_input: the block reader behind cconv_read_integer / cconv_read_real.
+# The same code for both targets, but for how a block is filled and spelled.
+_BULK_READER = {
+    "cpp": """
+// fast_input: stdin is read in 64 KiB blocks through std::cin's buffer and
+// the numbers are parsed by hand. Input must be whitespace-separated numbers;
+// a read past the end gives 0. Meant for piped or redirected input: on a
+// terminal a block only arrives when it is full or input ends.
+static char cconv_in_buf[1 << 16];
+static std::streamsize cconv_in_len = 0, cconv_in_pos = 0;
 
-    # idiomatic C++ tweaks: remove 'struct' in pointer declarations/usages and use nullptr
-    code = re.sub(r"\bstruct\s+([A-Za-z_][A-Za-z0-9_]*)\s*\*", r"\1*", code)
-    code = re.sub(r"\bNULL\b", "nullptr", code)
+static int cconv_in_peek() {
+    if (cconv_in_pos == cconv_in_len) {
+        cconv_in_len = std::cin.rdbuf()->sgetn(cconv_in_buf, sizeof cconv_in_buf);
+        cconv_in_pos = 0;
+        if (cconv_in_len <= 0) {
+            cconv_in_len = 0;
+            return -1;
+        }
+    }
+    return static_cast<unsigned char>(cconv_in_buf[cconv_in_pos]);
+}
 
-    # add using namespace std? avoid; we use std:: prefixes.
-    return code
+static int cconv_in_skip_space() {
+    int c;
+    while ((c = cconv_in_peek()) == ' ' || (c >= '\\t' && c <= '\\r'))
+        cconv_in_pos++;
+    return c;
+}
+""",
+    "c": """
+/* fast_input: stdin is read in 64 KiB blocks with fread and the numbers are
+   parsed by hand. Input must be whitespace-separated numbers; a read past
+   the end gives 0. Meant for piped or redirected input: on a terminal a
+   block only arrives when it is full or input ends. */
+static char cconv_in_buf[1 << 16];
+static size_t cconv_in_len = 0, cconv_in_pos = 0;
+
+static int cconv_in_peek(void) {
+    if (cconv_in_pos == cconv_in_len) {
+        cconv_in_len = fread(cconv_in_buf, 1, sizeof cconv_in_buf, stdin);
+        cconv_in_pos = 0;
+        if (cconv_in_len == 0)
+            return -1;
+    }
+    return (unsigned char)cconv_in_buf[cconv_in_pos];
+}
+
+static int cconv_in_skip_space(void) {
+    int c;
+    while ((c = cconv_in_peek()) == ' ' || (c >= '\\t' && c <= '\\r'))
+        cconv_in_pos++;
+    return c;
+}
+""",
+}
+
+_BULK_READ_INTEGER = """
+static long long cconv_read_integer(%(void)s) {
+    unsigned long long v = 0;
+    int c = cconv_in_skip_space();
+    int neg = c == '-';
+    if (c == '-' || c == '+')
+        cconv_in_pos++;
+    while ((c = cconv_in_peek()) >= '0' && c <= '9') {
+        v = v * 10 + (unsigned)(c - '0');
+        cconv_in_pos++;
+    }
+    return neg ? (long long)(0 - v) : (long long)v;
+}
+"""
 
+# strtod keeps the exact rounding of scanf's %f; only the token is copied
+_BULK_READ_REAL = """
+static double cconv_read_real(%(void)s) {
+    char tok[64];
+    %(size_t)s n = 0;
+    int c = cconv_in_skip_space();
+    while (c != -1 && c != ' ' && !(c >= '\\t' && c <= '\\r')) {
+        if (n < sizeof tok - 1)
+            tok[n++] = (char)c;
+        cconv_in_pos++;
+        c = cconv_in_peek();
+    }
+    tok[n] = '\\0';
+    return %(strtod)s(tok, %(null)s);
+}
+"""
 
-def convert_cpp_to_c(code: str) -> str:
-    # includes
-    if _include_iostream.search(code):
-        code = _include_iostream.sub("#include <stdio.h>\n#include <stdlib.h>", code)
 
-    # std::cout / std::cin
+def _repl_bulk_scanf(m: re.Match, ctx: _ConversionContext) -> str:
+    reads = _bulk_scanf(m.group(0))
+    return _bulk_reads(reads) if reads else m.group(0)
+
+
+def _repl_bulk_reader(m: re.Match, lang: str) -> str:
+    code = m.string
+    integer, real = "cconv_read_integer(" in code, "cconv_read_real(" in code
+    if not (integer or real) or "cconv_in_peek" in code:
+        return m.group(0)
+    spell = ({"void": "", "size_t": "std::size_t", "strtod": "std::strtod", "null": "nullptr"}
+             if lang == "cpp" else {"void": "void", "size_t": "size_t", "strtod": "strtod", "null": "NULL"})
+    text = _BULK_READER[lang]
+    if integer:
+        text += _BULK_READ_INTEGER % spell
+    if real:
+        text += _BULK_READ_REAL % spell
+    if lang == "cpp":
+        headers = ["<iostream>"] + (["<cstdlib>"] if real else [])
+    else:
+        headers = ["<stdio.h>"] + (["<stdlib.h>"] if real else [])
+    return _after_includes(m.group(0), _missing_includes(code, headers) + text)
+
+
+# C++ -> C node_pool: a slab allocator per pooled struct, right after its
+# definition, and new/delete of the struct routed to it
+
+_NODE_SLAB_C = """
+
+/* slab allocator for struct %(T)s: nodes come from blocks of 256 and are
+   recycled through a free list; blocks live until exit. Not thread-safe. */
+union %(T)s_slot {
+    union %(T)s_slot* next;
+    struct %(T)s obj;
+};
+static union %(T)s_slot* %(T)s_free_list;"""
+
+_NODE_SLAB_ALLOC_C = """
+static union %(T)s_slot* %(T)s_slab;
+static size_t %(T)s_slab_left;
+
+static struct %(T)s* %(T)s_pool_alloc(void) {
+    union %(T)s_slot* s = %(T)s_free_list;
+    if (s) {
+        %(T)s_free_list = s->next;
+        return &s->obj;
+    }
+    if (%(T)s_slab_left == 0) {
+        %(T)s_slab = (union %(T)s_slot*)malloc(256 * sizeof(union %(T)s_slot));
+        if (!%(T)s_slab)
+            return NULL;
+        %(T)s_slab_left = 256;
+    }
+    %(T)s_slab_left--;
+    return &(%(T)s_slab++)->obj;
+}"""
+
+_NODE_SLAB_FREE_C = """
+
+static void %(T)s_pool_free(struct %(T)s* p) {
+    union %(T)s_slot* s = (union %(T)s_slot*)p;
+    if (!s)
+        return;
+    s->next = %(T)s_free_list;
+    %(T)s_free_list = s;
+}"""
+
+
+def _repl_pool_slab(m: re.Match, ctx: _ConversionContext) -> str:
+    """The slab after a pooled struct, with only the functions the code calls
+    (runs after new/delete became T_pool_alloc()/T_pool_free(p)); an unused
+    static function would draw -Wunused-function."""
+    T = m.group("name")
+    if T not in ctx.pools:
+        return m.group(0)
+    alloc = re.search(rf"\b{T}_pool_alloc\s*\(", m.string) is not None
+    free = re.search(rf"\b{T}_pool_free\s*\(", m.string) is not None
+    if not (alloc or free):
+        return m.group(0)
+    slab = _NODE_SLAB_C + (_NODE_SLAB_ALLOC_C if alloc else "") + (_NODE_SLAB_FREE_C if free else "")
+    return m.group(0) + slab % {"T": T}
+
+
+def _repl_pool_new(m: re.Match, ctx: _ConversionContext) -> str:
+    T = m.group(1)
+    return f"{T}_pool_alloc()" if T in ctx.pools else m.group(0)
+
+
+def _repl_pool_delete(m: re.Match, ctx: _ConversionContext) -> str:
+    # `delete self->head;` goes by the member's declared type
+    tag = ctx.pool_vars.get(re.split(r"\s*(?:->|\.)\s*", m.group(1))[-1])
+    return f"{tag}_pool_free({m.group(1)});" if tag else m.group(0)
+
+
+# constexpr mode (C -> C++) and its lowering back to C
+
+def _repl_define_constexpr(m: re.Match, ctx: _ConversionContext) -> str:
+    name, val = m.group("name"), m.group("val")
+    if name not in ctx.constants:
+        return m.group(0)
+    # an unsuffixed decimal is an int; anything else keeps its literal type
+    T = "int" if re.fullmatch(r"\(?-?\d+\)?", val) and abs(int(val.strip("()"))) < 2**31 else "auto"
+    return f"constexpr {T} {name} = {val};{m.group('rest')}"
+
+
+def _repl_std_array(m: re.Match, ctx: _ConversionContext) -> str:
+    if m.group("name") not in ctx.std_arrays:
+        return m.group(0)
+    T = re.sub(r"^struct\s+", "", m.group("T"))
+    return f"{m.group('q')}std::array<{T}, {m.group('n').strip()}> {m.group('name')}{m.group('init') or ''};"
+
+
+def _repl_array_include(m: re.Match, ctx: _ConversionContext) -> str:
+    code = m.string
+    if "std::array<" not in code:
+        return m.group(0)
+    return _after_includes(m.group(0), _missing_includes(code, ["<array>"]))
+
+
+def _repl_constexpr_define(m: re.Match, ctx: _ConversionContext) -> str:
+    val = m.group("val").strip()
+    if not re.fullmatch(r"-?\w+|\(.*\)", val):
+        val = f"({val})"  # the macro must expand as one operand
+    return f"#define {m.group('name')} {val}{m.group('rest')}"
+
+
+def _repl_array_to_c(m: re.Match, ctx: _ConversionContext) -> str:
+    init = m.group("init") or ""
+    if init and "=" not in init:
+        # C needs `= {...}` and rejects an empty brace list
+        inner = init.strip()[1:-1].strip()
+        init = f" = {{{inner or '0'}}}"
+    return f"{m.group('q')}{m.group('T')} {m.group('name')}[{m.group('n')}]{init};"
+
+
+def _repl_array_member(m: re.Match, ctx: _ConversionContext) -> str:
+    n = ctx.array_sizes.get(m.group(1))
+    if n is None:
+        return m.group(0)
+    return f"({n})" if m.group(2) == "size" else m.group(1)
+
+
+_bool_word = re.compile(r"\b(?:bool|true|false)\b")
+
+
+def _repl_stdbool_include(m: re.Match, ctx: _ConversionContext) -> str:
+    code = m.string
+    if "<stdbool.h>" in code or not _bool_word.search(code):
+        return m.group(0)
+    # only blank the comments (a whole-file pass) when a word is there at all
+    if not _bool_word.search(_blank_comments(code)):
+        return m.group(0)
+    return _after_includes(m.group(0), "#include <stdbool.h>\n")
+
+
+# pack_bools: a bool array becomes unsigned char storage with one bit per
+# element. Every use must be `a[i]` with an index free of side effects (the
+# macros evaluate it twice); a store must be a statement of its own.
+_BIT_MIN = 64
+_bool_array_decl = re.compile(
+    r"^(?P<lead>[ \t]*(?:static\s+)?)bool\s+(?P<name>[A-Za-z_]\w*)\s*\[\s*(?P<n>[^\]\n]+?)\s*\]"
+    r"\s*(?P<init>=\s*\{\s*(?:0|false)?\s*\})?\s*;", re.MULTILINE)
+_bit_index = r"\[(?P<i>[^\[\]]*(?:\[[^\[\]]*\][^\[\]]*)*)\]"
+_bit_use = re.compile(r"(?P<name>[A-Za-z_]\w*)\s*" + _bit_index)
+_bit_store = re.compile(r"(?<![\w.>])(?P<name>[A-Za-z_]\w*)\s*" + _bit_index + r"\s*=(?!=)\s*(?P<v>[^;]+);")
+_bit_load = re.compile(r"(?<![\w.>])" + _bit_use.pattern)
+# the word before a use that doesn't make it a declaration of another type
+_bit_use_after = {"return", "else", "do", "case", "sizeof"}
+
+_BIT_MACROS = """
+/* pack_bools: bool arrays stored one bit per element */
+#define CCONV_BIT_BYTES(n) (((n) + 7) / 8)
+#define CCONV_BIT_GET(a, i) (((a)[(size_t)(i) >> 3] >> ((size_t)(i) & 7)) & 1)
+#define CCONV_BIT_SET(a, i, v) do { \\
+    if (v) (a)[(size_t)(i) >> 3] |= (unsigned char)(1u << ((size_t)(i) & 7)); \\
+    else (a)[(size_t)(i) >> 3] &= (unsigned char)~(1u << ((size_t)(i) & 7)); \\
+} while (0)
+"""
+
+
+def _array_bound(mask: str, n: str) -> Optional[int]:
+    """The value of an array bound: a literal, or a numeric #define / const."""
+    if n.isdigit():
+        return int(n)
+    if not _expr_var.fullmatch(n):
+        return None
+    m = re.search(rf"^[ \t]*#[ \t]*define[ \t]+{n}[ \t]+\(?(\d+)\)?[ \t]*$", mask, re.MULTILINE) \
+        or re.search(rf"\b(?:const|constexpr)\s+(?:static\s+)?\w+\s+{n}\s*=\s*(\d+)\s*;", mask)
+    return int(m.group(1)) if m else None
+
+
+def _packable_bool_arrays(code: str) -> Set[str]:
+    mask = _blank_comments(code)
+    decls: Dict[str, List[int]] = {}
+    for m in _bool_array_decl.finditer(mask):
+        size = _array_bound(mask, m.group("n"))
+        if size is not None and size >= _BIT_MIN:
+            decls.setdefault(m.group("name"), []).append(m.start("name"))
+        else:
+            decls.setdefault(m.group("name"), []).append(-1)  # one small array rules the name out
+    out: Set[str] = set()
+    for name, starts in decls.items():
+        if -1 in starts or re.search(rf"(?:\.|->)\s*{name}\b", mask):
+            continue  # a struct member
+        for u in re.finditer(rf"(?<![\w.>]){name}\b", mask):
+            if u.start() in starts:
+                continue
+            use = _bit_use.match(mask, u.start())
+            if not use or _side_effect.search(use.group("i")):
+                break  # the bare array (memset, a call, &a) or an index with effects
+            before = _text_before(mask, u.start())
+            after = _text_after(mask, use.end())
+            word = re.search(r"(\w+)$", before)
+            if word and word.group(1) not in _bit_use_after:
+                break  # another declaration of the name
+            if before.endswith(("&", "++", "--")) and not before.endswith("&&") \
+                    or re.match(r"\+\+|--|\[|(?:[-+*/%&|^]|<<|>>)=", after):
+                break
+            if re.match(r"=(?!=)", after) and before and before[-1] not in ";{})" \
+                    and not re.search(r"\b(?:else|do)$", before):
+                break  # a store inside an expression
+        else:
+            out.add(name)
+    return out
+
+
+def _repl_bool_array(m: re.Match, ctx: _ConversionContext) -> str:
+    if m.group("name") not in ctx.bit_arrays:
+        return m.group(0)
+    init = " = {0}" if m.group("init") else ""
+    return f"{m.group('lead')}unsigned char {m.group('name')}[CCONV_BIT_BYTES({m.group('n')})]{init};"
+
+
+def _bit_element(m: re.Match, ctx: _ConversionContext) -> bool:
+    # not the declaration itself: pack-bool-array rewrites that after the uses
+    return m.group("name") in ctx.bit_arrays and not re.search(r"\bbool$", _text_before(m.string, m.start()))
+
+
+def _repl_bit_store(m: re.Match, ctx: _ConversionContext) -> str:
+    if not _bit_element(m, ctx):
+        return m.group(0)
+    return f"CCONV_BIT_SET({m.group('name')}, {m.group('i').strip()}, {m.group('v').strip()});"
+
+
+def _repl_bit_load(m: re.Match, ctx: _ConversionContext) -> str:
+    if not _bit_element(m, ctx):
+        return m.group(0)
+    return f"CCONV_BIT_GET({m.group('name')}, {m.group('i').strip()})"
+
+
+def _repl_bit_macros(m: re.Match, ctx: _ConversionContext) -> str:
+    code = m.string
+    if "CCONV_BIT_BYTES(" not in code or "#define CCONV_BIT_GET" in code:
+        return m.group(0)
+    headers = [] if re.search(r"<(?:stdio|stdlib|stddef|string)\.h>", code) else ["<stddef.h>"]
+    return _after_includes(m.group(0), _missing_includes(code, headers) + _BIT_MACROS)
+
+
+# C++ -> C I/O rules
+
+def _repl_cout(m: re.Match, ctx: _ConversionContext) -> str:
     # Convert simple cout chains ending with optional std::endl
-    def cout_repl(m: re.Match) -> str:
-        expr = m.group(1)
-        # break by '<<'
-        parts = [p.strip() for p in re.split(r"<<", expr)]
-        fmt: List[str] = []
-        vs: List[str] = []
-        for p in parts:
-            if p == "std::endl":
-                fmt.append("\\n")
-            elif p.startswith('"'):
-                lit = p.strip().strip('"')
-                fmt.append(lit)
-            else:
-                vs.append(p)
-                # Try to infer format based on a simple type map
-                # Build a quick type map for current code
-                tmap = _infer_decl_types(code)
-                ctp = _expr_ctype(p, tmap)
-                fmt.append(_fmt_for_type(ctp or "int"))
-        fmt_str = "".join(fmt)
-        # build printf call
-        args = (", " + ", ".join(vs)) if vs else ""
-        return f'printf("{fmt_str}"{args});'
-
-    code = re.sub(r"std::cout\s*<<(.*?);", cout_repl, code)
+    expr = m.group(1)
+    # break by '<<'
+    parts = [p.strip() for p in _stream_shift_out.split(expr)]
+    fmt: List[str] = []
+    vs: List[str] = []
+    flush = False
+    for p in parts:
+        # std::endl and '\n' both end the line; std::flush becomes fflush
+        if p in ("std::endl", "'\\n'"):
+            fmt.append("\\n")
+        elif p == "std::flush":
+            flush = True
+        elif p.startswith('"'):
+            lit = p.strip().strip('"')
+            fmt.append(lit)
+        else:
+            vs.append(p)
+            # Try to infer format based on the shared type map
+            ctp = _expr_ctype(p, ctx.types)
+            fmt.append(_fmt_for_type(ctp or "int"))
+    fmt_str = "".join(fmt)
+    # build printf call
+    args = (", " + ", ".join(vs)) if vs else ""
+    if flush:
+        if not fmt_str:
+            return "fflush(stdout);"
+        return f'printf("{fmt_str}"{args}); fflush(stdout);'
+    return f'printf("{fmt_str}"{args});'
 
+
+def _repl_cin(m: re.Match, ctx: _ConversionContext) -> str:
     # std::cin >> x >> y;
-    def cin_repl(m: re.Match) -> str:
-        expr = m.group(1)
-        vars = [p.strip() for p in re.split(r">>", expr)]
-        # naive types: default to %d
-        fmts = ["%d" for _ in vars]
-        fmt = " ".join(fmts)
-        vaddrs = ["&" + v for v in vars]
-        args = ", ".join(vaddrs)
-        return f'scanf("{fmt}", {args});'
-
-    code = re.sub(r"std::cin\s*>>(.*?);", cin_repl, code)
+    expr = m.group(1)
+    if ctx.options.fast_input and ctx.bulk_input:
+        reads = _bulk_cin(expr, ctx.types)
+        if reads:
+            return _bulk_reads(reads)
+    vars = [p.strip() for p in _stream_shift_in.split(expr)]
+    # formats from the shared type map; unknown types default to %d
+    ctypes = [_expr_ctype(v, ctx.types) or "int" for v in vars]
+    fmts = [_fmt_for_type(t) for t in ctypes]
+    fmt = " ".join(fmts)
+    # char* already decays to an address
+    vaddrs = [v if t == "char*" else "&" + v for v, t in zip(vars, ctypes)]
+    args = ", ".join(vaddrs)
+    return f'scanf("{fmt}", {args});'
+
+
+# throw std::out_of_range("...");  (a string literal argument only)
+_throw_literal = re.compile(
+    r'(?P<indent>^[ \t]*)?\bthrow\s+[A-Za-z_][\w:]*\s*\(\s*"(?P<msg>(?:[^"\\\n]|\\.)*)"\s*\)\s*;',
+    re.MULTILINE)
+
+
+def _repl_throw(m: re.Match, ctx: _ConversionContext) -> str:
+    # no exceptions in C: report and exit, as an uncaught exception would
+    msg = m.group("msg")
+    args = f'"%s\\n", "{msg}"' if "%" in msg else f'"{msg}\\n"'
+    indent = m.group("indent") or ""
+    before = _text_before(m.string, m.start())
+    if m.group("indent") is None or before.endswith(")") or re.search(r"\b(?:else|do)$", before):
+        # the body of a braceless if/else/loop
+        return f"{indent}{{ fprintf(stderr, {args}); exit(1); }}"
+    return f"{indent}fprintf(stderr, {args});\n{indent}exit(1);"
+
+
+def _repl_reorder_fields(m: re.Match, ctx: _ConversionContext, cpp: bool) -> str:
+    from .layout import reorder_fields
+    return reorder_fields(m, ctx.options.abi, cpp)
+
 
+def _repl_templates(m: re.Match, ctx: _ConversionContext) -> str:
+    # imported here: the pass is large and most inputs have no templates
+    from .templates import monomorphize
+    return monomorphize(m.group(0), ctx)
+
+
+# from the first template to the end of the file (its uses follow it)
+_template_tail = re.compile(r"^[ \t]*template[ \t]*<[\s\S]*", re.MULTILINE)
+
+_ID = r"[A-Za-z_][A-Za-z0-9_]*"
+# a name or a member of one: `p`, `self->data`, `q.buf` (delete operands)
+_ID_PATH = rf"{_ID}(?:\s*(?:->|\.)\s*{_ID})*"
+# repeat bound of a size argument captured up to its `,`, `)` or `]`:
+# unbounded, a statement that never gets there has every later start
+# scan to the end of the file
+_ARG = "{1,256}"
+
+RULES: List[Rule] = [
+    # ---- C -> C++ ----
+    Rule("include-stdio", "cpp", "includes", _include_stdio, lambda m, ctx: _stdio_include(ctx),
+         triggers=("<stdio.h>",)),
+    # don't remove stdlib.h by default; harmless in C++
+    # one statement per line; [^\S\n] is \s without the newline
+    Rule("printf-to-cout", "cpp", "io", LazyPattern(r"printf[^\S\n]*\(", r"\)[^\S\n]*;"), _repl_printf,
+         triggers=("printf",)),
+    Rule("fflush-stdout", "cpp", "io", re.compile(r"\bfflush\s*\(\s*stdout\s*\)\s*;"), _repl_fflush_stdout,
+         triggers=("fflush",)),
+    Rule("scanf-to-cin", "cpp", "io", LazyPattern(r"scanf\s*\(", r"\)\s*;"),
+         lambda m, ctx: _scanf_statement(m.group(0), ctx), per_line=True, triggers=("scanf",)),
+    # ownership mode: heap arrays that are only indexed become containers
+    Rule("own-array-decl", "cpp", "ownership", _own_decl, _repl_own_decl, when=lambda ctx: bool(ctx.owned)),
+    Rule("own-array-alloc", "cpp", "ownership", _own_alloc, _repl_own_alloc, when=lambda ctx: bool(ctx.owned),
+         triggers=("malloc", "calloc", "realloc")),
+    Rule("own-array-free", "cpp", "ownership", _own_free, _repl_own_free, when=lambda ctx: bool(ctx.owned),
+         triggers=("free",)),
+    # node_pool: self-referential structs allocate through cconv_node_pool<T>
+    Rule("node-pool-members", "cpp", "ownership", _struct_full, _repl_pool_members,
+         when=lambda ctx: bool(ctx.pools), triggers=("struct",)),
+    # p = (T*)malloc(sizeof(T) * n) with optional 'struct'
+    Rule("malloc-cast-array", "cpp", "memory", re.compile(
+        rf"({_ID})\s*=\s*\(\s*(?:struct\s+)?({_ID})\s*\*\s*\)\s*malloc\s*\(\s*sizeof\(\s*(?:struct\s+)?\2\s*\)\s*\*\s*([^\)]{_ARG})\)\s*;"),
+         _repl_cast_array, triggers=("malloc",)),
+    # p = (T*)malloc(sizeof(T)) with optional 'struct'
+    Rule("malloc-cast-scalar", "cpp", "memory", re.compile(
+        rf"({_ID})\s*=\s*\(\s*(?:struct\s+)?({_ID})\s*\*\s*\)\s*malloc\s*\(\s*sizeof\(\s*(?:struct\s+)?\2\s*\)\s*\)\s*;"),
+         _repl_cast_scalar, triggers=("malloc",)),
+    # With sizeof(*p) forms (cast optional)
+    Rule("malloc-sizeof-ptr", "cpp", "memory", re.compile(
+        rf"({_ID})\s*=\s*(?:\(\s*(?:struct\s+)?({_ID})\s*\*\s*\)\s*)?malloc\s*\(\s*sizeof\s*\(\s*\*\s*\1\s*\)\s*(?:\*\s*([^\)]{_ARG}))?\)\s*;"),
+         _repl_sizeof_ptr, triggers=("malloc",)),
+    # No-cast forms with explicit type on LHS: T* p = malloc(sizeof(T) * n) / sizeof(T)
+    Rule("malloc-typed-array", "cpp", "memory", re.compile(
+        rf"((?:^|;)\s*)(?:struct\s+)?({_ID})\s*\*\s*({_ID})\s*=\s*malloc\s*\(\s*sizeof\(\s*(?:struct\s+)?\2\s*\)\s*\*\s*([^\)]{_ARG})\)\s*;"),
+         _repl_lhs_type_array, triggers=("malloc",)),
+    Rule("malloc-typed-scalar", "cpp", "memory", re.compile(
+        rf"((?:^|;)\s*)(?:struct\s+)?({_ID})\s*\*\s*({_ID})\s*=\s*malloc\s*\(\s*sizeof\(\s*(?:struct\s+)?\2\s*\)\s*\)\s*;"),
+         _repl_lhs_type_scalar, triggers=("malloc",)),
+    # calloc forms: (T*)calloc(n, sizeof(T)) or calloc(1, sizeof(T)) and sizeof(*p)
+    Rule("calloc-cast", "cpp", "memory", re.compile(
+        rf"({_ID})\s*=\s*\(\s*(?:struct\s+)?({_ID})\s*\*\s*\)\s*calloc\s*\(\s*([^,]{_ARG})\s*,\s*sizeof\(\s*(?:struct\s+)?\2\s*\)\s*\)\s*;"),
+         _repl_calloc_cast, triggers=("calloc",)),
+    Rule("calloc-sizeof-ptr", "cpp", "memory", re.compile(
+        rf"({_ID})\s*=\s*calloc\s*\(\s*([^,]{_ARG})\s*,\s*sizeof\(\s*\*\s*\1\s*\)\s*\)\s*;"),
+         _repl_calloc_sizeof_ptr, triggers=("calloc",)),
+    # free(p) -> delete or delete[]
+    Rule("free-to-delete", "cpp", "memory", re.compile(rf"free\s*\(\s*({_ID})\s*\)\s*;"), _repl_free,
+         triggers=("free",)),
+    # idiomatic C++ tweaks: remove 'struct' in pointer declarations/usages and use nullptr
+    Rule("struct-ptr", "cpp", "idioms", re.compile(rf"\bstruct\s+({_ID})\s*\*"), r"\1*", triggers=("struct",)),
+    Rule("null-to-nullptr", "cpp", "idioms", re.compile(r"\bNULL\b"), "nullptr", triggers=("NULL",)),
+    # whole-program passes over the converted code (the token engine runs these too)
+    # constexpr mode: #define bounds -> constexpr, fixed global arrays -> std::array
+    Rule("define-to-constexpr", "cpp", "finish", _numeric_define, _repl_define_constexpr,
+         when=lambda ctx: bool(ctx.constants), triggers=("define",)),
+    Rule("array-to-std-array", "cpp", "finish", _global_array, _repl_std_array,
+         when=lambda ctx: bool(ctx.std_arrays)),
+    Rule("std-array-include", "cpp", "finish", _leading_block, _repl_array_include,
+         when=lambda ctx: bool(ctx.std_arrays), head=True),
+    Rule("node-pool-template", "cpp", "finish", _leading_block, _repl_pool_template,
+         when=lambda ctx: bool(ctx.pools), head=True),
+    Rule("own-array-includes", "cpp", "finish", _leading_block, _repl_own_includes,
+         when=lambda ctx: bool(ctx.owned), head=True),
+    Rule("fast-io", "cpp", "finish", _main_body_open, _repl_fast_io, when=lambda ctx: ctx.options.fast_io,
+         triggers=("main",)),
+    # coalesce_output: one stream insert per run of cout statements, and a
+    # std::string buffer for loops that only print
+    Rule("coalesce-cout", "cpp", "finish", _cout_run, _repl_coalesce_cout,
+         when=lambda ctx: ctx.options.coalesce_output, triggers=("std::cout",)),
+    Rule("buffer-print-loops", "cpp", "finish", _print_loop, _repl_print_loop,
+         when=lambda ctx: ctx.options.coalesce_output, triggers=("for", "while")),
+    Rule("string-include", "cpp", "finish", _leading_block, _repl_string_include,
+         when=lambda ctx: ctx.options.coalesce_output, head=True),
+    Rule("reorder-fields", "cpp", "finish", _struct_full, lambda m, ctx: _repl_reorder_fields(m, ctx, True),
+         when=lambda ctx: ctx.options.reorder_fields, triggers=("struct",)),
+    Rule("fast-input-reader", "cpp", "finish", _leading_block, lambda m, ctx: _repl_bulk_reader(m, "cpp"),
+         when=lambda ctx: ctx.options.fast_input, head=True),
+    # add using namespace std? avoid; we use std:: prefixes.
+
+    # ---- C++ -> C ----
+    # class and function templates -> one struct / function per instantiation
+    Rule("monomorphize-templates", "c", "templates", _template_tail, _repl_templates, triggers=("template",)),
+    Rule("include-iostream", "c", "includes", _include_iostream, "#include <stdio.h>\n#include <stdlib.h>",
+         triggers=("<iostream>",)),
+    Rule("cout-to-printf", "c", "io", LazyPattern(r"std::cout\s*<<", ";", group=True), _repl_cout, triggers=("std::cout",)),
+    Rule("cin-to-scanf", "c", "io", LazyPattern(r"std::cin\s*>>", ";", group=True), _repl_cin, triggers=("std::cin",)),
+    # fast_input: scanf calls already in the C++ source
+    Rule("fast-input-scanf", "c", "io", LazyPattern(r"\bscanf\s*\(", r"\)\s*;"),
+         _repl_bulk_scanf, per_line=True, when=lambda ctx: ctx.options.fast_input and bool(ctx.bulk_input),
+         triggers=("scanf",)),
+    Rule("throw-to-exit", "c", "io", _throw_literal, _repl_throw, triggers=("throw",)),
+    Rule("include-stdexcept", "c", "includes",
+         re.compile(r"^[ \t]*#[ \t]*include[ \t]*<stdexcept>[ \t]*\n", re.MULTILINE), "",
+         triggers=("<stdexcept>",)),
     # nullptr, bool, true/false -> C equivalents
-    code = re.sub(r"\bnullptr\b", "NULL", code)
-    # Replace bool declarations with int (simple cases)
-    code = re.sub(r"\bbool\b", "int", code)
-    code = re.sub(r"\btrue\b", "1", code)
-    code = re.sub(r"\bfalse\b", "0", code)
+    Rule("nullptr-to-null", "c", "idioms", re.compile(r"\bnullptr\b"), "NULL", triggers=("nullptr",)),
+    # pack_bools: large bool arrays that are only indexed become bitsets
+    Rule("pack-bool-store", "c", "idioms", _bit_store, _repl_bit_store, when=lambda ctx: bool(ctx.bit_arrays)),
+    Rule("pack-bool-load", "c", "idioms", _bit_load, _repl_bit_load, when=lambda ctx: bool(ctx.bit_arrays)),
+    Rule("pack-bool-array", "c", "idioms", _bool_array_decl, _repl_bool_array,
+         when=lambda ctx: bool(ctx.bit_arrays), triggers=("bool",)),
+    # bool stays bool through <stdbool.h>; c89 has neither, so int, 1 and 0
+    Rule("bool-to-int", "c", "idioms", re.compile(r"\bbool\b"), "int", when=lambda ctx: ctx.options.c89,
+         triggers=("bool",)),
+    Rule("true-to-1", "c", "idioms", re.compile(r"\btrue\b"), "1", when=lambda ctx: ctx.options.c89,
+         triggers=("true",)),
+    Rule("false-to-0", "c", "idioms", re.compile(r"\bfalse\b"), "0", when=lambda ctx: ctx.options.c89,
+         triggers=("false",)),
+    # file-scope constexpr constants and std::array stay compile-time in C
+    Rule("constexpr-to-define", "c", "idioms", re.compile(
+        rf"^(?:static\s+)?constexpr\s+[^=;\n]*?\b(?P<name>{_ID})\s*=\s*(?P<val>[^;\n]+);(?P<rest>[^\n]*)",
+        re.MULTILINE), _repl_constexpr_define, triggers=("constexpr",)),
+    # a constexpr left in a function is a plain const local in C
+    Rule("constexpr-to-const", "c", "idioms", re.compile(r"\bconstexpr\b"), "const", triggers=("constexpr",)),
+    Rule("std-array-to-array", "c", "idioms", _std_array_decl, _repl_array_to_c, triggers=("std::array",)),
+    Rule("std-array-members", "c", "idioms", re.compile(rf"\b({_ID})\s*\.\s*(size|data)\s*\(\s*\)"),
+         _repl_array_member, when=lambda ctx: bool(ctx.array_sizes)),
+    Rule("include-array", "c", "includes", re.compile(r"^[ \t]*#[ \t]*include[ \t]*<array>[ \t]*\n", re.MULTILINE), "",
+         triggers=("<array>",)),
+    Rule("node-pool-new", "c", "memory", re.compile(rf"\bnew\s+(?:struct\s+)?({_ID})\b(?!\s*[\[({{])"),
+         _repl_pool_new, when=lambda ctx: bool(ctx.pools), triggers=("new",)),
+    Rule("node-pool-delete", "c", "memory", re.compile(rf"\bdelete\s+({_ID_PATH})\s*;"), _repl_pool_delete,
+         when=lambda ctx: bool(ctx.pools), triggers=("delete",)),
+    # node_pool: slab allocator for self-referential structs, once the calls
+    # above show which of its functions are used
+    Rule("node-slab", "c", "memory", _struct_full, _repl_pool_slab, when=lambda ctx: bool(ctx.pools),
+         triggers=("struct",)),
+    # new T[n] -> (T*)malloc(sizeof(T) * n)
+    Rule("new-array", "c", "memory", re.compile(rf"new\s+({_ID})\s*\[\s*([^\]]{_ARG})\s*\]"),
+         r"(\1*)malloc(sizeof(\1) * (\2))", triggers=("new",)),
+    # new T -> (T*)malloc(sizeof(T))
+    Rule("new-scalar", "c", "memory", re.compile(rf"new\s+({_ID})\b(?!\s*\[)"), r"(\1*)malloc(sizeof(\1))",
+         triggers=("new",)),
+    # delete[] p -> free(p)
+    Rule("delete-array", "c", "memory", re.compile(rf"delete\s*\[\s*\]\s*({_ID_PATH})\s*;"), r"free(\1);",
+         triggers=("delete",)),
+    # delete p -> free(p)
+    Rule("delete-scalar", "c", "memory", re.compile(rf"delete\s+({_ID_PATH})\s*;"), r"free(\1);",
+         triggers=("delete",)),
+    # coalesce_output: one printf per run of printf statements
+    Rule("coalesce-printf", "c", "finish", _printf_run, _repl_coalesce_printf,
+         when=lambda ctx: ctx.options.coalesce_output, triggers=("printf",)),
+    Rule("reorder-fields-c", "c", "finish", _struct_full, lambda m, ctx: _repl_reorder_fields(m, ctx, False),
+         when=lambda ctx: ctx.options.reorder_fields, triggers=("struct",)),
+    Rule("include-stdbool", "c", "finish", _leading_block, _repl_stdbool_include,
+         when=lambda ctx: not ctx.options.c89, triggers=("bool", "true", "false"), head=True),
+    Rule("pack-bool-macros", "c", "finish", _leading_block, _repl_bit_macros,
+         when=lambda ctx: bool(ctx.bit_arrays), head=True),
+    Rule("fast-input-reader-c", "c", "finish", _leading_block, lambda m, ctx: _repl_bulk_reader(m, "c"),
+         when=lambda ctx: ctx.options.fast_input, head=True),
+]
+
+
+def rule_names(direction: Optional[str] = None) -> List[str]:
+    return [r.name for r in RULES if direction is None or r.direction == direction]
+
+
+def add_rule(rule: Rule, before: Optional[str] = None) -> None:
+    """Register a rule. By default it runs after the last rule of its stage
+    for its direction; pass `before` to run it ahead of a named rule."""
+    if any(r.name == rule.name for r in RULES):
+        raise ValueError(f"duplicate rule name: {rule.name}")
+    if before is not None:
+        idx = next(i for i, r in enumerate(RULES) if r.name == before)
+    else:
+        idx = len(RULES)
+        for i, r in enumerate(RULES):
+            if r.direction == rule.direction and r.stage == rule.stage:
+                idx = i + 1
+    RULES.insert(idx, rule)
+
 
-    # new/delete -> malloc/free
-    code = _convert_new_delete_to_malloc_free(code)
+def _sub(rule: Rule, code: str, ctx: _ConversionContext,
+         edits: Optional[List[Tuple[int, int, str]]] = None) -> str:
+    repl = rule.repl
+    stats = ctx.stats
+    if edits is not None:
+        # record (start, end, replacement) of every match the rule changes
+        expand = (lambda m: m.expand(repl)) if isinstance(repl, str) else (lambda m: repl(m, ctx))
 
+        def tracked(m: re.Match) -> str:
+            out = expand(m)
+            if out != m.group(0):
+                edits.append((m.start(), m.end(), out))
+                if stats is not None:
+                    stats.count(rule.name)
+            return out
+        return rule.pattern.sub(tracked, code)
+    if isinstance(repl, str):
+        if stats is None:
+            return rule.pattern.sub(repl, code)
+        code, n = rule.pattern.subn(repl, code)
+        if n:
+            stats.count(rule.name, n)
+        return code
+    if stats is None:
+        return rule.pattern.sub(lambda m: repl(m, ctx), code)
+
+    def counted(m: re.Match) -> str:
+        out = repl(m, ctx)
+        # callbacks decline a match by returning it unchanged
+        if out != m.group(0):
+            stats.count(rule.name)
+        return out
+    return rule.pattern.sub(counted, code)
+
+
+# trigger words of a rule set -> one alternation over all of them
+_trigger_patterns: Dict[Tuple[str, ...], re.Pattern] = {}
+
+
+class _Triggers:
+    """Where the trigger words of a rule set occur in the code.
+
+    One scan of the code finds every occurrence (overlapping ones too). It is
+    redone only when a rule asks for a word the last scan didn't see and the
+    code has changed since: a rewrite can introduce its words (the
+    monomorphizer's output has `new` and `std::cout`).
+    """
+
+    def __init__(self, rules: List[Rule]) -> None:
+        words = tuple(sorted({w for r in rules for w in r.triggers}))
+        rx = _trigger_patterns.get(words)
+        if rx is None and words:
+            rx = _trigger_patterns[words] = re.compile(
+                "|".join(re.escape(w) for w in sorted(words, key=len, reverse=True)))
+        self.rx = rx
+        self.text: Optional[str] = None
+        self.hits: Dict[str, List[int]] = {}
+
+    def scan(self, code: str) -> None:
+        hits: Dict[str, List[int]] = {}
+        if self.rx is not None:
+            search = self.rx.search
+            m = search(code)
+            while m:
+                hits.setdefault(m.group(), []).append(m.start())
+                m = search(code, m.start() + 1)
+        self.text, self.hits = code, hits
+
+    def _fresh(self, code: str) -> bool:
+        if code is self.text or code == self.text:
+            return False
+        self.scan(code)
+        return True
+
+    def may_match(self, rule: Rule, code: str) -> bool:
+        if not rule.triggers or any(w in self.hits for w in rule.triggers):
+            return True
+        # not seen: only a rewrite since the last scan can have added it
+        return self._fresh(code) and any(w in self.hits for w in rule.triggers)
+
+    def lines(self, group: List[Rule], code: str) -> Optional[List[int]]:
+        """Indices of the lines a per-line group has to visit, None for all."""
+        if not all(r.triggers for r in group):
+            return None
+        self._fresh(code)
+        starts = sorted(p for w in {w for r in group for w in r.triggers} for p in self.hits.get(w, ()))
+        out: List[int] = []
+        line = last = 0
+        for p in starts:
+            line += code.count("\n", last, p)
+            last = p
+            if not out or out[-1] != line:
+                out.append(line)
+        return out
+
+
+def _run_rules(code: str, direction: str, ctx: _ConversionContext, stage: Optional[str] = None,
+               skip: Tuple[str, ...] = (), edits: Optional[EditMap] = None) -> str:
+    """Apply the enabled rules for `direction` (optionally one stage, or all
+    but the `skip` stages) in table order.
+
+    Rules whose triggers don't occur in the code are skipped. Consecutive
+    per-line rules share a single walk over the lines that hold a trigger.
+    With `edits`, every pass's rewrites are composed onto it, so it ends up
+    holding the whole conversion as replacements of the input.
+    """
+    rules = [r for r in RULES
+             if r.direction == direction and r.enabled and r.name not in ctx.options.disabled_rules
+             and (stage is None or r.stage == stage) and r.stage not in skip
+             and (r.when is None or r.when(ctx)) and (ctx.at_head or not r.head)]
+    stats = ctx.stats
+    triggers = _Triggers(rules)
+    triggers.scan(code)
+    i = 0
+    while i < len(rules):
+        ctx.check_time()
+        t0 = time.perf_counter() if stats is not None else 0.0
+        if not rules[i].per_line:
+            if triggers.may_match(rules[i], code):
+                found: Optional[List[Tuple[int, int, str]]] = [] if edits is not None else None
+                code = _sub(rules[i], code, ctx, found)
+                if found:
+                    edits.apply(found)
+                if stats is not None:
+                    stats.add_pass(rules[i].name, time.perf_counter() - t0)
+            elif stats is not None:
+                stats.rules_skipped += 1
+            i += 1
+            continue
+        j = i
+        while j < len(rules) and rules[j].per_line:
+            j += 1
+        group = rules[i:j]
+        # an earlier rule of the group can write a later one's trigger into
+        # a line it visits, so every rule stays in and each line is checked
+        visit = triggers.lines(group, code)
+        if stats is not None:
+            stats.rules_skipped += sum(not triggers.may_match(r, code) for r in group)
+        if visit is None or visit:
+            # split on '\n' only so CRLF endings and the final newline survive
+            lines = code.split("\n")
+            changed: List[int] = []
+            for n, k in enumerate(range(len(lines)) if visit is None else visit):
+                if not n & 1023:
+                    ctx.check_time()
+                ln = lines[k]
+                for r in group:
+                    if not r.triggers or any(w in ln for w in r.triggers):
+                        ln = _sub(r, ln, ctx)
+                if edits is not None and ln != lines[k]:
+                    changed.append(k)
+                lines[k] = ln
+            if changed:
+                # a changed line is one replacement of the whole line
+                old, pos, k0 = code.split("\n"), 0, 0
+                found = []
+                for k in changed:
+                    pos += sum(len(x) + 1 for x in old[k0:k])
+                    found.append((pos, pos + len(old[k]), lines[k]))
+                    k0 = k
+                edits.apply(found)
+            code = "\n".join(lines)
+            if stats is not None:
+                # the rules of a per-line group share one walk; time them together
+                stats.add_pass("+".join(r.name for r in group), time.perf_counter() - t0)
+        i = j
     return code
+
+
+def _convert_new_delete_to_malloc_free(code: str, ctx: Optional[_ConversionContext] = None) -> str:
+    return _run_rules(code, "c", ctx or _ConversionContext(), stage="memory")
+
+
+def _convert_malloc_free_to_new_delete(code: str, ctx: Optional[_ConversionContext] = None) -> str:
+    ctx = ctx or _ConversionContext(code)
+    return _run_rules(code, "cpp", ctx, stage="memory")
+
+
+# option values a JSON client (web API, `cconv serve`) may pick from
+OPTION_CHOICES = {"engine": ENGINES, "io_style": IO_STYLES, "format_lib": FORMAT_LIBS,
+                  "ownership": OWNERSHIP_MODES, "abi": ABIS}
+
+
+def options_from_json(obj: Any) -> Optional[ConvertOptions]:
+    """ConvertOptions from a JSON object of its fields; ValueError on a bad one."""
+    if obj is None:
+        return None
+    if not isinstance(obj, dict):
+        raise ValueError("options must be an object")
+    flags = {f.name for f in fields(ConvertOptions) if f.type == "bool"}
+    kwargs = {}
+    for key, value in obj.items():
+        if key in OPTION_CHOICES:
+            if value not in OPTION_CHOICES[key]:
+                raise ValueError(f"{key} must be one of {', '.join(OPTION_CHOICES[key])}")
+        elif key in flags:
+            if not isinstance(value, bool):
+                raise ValueError(f"{key} must be true or false")
+        elif key == "disabled_rules":
+            names = {r.name for r in RULES}
+            if not isinstance(value, list) or any(v not in names for v in value):
+                raise ValueError("disabled_rules must be a list of rule names")
+            value = frozenset(value)
+        else:
+            raise ValueError(f"unknown option: {key}")
+        kwargs[key] = value
+    return ConvertOptions(**kwargs)
+
+
+def convert(code: str, target: str, options: Optional[ConvertOptions] = None,
+            stats: bool = False, budget: Optional[float] = None) -> Union[str, Tuple[str, ConversionStats]]:
+    """Convert `code` to `target` ("cpp" or "c").
+
+    With `stats=True` returns `(output, ConversionStats)` instead of the
+    output alone. A conversion still running `budget` seconds in gives up
+    between passes: the output is `code` unchanged, with a
+    `ConversionWarning`. Raises `ConversionError` when the input can't be
+    converted into valid code.
+    """
+    if target not in ("cpp", "c"):
+        raise ValueError(f"unknown target: {target!r}")
+    t0 = time.perf_counter()
+    ctx = _ConversionContext(code, options)
+    if budget is not None:
+        ctx.deadline = t0 + budget
+    run = _convert_c_to_cpp if target == "cpp" else _convert_cpp_to_c
+    st = None
+    if stats:
+        st = ConversionStats(
+            target=target,
+            engine=ctx.options.engine if target == "cpp" else "regex",
+            bytes_in=len(code.encode("utf-8")),
+            analysis_seconds=time.perf_counter() - t0,
+            type_map_size=len(ctx.types),
+            typedefs=len(ctx.typedefs),
+        )
+        ctx.stats = st
+    try:
+        ctx.check_time()
+        out = run(code, ctx)
+    except _OverBudget:
+        out = code
+        _warn_over_budget(budget)
+        if st is not None:
+            st.over_budget = True
+    if st is None:
+        return out
+    st.seconds = time.perf_counter() - t0
+    st.bytes_out = len(out.encode("utf-8"))
+    return out, st
+
+
+def _warn_over_budget(budget: float) -> None:
+    warnings.warn(ConversionWarning(
+        f"conversion took longer than its {budget:g}s time budget; the input is passed through unchanged"),
+        stacklevel=3)
+
+
+def convert_edits(code: str, target: str, options: Optional[ConvertOptions] = None,
+                  budget: Optional[float] = None) -> Tuple[str, List[Edit]]:
+    """`convert()`'s output, and the same change as sorted replacements of
+    ranges of `code` (applying them gives the output).
+
+    The regex engine's edits come from the positions its rules rewrote. The
+    token and tree-sitter engines don't keep them, so their output is
+    diffed by line instead. Over `budget`, there are no edits.
+    """
+    if target not in ("cpp", "c"):
+        raise ValueError(f"unknown target: {target!r}")
+    t0 = time.perf_counter()
+    ctx = _ConversionContext(code, options)
+    if budget is not None:
+        ctx.deadline = t0 + budget
+    try:
+        ctx.check_time()
+        if target == "cpp" and ctx.options.engine != "regex":
+            out = _convert_c_to_cpp(code, ctx)
+            return out, line_edits(code, out)
+        edits = EditMap()
+        out = _run_rules(code, target, ctx, edits=edits)
+    except _OverBudget:
+        _warn_over_budget(budget)
+        return code, []
+    return out, edits.edits(code)
+
+
+def convert_c_to_cpp(code: str, options: Optional[ConvertOptions] = None) -> str:
+    return _convert_c_to_cpp(code, _ConversionContext(code, options))
+
+
+def convert_cpp_to_c(code: str, options: Optional[ConvertOptions] = None) -> str:
+    return _convert_cpp_to_c(code, _ConversionContext(code, options))
+
+
+def _convert_c_to_cpp(code: str, ctx: _ConversionContext) -> str:
+    if ctx.options.engine == "tokens":
+        from .tokens import convert_c_to_cpp_tokens
+        return convert_c_to_cpp_tokens(code, ctx)
+    if ctx.options.engine == "tree-sitter":
+        # optional dependency; raises ImportError naming the packages
+        from .treesitter import convert_c_to_cpp_treesitter
+        return convert_c_to_cpp_treesitter(code, ctx)
+    return _run_rules(code, "cpp", ctx)
+
+
+def _convert_cpp_to_c(code: str, ctx: _ConversionContext) -> str:
+    return _run_rules(code, "c", ctx)
@@ -0,0 +1,303 @@
+"""Struct layout: size, alignment and padding per ABI (`cconv --layout`),
+and the member reordering behind rule `reorder-fields`.
+
+A struct is laid out when every member is a plain data declaration whose
+type is known: a scalar, a pointer, an enum, a struct laid out before it,
+or a typedef of one of those. Array bounds must be literals, numeric
+#defines or consts. Bit-fields, unions, methods and anything else leave the
+struct unknown.
+
+Sorting the members by alignment, largest first, removes all padding
+between them. Only the tail padding up to the struct's alignment stays. The
+reorder is applied when it makes the struct smaller and no code can see the
+member order:
+
+- there is no positional initializer of the struct (`= {1, p}`, compound
+  literals, C++ `X{...}`). Empty and `{0}` initializers are fine, and so are
+  designated ones in C (C++ requires them in declaration order);
+- `offsetof` is never applied to it;
+- its first member isn't itself a struct (the C "base struct" idiom, where
+  a pointer to the struct is cast to its first member);
+- each member is on its own line.
+"""
+from __future__ import annotations
+
+import re
+from dataclasses import dataclass
+from typing import Dict, List, Optional, Tuple
+
+from .converter import (
+    ABIS,
+    _array_bound,
+    _blank_comments,
+    _collect_typedefs,
+    _self_referential_structs,
+    _struct_full,
+)
+
+# (size, alignment) of the scalar types and of a pointer
+ABI_TYPES: Dict[str, Dict[str, Tuple[int, int]]] = {
+    # System V LP64 (Linux, macOS, BSD on x86-64)
+    "x86-64": {"char": (1, 1), "bool": (1, 1), "short": (2, 2), "int": (4, 4), "long": (8, 8),
+               "long long": (8, 8), "float": (4, 4), "double": (8, 8), "long double": (16, 16),
+               "pointer": (8, 8)},
+    # System V ILP32: 8-byte types align to 4 inside structs
+    "i386": {"char": (1, 1), "bool": (1, 1), "short": (2, 2), "int": (4, 4), "long": (4, 4),
+             "long long": (8, 4), "float": (4, 4), "double": (8, 4), "long double": (12, 4),
+             "pointer": (4, 4)},
+    # Windows x64 (LLP64)
+    "win64": {"char": (1, 1), "bool": (1, 1), "short": (2, 2), "int": (4, 4), "long": (4, 4),
+              "long long": (8, 8), "float": (4, 4), "double": (8, 8), "long double": (8, 8),
+              "pointer": (8, 8)},
+}
+
+assert tuple(ABI_TYPES) == ABIS
+
+CACHE_LINE = 64
+
+_ID = r"[A-Za-z_]\w*"
+_declarator = re.compile(rf"(?P<stars>[\s*]*)(?<!\w)(?P<name>{_ID})\s*(?P<dims>(?:\[[^\]]*\]\s*)*)")
+_first_declarator = re.compile(rf"(?P<type>.*?)" + _declarator.pattern, re.DOTALL)
+_dim = re.compile(r"\[([^\]]*)\]")
+_qualifier = re.compile(r"\b(?:const|volatile|mutable)\b")
+_fixed_int = re.compile(r"(?:std::)?u?int(8|16|32|64)_t")
+_size_types = {"size_t", "ssize_t", "ptrdiff_t", "intptr_t", "uintptr_t"}
+
+
+@dataclass
+class Field:
+    name: str
+    ctype: str
+    size: int
+    align: int
+    offset: int = 0
+
+
+@dataclass
+class StructLayout:
+    name: str
+    fields: List[Field]
+    size: int
+    align: int
+    reordered_size: int
+    node: bool = False          # self-referential (list/tree node)
+    # why the members can't be reordered, or "" when they can
+    fixed: str = ""
+
+    @property
+    def padding(self) -> int:
+        return self.size - sum(f.size for f in self.fields)
+
+    @property
+    def per_line(self) -> int:
+        return CACHE_LINE // self.size if self.size else 0
+
+
+@dataclass
+class _Unit:
+    """One member line of a struct body, with the comment lines above it."""
+    text: str
+    align: int
+
+
+def _word_type(words: List[str]) -> Optional[str]:
+    """The scalar table key for a spelled builtin type, e.g. `unsigned long int`."""
+    words = [w for w in words if w not in ("signed", "unsigned")] or ["int"]
+    if words.count("long") == 2:
+        return "long long" if set(words) <= {"long", "int"} else None
+    if words == ["long", "double"]:
+        return "long double"
+    for key in ("short", "long"):
+        if key in words:
+            return key if set(words) <= {key, "int"} else None
+    if len(words) == 1 and words[0] in ("char", "int", "float", "double", "bool", "_Bool"):
+        return "bool" if words[0] == "_Bool" else words[0]
+    return None
+
+
+class _Layouts:
+    def __init__(self, code: str, abi: str, cpp: bool = False) -> None:
+        self.code = code
+        self.cpp = cpp
+        self.mask = _blank_comments(code)
+        self.table = ABI_TYPES[abi]
+        self.typedefs = _collect_typedefs(code)
+        self.structs: Dict[str, Optional[StructLayout]] = {}
+        self.enums = set(re.findall(rf"\benum\s+({_ID})", self.mask))
+
+    def resolve(self, ctype: str) -> str:
+        ctype = " ".join(_qualifier.sub(" ", ctype).split())
+        for _ in range(8):  # typedef chains
+            if ctype not in self.typedefs:
+                break
+            ctype = self.typedefs[ctype]
+        return ctype
+
+    def is_struct(self, ctype: str) -> bool:
+        ctype = self.resolve(ctype)
+        return ctype.startswith("struct ") or ctype in self.structs
+
+    def scalar(self, ctype: str) -> Optional[Tuple[int, int]]:
+        """(size, align) of a non-pointer type, or None when unknown."""
+        ctype = self.resolve(ctype)
+        if ctype.startswith("enum ") or ctype in self.enums:
+            return self.table["int"]
+        name = ctype[len("struct "):] if ctype.startswith("struct ") else ctype
+        if name in self.structs:
+            s = self.structs[name]
+            return (s.size, s.align) if s else None
+        m = _fixed_int.fullmatch(ctype)
+        if m:
+            n = int(m.group(1)) // 8
+            return n, min(n, self.table["long long"][1])
+        if ctype.replace("std::", "") in _size_types:
+            return self.table["pointer"]
+        key = _word_type(ctype.split())
+        return self.table[key] if key else None
+
+    def members(self, body: str) -> Optional[List[Field]]:
+        fields: List[Field] = []
+        for decl in body.split(";"):
+            decl = decl.strip()
+            if not decl:
+                continue
+            if re.search(r"[(){}:]|\bstatic\b|\bunion\b|\btypedef\b", decl):
+                return None  # methods, bit-fields, access specifiers, nested types
+            decl = decl.split("=", 1)[0]  # a C++ default member initializer
+            parts = decl.split(",")
+            first = _first_declarator.fullmatch(parts[0].strip())
+            if not first or not first.group("type").strip():
+                return None
+            base = first.group("type").strip()
+            for i, part in enumerate(parts):
+                d = first if i == 0 else _declarator.fullmatch(part.strip())
+                if not d:
+                    return None
+                stars = d.group("stars").count("*") + base.count("*")
+                size_align = self.table["pointer"] if stars else self.scalar(base.rstrip("* "))
+                if size_align is None:
+                    return None
+                count = 1
+                for n in _dim.findall(d.group("dims")):
+                    bound = _array_bound(self.mask, n.strip())
+                    if bound is None:
+                        return None
+                    count *= bound
+                ctype = base + "*" * d.group("stars").count("*") + d.group("dims").strip()
+                fields.append(Field(d.group("name"), ctype, size_align[0] * count, size_align[1]))
+        return fields
+
+    def run(self) -> List[StructLayout]:
+        nodes = _self_referential_structs(self.code, self.typedefs)
+        out = []
+        for m in _struct_full.finditer(self.mask):
+            name = m.group("name")
+            fields = self.members(m.group("body"))
+            if not fields:
+                self.structs[name] = None
+                continue
+            size, align = _place(fields)
+            best, _ = _place([Field(f.name, f.ctype, f.size, f.align) for f in _by_alignment(fields)])
+            layout = StructLayout(name, fields, size, align, best, node=name in nodes)
+            layout.fixed = _order_dependence(self.code, self.mask, m, self.typedefs, fields, self)
+            self.structs[name] = layout
+            out.append(layout)
+        return out
+
+
+def _by_alignment(items):
+    return sorted(items, key=lambda f: -f.align)
+
+
+def _place(fields: List[Field]) -> Tuple[int, int]:
+    """Assign offsets in order; returns (size, align) of the struct."""
+    offset, align = 0, 1
+    for f in fields:
+        offset = -(-offset // f.align) * f.align
+        f.offset = offset
+        offset += f.size
+        align = max(align, f.align)
+    return -(-offset // align) * align, align
+
+
+def _order_dependence(code: str, mask: str, m: re.Match, typedefs: Dict[str, str],
+                      fields: List[Field], layouts: _Layouts) -> str:
+    name = m.group("name")
+    spell = "|".join([rf"struct\s+{name}", name] + [re.escape(a) for a, t in typedefs.items()
+                                                     if t == f"struct {name}"])
+    outside = mask[:m.start()] + " " * (m.end() - m.start()) + mask[m.end():]
+    if re.search(rf"\boffsetof\s*\(\s*(?:{spell})\b", outside):
+        return "offsetof"
+    # = { ... } after a declaration of the type, (T){ ... }, T{ ... } and T x{ ... }
+    designated = r"" if layouts.cpp else r"|\s*\."
+    inits = re.finditer(
+        rf"\b(?:{spell})\b(?:[^;=(){{}}]*=\s*|\s*\)\s*|\s*|\s*\**\s*{_ID}\s*(?:\[[^\]]*\]\s*)*)\{{", outside)
+    for init in inits:
+        rest = outside[init.end():]
+        if not re.match(r"\s*(?:0\s*)?\}" + designated, rest):
+            return "designated initializer" if re.match(r"\s*\.", rest) else "positional initializer"
+    first = fields[0].ctype
+    if "*" not in first and layouts.is_struct(first.split("[")[0]):
+        return "struct first member"
+    return ""
+
+
+def struct_layouts(code: str, abi: str = "x86-64", cpp: bool = False) -> List[StructLayout]:
+    """Layout of every struct in `code` that can be laid out, in source order.
+    `cpp` says the code is C++, which is stricter about initializer order."""
+    if abi not in ABI_TYPES:
+        raise ValueError(f"unknown ABI: {abi} (one of {', '.join(ABI_TYPES)})")
+    return _Layouts(code, abi, cpp).run()
+
+
+def reorder_fields(m: re.Match, abi: str, cpp: bool) -> str:
+    """`_struct_full` match -> the same struct with its members by alignment,
+    when that makes it smaller and nothing depends on the order."""
+    code = m.string
+    name = m.group("name")
+    layouts = _Layouts(code, abi, cpp)
+    layout = next((s for s in layouts.run() if s.name == name), None)
+    if layout is None or layout.fixed or layout.reordered_size >= layout.size:
+        return m.group(0)
+    body = m.group("body")
+    lines = body.split("\n")
+    head, tail = lines[0], lines[-1]
+    if head.strip() or tail.strip() or len(lines) < 4:
+        return m.group(0)  # members must be one per line, between the brace lines
+    units: List[_Unit] = []
+    pending: List[str] = []
+    for line in lines[1:-1]:
+        text = line.strip()
+        if not text:
+            return m.group(0)  # blank lines group members; keep such a body as written
+        if text.startswith(("//", "/*", "*")):
+            pending.append(line)
+            continue
+        code_part = _blank_comments(line).strip()
+        if code_part.count(";") != 1 or not code_part.endswith(";"):
+            return m.group(0)
+        fields = layouts.members(code_part)
+        if not fields:
+            return m.group(0)
+        units.append(_Unit("\n".join(pending + [line]), max(f.align for f in fields)))
+        pending = []
+    if pending:
+        return m.group(0)
+    body = "\n".join([head] + [u.text for u in _by_alignment(units)] + [tail])
+    return f"struct {name} {{{body}}}{m.group('tail')};"
+
+
+def format_report(layouts: List[StructLayout], abi: str) -> str:
+    rows = [f"struct layouts ({abi})",
+            f"{'struct':24} {'size':>5} {'align':>5} {'padding':>7} {'sorted':>6} {f'per {CACHE_LINE}B':>7}  notes"]
+    for s in layouts:
+        notes = []
+        if s.node:
+            notes.append("node")
+        if s.reordered_size < s.size:
+            notes.append(f"fixed by {s.fixed}" if s.fixed else "--reorder-fields would shrink it")
+        rows.append(f"{s.name:24} {s.size:5} {s.align:5} {s.padding:7} {s.reordered_size:6} "
+                    f"{s.per_line:7}  {', '.join(notes)}".rstrip())
+        for f in s.fields:
+            rows.append(f"    {f.offset:4}  {f.size:4}  {f.ctype} {f.name}")
+    return "\n".join(rows) + "\n"
@@ -0,0 +1,92 @@
+"""Linear-time matching for the `start ... close` rule patterns.
+
+`re` has no trouble with `printf\\s*\\(.*?\\)\\s*;` on ordinary code, but a
+line with many `printf(` and no `);` makes it try every start and scan the
+rest of the line from each one: the work grows with the square of the
+line. `LazyPattern` gives the same matches in one pass over the text. A
+start is rejected without scanning when the first `close` after it lies past
+the first stop character, and that first `close` and stop character are
+looked up once and shared by every start before them.
+"""
+from __future__ import annotations
+
+import re
+from typing import Callable, Iterator, Optional, Tuple, Union
+
+
+class LazyPattern:
+    """`start`, then the shortest run of characters other than `stop`, then
+    `close`; `stop=""` lets the run take anything.
+
+    `group` captures the run (True for group 1 after those of `start`, or a
+    group name). A match of `start` must end at one place: a name or a
+    bracket, not an optional tail. Matches are those of `self.regex`, and
+    it offers the parts of the `re.Pattern` API the rules use.
+    """
+
+    def __init__(self, start: str, close: str, stop: str = "\n",
+                 group: Union[bool, str] = False, flags: int = 0) -> None:
+        run = f"[^{''.join(map(re.escape, stop))}]*?" if stop else r"(?s:.)*?"
+        if group:
+            run = f"(?P<{group}>{run})" if isinstance(group, str) else f"({run})"
+        self.start = re.compile(start, flags)
+        self.close = re.compile(close, flags)
+        self.stop = stop
+        self.regex = re.compile(start + run + close, flags)
+        self.pattern = self.regex.pattern
+        self.flags = self.regex.flags
+
+    def __repr__(self) -> str:
+        return f"LazyPattern({self.pattern!r})"
+
+    def _stop_at(self, string: str, pos: int) -> int:
+        at = [i for i in (string.find(c, pos) for c in self.stop) if i >= 0]
+        return min(at) if at else len(string)
+
+    def finditer(self, string: str, pos: int = 0) -> Iterator[re.Match]:
+        n = len(string)
+        # the first close (n + 1 for none) and stop character at or after
+        # the position each was looked up from; later starts up to them share them
+        close_from, close_at = n + 1, n + 1
+        stop_from, stop_at = n + 1, n + 1
+        while pos <= n:
+            s = self.start.search(string, pos)
+            if s is None:
+                return
+            body = s.end()
+            if not close_from <= body <= close_at:
+                c = self.close.search(string, body)
+                close_from, close_at = body, c.start() if c else n + 1
+            if self.stop and not stop_from <= body <= stop_at:
+                stop_from, stop_at = body, self._stop_at(string, body)
+            if close_at > n or (self.stop and close_at > stop_at):
+                pos = s.start() + 1
+                continue
+            m = self.regex.match(string, s.start())
+            if m is None:
+                pos = s.start() + 1
+                continue
+            yield m
+            pos = m.end() if m.end() > m.start() else m.end() + 1
+
+    def search(self, string: str, pos: int = 0) -> Optional[re.Match]:
+        return next(self.finditer(string, pos), None)
+
+    def subn(self, repl: Union[str, Callable[[re.Match], str]], string: str,
+             count: int = 0) -> Tuple[str, int]:
+        expand = repl if callable(repl) else (lambda m: m.expand(repl))
+        parts, last, n = [], 0, 0
+        for m in self.finditer(string):
+            parts.append(string[last:m.start()])
+            parts.append(expand(m))
+            last = m.end()
+            n += 1
+            if n == count:
+                break
+        if not n:
+            return string, 0
+        parts.append(string[last:])
+        return "".join(parts), n
+
+    def sub(self, repl: Union[str, Callable[[re.Match], str]], string: str, count: int = 0) -> str:
+        return self.subn(repl, string, count)[0]
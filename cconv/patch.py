@@ -0,0 +1,243 @@
+"""Conversion output as changes to the input (`--emit=diff|edits`).
+
+The regex engine records where each pass rewrote a match. `EditMap`
+composes those replacements, pass after pass, into replacements of ranges
+of the *original* text, so the diff and the edit list come from the
+rewrite positions themselves rather than from diffing the output.
+"""
+from __future__ import annotations
+
+import bisect
+import difflib
+import json
+import re
+from typing import List, NamedTuple, Optional, Sequence, Tuple
+
+# what the CLI writes: the converted text, a unified diff, or JSON edit lists
+EMITS = ("text", "diff", "edits")
+
+
+class Edit(NamedTuple):
+    """Replace input[start:end] (str offsets) with text."""
+    start: int
+    end: int
+    text: str
+
+
+class _Rep:
+    """One replaced range: original [os, oe) now reads `text`, which starts at
+    `cs` in the current code. `left` is how much longer the code before it
+    has become."""
+    __slots__ = ("os", "oe", "text", "cs", "left")
+
+    def __init__(self, os: int, oe: int, text: str, cs: int = 0, left: int = 0) -> None:
+        self.os, self.oe, self.text, self.cs, self.left = os, oe, text, cs, left
+
+    @property
+    def ce(self) -> int:
+        return self.cs + len(self.text)
+
+    @property
+    def growth(self) -> int:
+        return len(self.text) - (self.oe - self.os)
+
+
+class EditMap:
+    """The current code as the original with a sorted list of replacements."""
+
+    def __init__(self) -> None:
+        self.reps: List[_Rep] = []
+
+    def apply(self, edits: Sequence[Tuple[int, int, str]]) -> None:
+        """Compose one pass: `edits` are sorted, non-overlapping replacements
+        in the coordinates of the code before the pass (as from `re.sub`)."""
+        if not edits:
+            return
+        # right to left, so the positions left of each edit are still valid
+        pending = list(self.reps)
+        done: List[_Rep] = []
+        for s, e, text in reversed(edits):
+            while pending and pending[-1].cs >= e:
+                done.append(pending.pop())
+            touched: List[_Rep] = []
+            while pending and pending[-1].ce > s:
+                touched.append(pending.pop())
+            touched.reverse()
+            before = pending[-1].left + pending[-1].growth if pending else 0
+            if touched and s >= touched[0].cs:
+                first = touched[0]
+                os, prefix, cs, left = first.os, first.text[:s - first.cs], first.cs, first.left
+            else:
+                os, prefix, cs, left = s - before, "", s, before
+            if touched and e <= touched[-1].ce:
+                last = touched[-1]
+                oe, suffix = last.oe, last.text[e - last.cs:]
+            else:
+                after = touched[-1].left + touched[-1].growth if touched else before
+                oe, suffix = e - after, ""
+            # edits further left may still touch the merged range
+            pending.append(_Rep(os, oe, prefix + text + suffix, cs, left))
+        done.extend(reversed(pending))
+        done.reverse()
+        left = 0
+        for r in done:
+            r.left, r.cs = left, r.os + left
+            left += r.growth
+        self.reps = done
+
+    def edits(self, original: str) -> List[Edit]:
+        """The replacements, less the whole lines they leave as they were
+        (the monomorphizer rewrites the file from the first template on),
+        merged where they touch."""
+        out: List[Edit] = []
+        for r in self.reps:
+            old, new = original[r.os:r.oe], r.text
+            if old == new:
+                continue
+            n = 0
+            limit = min(len(old), len(new))
+            while n < limit and old[n] == new[n]:
+                n += 1
+            n = old.rfind("\n", 0, n) + 1
+            m = 0
+            while m < limit - n and old[len(old) - 1 - m] == new[len(new) - 1 - m]:
+                m += 1
+            # keep the newline ending the last changed line, and the lines after it
+            nl = old.find("\n", len(old) - m)
+            m = len(old) - nl - 1 if nl >= 0 else 0
+            edit = Edit(r.os + n, r.oe - m, new[n:len(new) - m])
+            if out and out[-1].end >= edit.start:
+                prev = out.pop()
+                edit = Edit(prev.start, edit.end, prev.text + original[prev.end:edit.start] + edit.text)
+            out.append(edit)
+        return out
+
+
+def line_edits(original: str, output: str) -> List[Edit]:
+    """Edits by a line diff, for the engines that don't record positions."""
+    a = _lines(original)
+    b = _lines(output)
+    starts = [0]
+    for line in a:
+        starts.append(starts[-1] + len(line))
+    out: List[Edit] = []
+    for tag, i1, i2, j1, j2 in difflib.SequenceMatcher(None, a, b, autojunk=False).get_opcodes():
+        if tag != "equal":
+            out.append(Edit(starts[i1], starts[i2], "".join(b[j1:j2])))
+    return out
+
+
+def apply_edits(original: str, edits: Sequence[Edit]) -> str:
+    parts, pos = [], 0
+    for e in edits:
+        parts.append(original[pos:e.start])
+        parts.append(e.text)
+        pos = e.end
+    parts.append(original[pos:])
+    return "".join(parts)
+
+
+def edits_json(original: str, edits: Sequence[Edit], path: Optional[str] = None,
+               target: Optional[str] = None) -> str:
+    """One JSON object per file: byte offsets into the UTF-8 input."""
+    if original.isascii():
+        items = [{"start": e.start, "end": e.end, "text": e.text} for e in edits]
+    else:
+        items = []
+        pos = nbytes = 0  # edits are sorted: count the bytes up to each one once
+        for e in edits:
+            start = nbytes + len(original[pos:e.start].encode("utf-8"))
+            nbytes = start + len(original[e.start:e.end].encode("utf-8"))
+            pos = e.end
+            items.append({"start": start, "end": nbytes, "text": e.text})
+    obj = {"path": path, "target": target, "edits": items}
+    return json.dumps(obj, ensure_ascii=False) + "\n"
+
+
+def unified_diff(original: str, edits: Sequence[Edit], old_name: str, new_name: str,
+                 context: int = 3) -> str:
+    """A unified diff (`diff -u` layout) of `original` and the edits applied."""
+    if not edits:
+        return ""
+    lines = _lines(original)
+    starts = [0]
+    for line in lines:
+        starts.append(starts[-1] + len(line))
+    ends_open = bool(original) and not original.endswith("\n")
+
+    # original lines [a, b) each run of edits rewrites; edits sharing a line go together
+    groups: List[Tuple[int, int, List[Edit]]] = []
+    for e in edits:
+        a = bisect.bisect_right(starts, e.start) - 1
+        if e.end > e.start:
+            b = bisect.bisect_right(starts, e.end - 1)
+        elif a == len(lines) and ends_open:
+            a, b = a - 1, a  # appended to a last line without a newline
+        else:
+            # an insertion at a line start that ends its own line adds lines only
+            b = a if a == len(lines) or (e.start == starts[a] and e.text.endswith("\n")) else a + 1
+        if groups and a < groups[-1][1]:
+            pa, pb, group = groups.pop()
+            groups.append((pa, max(b, pb), group + [e]))
+        else:
+            groups.append((a, b, [e]))
+
+    changes = []
+    k = 0
+    while k < len(groups):
+        a, b, group = groups[k]
+        k += 1
+        while True:
+            base = starts[a]
+            text = apply_edits(original[base:starts[b]], [Edit(x.start - base, x.end - base, x.text) for x in group])
+            if text.endswith("\n") or not text or b == len(lines):
+                break
+            # the edit took a newline: the following line joins the change
+            b += 1
+            if k < len(groups) and groups[k][0] < b:
+                b = max(b, groups[k][1])
+                group = group + groups[k][2]
+                k += 1
+        changes.append((a, b, _lines(text)))
+
+    out = [f"--- {old_name}\n", f"+++ {new_name}\n"]
+    shift = 0  # new line number minus old line number, before the hunk
+    i = 0
+    while i < len(changes):
+        j = i
+        while j + 1 < len(changes) and changes[j + 1][0] - changes[j][1] <= 2 * context:
+            j += 1
+        lo = max(0, changes[i][0] - context)
+        hi = min(len(lines), changes[j][1] + context)
+        body: List[str] = []
+        pos, added, removed = lo, 0, 0
+        for a, b, new in changes[i:j + 1]:
+            body.extend(" " + ln for ln in lines[pos:a])
+            body.extend("-" + ln for ln in lines[a:b])
+            body.extend("+" + ln for ln in new)
+            removed += b - a
+            added += len(new)
+            pos = b
+        body.extend(" " + ln for ln in lines[pos:hi])
+        old_len = hi - lo
+        new_len = old_len - removed + added
+        out.append(f"@@ -{_range(lo, old_len)} +{_range(lo + shift, new_len)} @@\n")
+        for ln in body:
+            out.append(ln if ln.endswith("\n") else ln + "\n\\ No newline at end of file\n")
+        shift += added - removed
+        i = j + 1
+    return "".join(out)
+
+
+_line = re.compile(r"[^\n]*\n|[^\n]+$")
+
+
+def _lines(text: str) -> List[str]:
+    """Lines with their endings, split on '\\n' only."""
+    return _line.findall(text)
+
+
+def _range(start: int, length: int) -> str:
+    # `diff -u` numbers an empty range by the line before it
+    first = start + 1 if length else start
+    return f"{first}" if length == 1 else f"{first},{length}"
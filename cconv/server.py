@@ -0,0 +1,298 @@
+"""`cconv serve --stdio`: a long-lived converter for editors.
+
+Speaks the Language Server Protocol base protocol (JSON-RPC 2.0 messages
+framed by `Content-Length` headers) on stdin/stdout. Each open document
+keeps a `ConversionSession`, so an edit re-converts only the functions it
+touched. The converted text is pushed to the client after every `didOpen`
+and `didChange`:
+
+    cconv/converted  {uri, version, target, text}            (notification)
+                     {uri, version, target, error}           on failure
+
+Requests:
+
+- `initialize`: `initializationOptions` may hold `options` (ConvertOptions
+  fields, as the web API takes them) and `target` ("cpp" or "c"; by default
+  C documents go to C++ and everything else to C);
+- `cconv/convert` {uri} -> {text} for an open document, or
+  {text, target?, options?} -> {text} for a one-off conversion;
+- `shutdown`; then the `exit` notification ends the process.
+
+`workspace/didChangeConfiguration` {settings: {options?, target?}} replaces
+the options and reconverts the open documents.
+"""
+from __future__ import annotations
+
+import json
+import sys
+from typing import Any, BinaryIO, Dict, Optional
+
+from . import __version__
+from .converter import ConvertOptions, convert, options_from_json
+from .session import ConversionSession
+
+PARSE_ERROR = -32700
+INVALID_REQUEST = -32600
+METHOD_NOT_FOUND = -32601
+INVALID_PARAMS = -32602
+INTERNAL_ERROR = -32603
+SERVER_NOT_INITIALIZED = -32002
+
+
+class _ParamsError(Exception):
+    pass
+
+
+def read_message(stream: BinaryIO) -> Optional[bytes]:
+    """One framed message body, or None at end of input."""
+    length = None
+    while True:
+        line = stream.readline()
+        if not line:
+            return None
+        line = line.strip()
+        if not line:
+            if length is None:
+                continue
+            break
+        name, _, value = line.decode("ascii", "replace").partition(":")
+        if name.strip().lower() == "content-length":
+            length = int(value)
+    body = stream.read(length)
+    return body if len(body) == length else None
+
+
+def write_message(stream: BinaryIO, msg: Dict[str, Any]) -> None:
+    body = json.dumps(msg, separators=(",", ":")).encode("utf-8")
+    stream.write(b"Content-Length: %d\r\n\r\n" % len(body) + body)
+    stream.flush()
+
+
+def _offset(text: str, line: int, character: int, encoding: str) -> int:
+    """Index into `text` of an LSP position, `character` counted in `encoding` units."""
+    pos = 0
+    for _ in range(line):
+        nl = text.find("\n", pos)
+        if nl < 0:
+            return len(text)
+        pos = nl + 1
+    end = text.find("\n", pos)
+    end = len(text) if end < 0 else end
+    if encoding == "utf-32":
+        return min(pos + character, end)
+    units = 0
+    i = pos
+    while i < end and units < character:
+        c = ord(text[i])
+        if encoding == "utf-8":
+            units += 1 if c < 0x80 else 2 if c < 0x800 else 3 if c < 0x10000 else 4
+        else:
+            units += 2 if c >= 0x10000 else 1
+        i += 1
+    return i
+
+
+def _default_target(language_id: str, uri: str) -> str:
+    c = language_id == "c" or (not language_id and uri.endswith(".c"))
+    return "cpp" if c else "c"
+
+
+class _Document:
+    def __init__(self, uri: str, text: str, version: Any, target: str, options: ConvertOptions) -> None:
+        self.uri = uri
+        self.text = text
+        self.version = version
+        self.session = ConversionSession(target, options)
+
+
+class Server:
+    def __init__(self, out: BinaryIO) -> None:
+        self.out = out
+        self.options = ConvertOptions()
+        self.target: Optional[str] = None
+        self.encoding = "utf-16"
+        self.docs: Dict[str, _Document] = {}
+        self.initialized = False
+        self.shutdown = False
+        self.methods = {
+            "initialize": self._initialize,
+            "initialized": self._initialized,
+            "shutdown": self._shutdown,
+            "workspace/didChangeConfiguration": self._did_change_configuration,
+            "textDocument/didOpen": self._did_open,
+            "textDocument/didChange": self._did_change,
+            "textDocument/didClose": self._did_close,
+            "cconv/convert": self._convert,
+        }
+
+    # -- protocol --------------------------------------------------------------
+
+    def handle(self, body: bytes) -> Optional[int]:
+        """Dispatch one message; returns the exit code after `exit`."""
+        try:
+            msg = json.loads(body.decode("utf-8"))
+        except (UnicodeDecodeError, ValueError) as e:
+            self._error(None, PARSE_ERROR, f"parse error: {e}")
+            return None
+        if not isinstance(msg, dict) or not isinstance(msg.get("method"), str):
+            if isinstance(msg, dict) and "method" not in msg:
+                return None  # a response to something we never send
+            self._error(msg.get("id") if isinstance(msg, dict) else None, INVALID_REQUEST, "invalid request")
+            return None
+        method = msg["method"]
+        params = msg.get("params") or {}
+        is_request = "id" in msg
+        if method == "exit":
+            return 0 if self.shutdown else 1
+        if not self.initialized and method != "initialize":
+            if is_request:
+                self._error(msg["id"], SERVER_NOT_INITIALIZED, "server not initialized")
+            return None
+        handler = self.methods.get(method)
+        if handler is None:
+            if is_request:
+                self._error(msg["id"], METHOD_NOT_FOUND, f"method not found: {method}")
+            return None  # unknown notifications are ignored
+        try:
+            result = handler(params)
+        except (_ParamsError, ValueError, KeyError, TypeError) as e:
+            if is_request:
+                self._error(msg["id"], INVALID_PARAMS, str(e))
+            return None
+        except Exception as e:
+            if is_request:
+                self._error(msg["id"], INTERNAL_ERROR, f"{type(e).__name__}: {e}")
+            return None
+        if is_request:
+            write_message(self.out, {"jsonrpc": "2.0", "id": msg["id"], "result": result})
+        return None
+
+    def _error(self, id_: Any, code: int, message: str) -> None:
+        write_message(self.out, {"jsonrpc": "2.0", "id": id_, "error": {"code": code, "message": message}})
+
+    def _notify(self, method: str, params: Dict[str, Any]) -> None:
+        write_message(self.out, {"jsonrpc": "2.0", "method": method, "params": params})
+
+    def _configure(self, settings: Dict[str, Any]) -> None:
+        if not isinstance(settings, dict):
+            raise _ParamsError("settings must be an object")
+        target = settings.get("target")
+        if target not in (None, "cpp", "c"):
+            raise _ParamsError("target must be \"cpp\" or \"c\"")
+        if "options" in settings:
+            self.options = options_from_json(settings["options"]) or ConvertOptions()
+        if target is not None:
+            self.target = target
+
+    def _push(self, doc: _Document) -> None:
+        params = {"uri": doc.uri, "version": doc.version, "target": doc.session.target}
+        try:
+            params["text"] = doc.session.convert(doc.text)
+        except Exception as e:
+            params["error"] = f"{type(e).__name__}: {e}"
+        self._notify("cconv/converted", params)
+
+    # -- lifecycle -------------------------------------------------------------
+
+    def _initialize(self, params):
+        self._configure(params.get("initializationOptions") or {})
+        offered = ((params.get("capabilities") or {}).get("general") or {}).get("positionEncodings") or []
+        self.encoding = "utf-8" if "utf-8" in offered else "utf-16"
+        self.initialized = True
+        return {
+            "capabilities": {
+                "positionEncoding": self.encoding,
+                # 2 = incremental: didChange carries ranges
+                "textDocumentSync": {"openClose": True, "change": 2},
+                "experimental": {"cconvConvert": True},
+            },
+            "serverInfo": {"name": "cconv", "version": __version__},
+        }
+
+    def _initialized(self, params):
+        return None
+
+    def _shutdown(self, params):
+        self.shutdown = True
+        self.docs.clear()
+        return None
+
+    def _did_change_configuration(self, params):
+        self._configure(params.get("settings") or {})
+        for doc in self.docs.values():
+            target = self.target or doc.session.target
+            doc.session = ConversionSession(target, self.options)
+            self._push(doc)
+
+    # -- documents -------------------------------------------------------------
+
+    def _did_open(self, params):
+        item = params["textDocument"]
+        uri = item["uri"]
+        target = self.target or _default_target(item.get("languageId", ""), uri)
+        doc = _Document(uri, item["text"], item.get("version"), target, self.options)
+        self.docs[uri] = doc
+        self._push(doc)
+
+    def _did_change(self, params):
+        ident = params["textDocument"]
+        doc = self.docs.get(ident["uri"])
+        if doc is None:
+            raise _ParamsError(f"document not open: {ident['uri']}")
+        text = doc.text
+        for change in params["contentChanges"]:
+            rng = change.get("range")
+            if rng is None:
+                text = change["text"]
+                continue
+            start = _offset(text, rng["start"]["line"], rng["start"]["character"], self.encoding)
+            end = _offset(text, rng["end"]["line"], rng["end"]["character"], self.encoding)
+            text = text[:start] + change["text"] + text[end:]
+        doc.text = text
+        doc.version = ident.get("version")
+        self._push(doc)
+
+    def _did_close(self, params):
+        self.docs.pop(params["textDocument"]["uri"], None)
+
+    def _convert(self, params):
+        if "uri" in params:
+            doc = self.docs.get(params["uri"])
+            if doc is None:
+                raise _ParamsError(f"document not open: {params['uri']}")
+            return {"text": doc.session.convert(doc.text), "target": doc.session.target}
+        text = params["text"]
+        if not isinstance(text, str):
+            raise _ParamsError("text must be a string")
+        target = params.get("target") or self.target or "cpp"
+        if target not in ("cpp", "c"):
+            raise _ParamsError("target must be \"cpp\" or \"c\"")
+        options = options_from_json(params["options"]) if "options" in params else self.options
+        return {"text": convert(text, target, options), "target": target}
+
+
+def serve_stdio(stdin: Optional[BinaryIO] = None, stdout: Optional[BinaryIO] = None) -> int:
+    """Serve until `exit` or end of input; returns the process exit code."""
+    stdin = stdin or sys.stdin.buffer
+    server = Server(stdout or sys.stdout.buffer)
+    while True:
+        try:
+            body = read_message(stdin)
+        except ValueError:
+            server._error(None, PARSE_ERROR, "bad Content-Length header")
+            continue
+        if body is None:
+            return 0 if server.shutdown else 1
+        code = server.handle(body)
+        if code is not None:
+            return code
+
+
+def main(argv=None) -> None:
+    import argparse
+    p = argparse.ArgumentParser(prog="cconv serve",
+                                description="Language-server mode: convert open documents as they change")
+    p.add_argument("--stdio", action="store_true", required=True,
+                   help="Speak LSP-framed JSON-RPC on stdin/stdout (the only transport)")
+    p.parse_args(argv)
+    sys.exit(serve_stdio())
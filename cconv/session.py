@@ -0,0 +1,130 @@
+"""Incremental conversion of one document that keeps changing (`cconv serve`).
+
+`ConversionSession.convert(code)` gives what `convert(code, target,
+options)` gives, but it reuses the work of the previous call. The input is
+cut at top-level boundaries, as in `cconv.stream`, so each function or
+struct, with the file-scope lines above it, is one piece. Every rule except the
+`finish` stage is local to its statement, so each piece runs that part of
+the pipeline on its own, and the result is memoized by:
+
+- the piece's text;
+- the state earlier pieces hand on (the `allocs` that pick `delete` vs
+  `delete[]`, the printf types `coalesce_output` records).
+
+The `finish` rules then run once on the whole output, as they do in a
+whole-file conversion. The memo is dropped when the file-scope analysis
+(type map, typedefs, option-driven sets) or the options change.
+
+C++ -> C input with templates is converted whole, because the
+monomorphizer needs every use. The tree-sitter engine keeps its own
+`TreeSitterSession`, and the token engine (one fast pass) converts whole.
+"""
+from __future__ import annotations
+
+import hashlib
+import re
+from typing import Dict, List, Optional, Tuple
+
+from .converter import (
+    ConvertOptions,
+    _ConversionContext,
+    _convert_c_to_cpp,
+    _convert_cpp_to_c,
+    _run_rules,
+    _template_tail,
+)
+from .stream import _BoundaryTracker
+
+_line = re.compile(r"[^\n]*\n|[^\n]+$")
+
+# what a piece's conversion learns for the pieces after it
+_Learned = Tuple[Tuple[Tuple[str, str], ...], Tuple[Tuple[str, str], ...]]
+
+
+def split_pieces(code: str) -> List[str]:
+    """`code` cut after every line that closes a top-level brace block (a
+    function, struct or initializer); "".join() restores it.
+
+    File-scope lines stay with the block after them: a piece that ended on
+    an `#include` line would let patterns like `^#include <x>\\s*$` take
+    its newline, which they can't do in the whole file.
+    """
+    pieces: List[str] = []
+    buf: List[str] = []
+    tracker = _BoundaryTracker()
+    opened = False
+    for line in _line.findall(code):
+        buf.append(line)
+        tracker.feed(line)
+        opened = opened or tracker.depth > 0 or "{" in line
+        if opened and tracker.at_boundary(line) and line.rstrip().endswith(("}", "};")):
+            pieces.append("".join(buf))
+            buf = []
+            opened = False
+    if buf:
+        pieces.append("".join(buf))
+    return pieces
+
+
+def _file_scope(ctx: _ConversionContext) -> str:
+    """Digest of everything a piece's output depends on besides its text."""
+    state = (ctx.options, sorted(ctx.typedefs.items()), sorted(ctx.types.items()),
+             sorted(ctx.realloc_names), sorted(ctx.owned.items()), sorted(ctx.pools),
+             sorted(ctx.pool_vars.items(), key=repr), sorted(ctx.constants), sorted(ctx.std_arrays),
+             sorted(ctx.array_sizes.items()), ctx.bulk_input, sorted(ctx.bit_arrays))
+    return hashlib.sha256(repr(state).encode("utf-8")).hexdigest()
+
+
+class ConversionSession:
+    """Converts successive versions of one file to `target` ("cpp" or "c")."""
+
+    def __init__(self, target: str, options: Optional[ConvertOptions] = None) -> None:
+        if target not in ("cpp", "c"):
+            raise ValueError(f"unknown target: {target!r}")
+        self.target = target
+        self.options = options or ConvertOptions()
+        self._context = ""
+        # (piece, allocs, printed) -> (output, what it added to allocs and printed)
+        self._memo: Dict[Tuple[str, frozenset, frozenset], Tuple[str, _Learned]] = {}
+        self._tree = None
+        # pieces converted and reused by the last call
+        self.converted = 0
+        self.reused = 0
+
+    def convert(self, code: str) -> str:
+        ctx = _ConversionContext(code, self.options)
+        if self.target == "cpp" and self.options.engine == "tree-sitter":
+            if self._tree is None:
+                from .treesitter import TreeSitterSession
+                self._tree = TreeSitterSession(self.options)
+            return self._tree.convert(code, ctx)
+        if self.target == "cpp" and self.options.engine == "tokens":
+            return _convert_c_to_cpp(code, ctx)
+        if self.target == "c" and _template_tail.search(code):
+            return _convert_cpp_to_c(code, ctx)
+
+        context = _file_scope(ctx)
+        if context != self._context:
+            self._memo = {}
+            self._context = context
+        memo, self._memo = self._memo, {}
+        self.converted = self.reused = 0
+        out: List[str] = []
+        for piece in split_pieces(code):
+            key = (piece, frozenset(ctx.allocs.items()), frozenset(ctx.printed.items()))
+            entry = memo.get(key) or self._memo.get(key)
+            if entry is None:
+                allocs, printed = dict(ctx.allocs), dict(ctx.printed)
+                text = _run_rules(piece, self.target, ctx, skip=("finish",))
+                learned = (tuple((k, v) for k, v in ctx.allocs.items() if allocs.get(k) != v),
+                           tuple((k, v) for k, v in ctx.printed.items() if printed.get(k) != v))
+                entry = (text, learned)
+                self.converted += 1
+            else:
+                ctx.allocs.update(entry[1][0])
+                ctx.printed.update(entry[1][1])
+                self.reused += 1
+            # entries for pieces that are gone are dropped
+            self._memo[key] = entry
+            out.append(entry[0])
+        return _run_rules("".join(out), self.target, ctx, stage="finish")
@@ -0,0 +1,114 @@
+"""Streaming conversion: convert a source chunk by chunk with bounded memory.
+
+The input is cut at top-level boundaries (a line that closes the last open
+brace, or ends a statement at file scope), so every chunk holds whole
+functions and declarations. Only the state later chunks need is carried
+forward: the `_ConversionContext` with the type map, typedefs, realloc names
+and the `allocs` map that picks `delete` vs `delete[]`.
+
+Known differences from whole-file conversion: a declaration or `realloc`
+that only appears after a use in an earlier chunk isn't seen by that chunk.
+C++ -> C: a template is only instantiated for the uses in its own chunk.
+`fast_input` is off: the reader can only replace every stdin read or none,
+which needs the whole file. `fast_io` is off for the same reason: a chunk
+can't tell whether another one still calls C stdio. `node_pool` is off too,
+since each chunk would emit its own `cconv_node_pool` class. `ownership` is
+"raw": a chunk that turns a pointer into std::vector/std::unique_ptr can't
+change a later chunk that still passes it as `T*`. `constexpr` is off for the
+same reason: a global array that became std::array would still be passed as
+`T*` in later chunks. Includes and
+helper code that go at the top of the file are only added for the first
+chunk, from what that chunk uses.
+"""
+from __future__ import annotations
+
+import re
+from dataclasses import replace
+from typing import Iterable, Iterator, List, Optional, TextIO
+
+from .converter import (
+    ConvertOptions,
+    _ConversionContext,
+    _convert_c_to_cpp,
+    _convert_cpp_to_c,
+)
+
+DEFAULT_CHUNK = 256 * 1024
+
+# things that can hide a brace: comments and literals
+_BRACE_SCAN = re.compile(r"//[^\n]*|/\*|\*/|\"(?:[^\"\\\n]|\\.)*\"|'(?:[^'\\\n]|\\.)*'|[{}]")
+
+
+class _BoundaryTracker:
+    """Brace depth across lines, aware of comments and string literals."""
+
+    def __init__(self) -> None:
+        self.depth = 0
+        self.in_comment = False
+
+    def feed(self, line: str) -> None:
+        pos = 0
+        if self.in_comment:
+            end = line.find("*/")
+            if end < 0:
+                return
+            self.in_comment = False
+            pos = end + 2
+        for m in _BRACE_SCAN.finditer(line, pos):
+            tok = m.group(0)
+            if self.in_comment:
+                if tok == "*/":
+                    self.in_comment = False
+            elif tok == "/*":
+                self.in_comment = True
+            elif tok == "{":
+                self.depth += 1
+            elif tok == "}":
+                self.depth = max(0, self.depth - 1)
+
+    def at_boundary(self, line: str) -> bool:
+        if self.in_comment or self.depth:
+            return False
+        tail = line.rstrip()
+        return not tail or tail.endswith((";", "}")) or tail.lstrip().startswith("#")
+
+
+def iter_chunks(lines: Iterable[str], chunk_size: int = DEFAULT_CHUNK) -> Iterator[str]:
+    """Group lines (with their endings) into chunks of roughly `chunk_size` chars.
+
+    A chunk is only cut at a top-level boundary. If none shows up, a chunk
+    that has grown to 16x the target is cut at the next line ending in `;`
+    or `}` so memory stays bounded on pathological input.
+    """
+    buf: List[str] = []
+    size = 0
+    tracker = _BoundaryTracker()
+    for line in lines:
+        buf.append(line)
+        size += len(line)
+        tracker.feed(line)
+        if size < chunk_size:
+            continue
+        if tracker.at_boundary(line) or (
+            size >= 16 * chunk_size and line.rstrip().endswith((";", "}"))
+        ):
+            yield "".join(buf)
+            buf, size = [], 0
+    if buf:
+        yield "".join(buf)
+
+
+def convert_stream(src: TextIO, dst: TextIO, target: str,
+                   options: Optional[ConvertOptions] = None,
+                   chunk_size: int = DEFAULT_CHUNK) -> None:
+    """Read `src`, write the converted code to `dst` as each chunk is done."""
+    if options is not None and (options.fast_input or options.fast_io or options.node_pool
+                                or options.ownership != "raw" or options.constexpr):
+        options = replace(options, fast_input=False, fast_io=False, node_pool=False, ownership="raw",
+                          constexpr=False)
+    ctx = _ConversionContext(options=options)
+    convert = _convert_c_to_cpp if target == "cpp" else _convert_cpp_to_c
+    for chunk in iter_chunks(src, chunk_size):
+        ctx.update(chunk)
+        dst.write(convert(chunk, ctx))
+        ctx.at_head = False
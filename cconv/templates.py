@@ -0,0 +1,1541 @@
+"""Template monomorphization for C++ -> C (rule `monomorphize-templates`).
+
+C has no templates. Every instantiation the translation unit uses becomes its
+own C code with the concrete types substituted:
+
+- `Deque<int>` and `Deque<double>` become the structs `Deque_int` and
+  `Deque_double`. A nested class becomes `Deque_int_Node`.
+- Member functions become `deque_int_push_front(Deque_int* self, ...)`.
+  Constructors are named `_init` and the destructor `_destroy`, and
+  `new X(...)` calls a generated `_new`.
+- A function template becomes `max_of_int(...)`. Its arguments are explicit
+  (`max_of<int>(a, b)`) or deduced from the argument types.
+
+So no `void*` boxing is generated, and every data path has the element
+type. Call sites follow: `dq.push_front(1)` becomes
+`deque_int_push_front(&dq, 1)`. A local object is initialized where it is
+declared and destroyed before each `return` and at the end of its block.
+Const reference parameters are passed by value, other references become
+pointers.
+
+Instantiations are looked for in the code outside the templates. They are
+then looked for in the generated code until no new one turns up
+(`Deque<T>` using `Node<T>`). The generated code takes the place of the
+template definition, so it comes where C++ declared the template.
+
+Some templates can't be lowered: those with a base class, an operator,
+static data, a virtual or friend member, a member template or a
+specialization. Such a template, and its uses, are left as they are.
+
+Function template arguments are deduced from variables, literals, casts,
+and the return types of calls (methods of the instantiated structs, other
+function templates, plain functions). A use whose arguments still can't be
+worked out stops the conversion with a `ConversionError`: its template
+could only be left in the output as C++.
+"""
+from __future__ import annotations
+
+import re
+from collections import ChainMap
+from dataclasses import dataclass, field
+from typing import Dict, Iterable, List, Optional, Set, Tuple
+
+from .converter import ConversionError, _ConversionContext, _blank_comments, _run_rules
+
+_ID = r"[A-Za-z_]\w*"
+_word = re.compile(rf"\b{_ID}")
+_ws = re.compile(r"\s+")
+_type_punct = re.compile(r"\s*([*&<>,])\s*")
+_non_word = re.compile(r"\W+")
+_camel = re.compile(r"(?<=[a-z0-9])(?=[A-Z])")
+_leading_const = re.compile(r"^\s*const\s+")
+_template_kw = re.compile(r"\btemplate\s*<|[{}]")
+_tparam_type = re.compile(rf"^(?:typename|class)\s+(?P<name>{_ID})\s*(?:=\s*(?P<default>.+))?$", re.DOTALL)
+_tparam_value = re.compile(
+    rf"^(?:(?:const|unsigned|signed|short|long|int|char|bool|size_t|std::size_t)\s+)+"
+    rf"(?P<name>{_ID})\s*(?:=\s*(?P<default>.+))?$", re.DOTALL)
+_class_head = re.compile(rf"^\s*(?:class|struct)\s+(?P<name>{_ID})\s*(?:final\s*)?$")
+_class_decl = re.compile(rf"^\s*(?:class|struct)\s+{_ID}\s*$")
+_out_of_class = re.compile(
+    rf"^\s*(?P<ret>[^;{{}}]*?)\b(?P<cls>{_ID})\s*<(?P<args>[^;{{}}()]*)>\s*::\s*(?P<dtor>~\s*)?(?P<name>{_ID})\s*\($",
+    re.DOTALL)
+_func_head = re.compile(rf"^\s*(?P<ret>[^;{{}}()]*?[\w*&>\s])(?P<name>{_ID})\s*\($", re.DOTALL)
+_access = re.compile(r"\s*(?:public|private|protected)\s*:(?!:)")
+_member_fn = re.compile(rf"(?P<dtor>~\s*)?(?P<name>{_ID})\s*$")
+_specifiers = re.compile(r"\b(?:inline|constexpr|explicit)\s+")
+_field_type = re.compile(rf"^(?P<type>.*?[\w>])(?=[\s*&]*{_ID}\s*(?:\[[^\]]*\]\s*)*(?:=.*|\{{.*\}})?$)", re.DOTALL)
+_declarator = re.compile(
+    rf"^(?P<ptr>[\s*&]*)(?P<name>{_ID})\s*(?P<arr>(?:\[[^\]]*\]\s*)*)(?P<init>=.*|\{{.*\}})?$", re.DOTALL)
+_param = re.compile(
+    rf"^(?P<type>.*?[\w>])(?P<ptr>[\s*&]*?)\s*\b(?P<name>{_ID})\s*(?P<arr>\[\s*\])?\s*(?:=\s*(?P<default>.+))?$",
+    re.DOTALL)
+_init_item = re.compile(rf"^(?P<name>{_ID})\s*(?:\((?P<p>.*)\)|\{{(?P<b>.*)\}})$", re.DOTALL)
+# `type name` where a declaration can start: parameters, locals, for-init
+_local_decl = re.compile(
+    rf"(?:^|(?<=[;{{}}(,]))\s*(?P<q>(?:(?:const|static|volatile|unsigned|signed|long|short|struct)\s+)*)"
+    rf"(?P<type>{_ID}(?:\s*::\s*{_ID})*)(?P<ptr>(?:\s*[*&])*)\s*(?<=[\s*&])(?P<name>{_ID})\s*(?=(?P<next>[=;,\[)(:{{]))",
+    re.MULTILINE)
+_return = re.compile(r"\breturn\b")
+_this = re.compile(r"\(\s*\*\s*this\s*\)|\*\s*this\b|\bthis\b")
+_new_expr = re.compile(rf"\bnew\s+(?P<T>{_ID})\s*(?P<open>[({{])?")
+_delete_stmt = re.compile(rf"\bdelete\s+(?P<name>{_ID})\s*;")
+_call_method = re.compile(
+    rf"(?<![\w.>:])(?P<recv>{_ID}(?:\s*(?:->|\.)\s*{_ID})*?)\s*(?P<op>->|\.)\s*(?P<m>{_ID})\s*\(")
+_call_free = re.compile(rf"(?<![\w.>:])(?P<name>{_ID})\s*\(")
+_member_path = re.compile(rf"\s*(->|\.)\s*")
+_lvalue = re.compile(rf"{_ID}(?:\s*(?:->|\.)\s*{_ID}|\s*\[[^\]]*\])*")
+_scope_ref = re.compile(rf"\s*::\s*(?P<name>{_ID})")
+_main_open = re.compile(r"\bint\s+main\s*\([^)]*\)\s*\{")
+_int_lit = re.compile(r"^[+-]?(?:0[xX][0-9a-fA-F]+|\d+)(?P<sfx>[uUlL]*)$")
+_float_lit = re.compile(r"^[+-]?(?:\d+\.\d*|\.\d+|\d+(?=[eE]))(?:[eE][+-]?\d+)?(?P<f>[fFlL]?)$")
+_str_lit = re.compile(r'^(?:"(?:[^"\\\n]|\\.)*"\s*)+$')
+_cast = re.compile(r"^(?:static|const|reinterpret)_cast\s*<")
+# `callee(` of a call expression: a function, or a method through a path
+_callee = re.compile(rf"^(?P<callee>{_ID}(?:\s*(?:->|\.)\s*{_ID})*)\s*\(")
+# a plain function's definition or prototype, for the return type of calls
+_fn_decl = re.compile(
+    rf"^[ \t]*(?P<ret>(?:{_ID}[ \t*&]+)+?)(?P<name>{_ID})\s*\([^;{{}}()]*\)\s*[{{;]", re.MULTILINE)
+_block_kw = re.compile(r"\b(?:struct|class|union|enum|namespace)\b[^()]*$")
+_word_at_end = re.compile(rf"({_ID})\s*$")
+
+_KEYWORDS = frozenset(
+    "return if else while for do switch case default break continue goto sizeof new delete throw "
+    "typedef struct class union enum const static inline virtual explicit operator this template "
+    "typename using namespace public private protected friend mutable volatile".split()
+)
+# members the pass can't lower; their class template is left as it is
+_UNSUPPORTED = re.compile(r"\b(?:operator|friend|virtual|static|template|using|typedef|union|enum)\b")
+
+Edit = Tuple[int, int, str]
+
+
+class _Unsupported(Exception):
+    pass
+
+
+@dataclass
+class _TParam:
+    name: str
+    default: Optional[str] = None
+
+
+@dataclass
+class _Member:
+    kind: str                    # "field" | "method" | "ctor" | "dtor"
+    name: str = ""
+    ret: str = ""
+    params: str = ""             # text between the parentheses
+    inits: str = ""              # constructor initializer list, after the ':'
+    body: Optional[str] = None   # "{...}", dedented; None while only declared
+    const: bool = False
+    # fields: (name, raw type, array suffix, default initializer)
+    decls: List[Tuple[str, str, str, Optional[str]]] = field(default_factory=list)
+    lead: str = ""               # comment lines above the member
+    # template parameter names of an out-of-class definition
+    tnames: List[str] = field(default_factory=list)
+
+
+@dataclass
+class _Class:
+    name: str
+    tparams: List[_TParam]
+    members: List[_Member]
+    nested: List["_Class"]
+
+
+@dataclass
+class _Function:
+    name: str
+    tparams: List[_TParam]
+    ret: str
+    params: str
+    body: str
+
+
+@dataclass
+class _Span:
+    start: int
+    end: int
+    name: Optional[str]          # None: left as it is
+    kind: str                    # "class" | "function" | "member" | "decl" | "proto"
+
+
+@dataclass
+class _Parsed:
+    classes: Dict[str, _Class] = field(default_factory=dict)
+    functions: Dict[str, _Function] = field(default_factory=dict)
+    # every template declaration and definition, in source order
+    spans: List[_Span] = field(default_factory=list)
+
+
+@dataclass
+class _Param:
+    decl: str                    # C declaration, "int value"
+    name: str
+    ctype: str                   # "int", "Deque_int*"
+    ref: bool                    # a non-const reference, now a pointer
+    default: Optional[str]
+
+
+@dataclass
+class _Fn:
+    cname: str
+    ret: str
+    params: List[_Param]
+    member: Optional[_Member]    # None for a generated constructor/destructor
+    const: bool = False
+
+
+@dataclass
+class _ClassInst:
+    cls: _Class
+    struct: str
+    prefix: str
+    label: str
+    outer: Optional["_ClassInst"] = None
+    names: Dict[str, str] = field(default_factory=dict)
+    # (name, C type, array suffix, default initializer)
+    fields: List[Tuple[str, str, str, Optional[str]]] = field(default_factory=list)
+    field_types: Dict[str, str] = field(default_factory=dict)
+    methods: Dict[str, List[_Fn]] = field(default_factory=dict)
+    ctors: List[_Fn] = field(default_factory=list)
+    dtor: Optional[_Fn] = None
+    nested: List["_ClassInst"] = field(default_factory=list)
+    new: Set[int] = field(default_factory=set)      # constructors `new` is used with
+    deps: List["_ClassInst"] = field(default_factory=list)  # held by value
+    struct_code: str = ""
+    ctor_code: List[str] = field(default_factory=list)
+    fn_code: List[str] = field(default_factory=list)
+
+
+@dataclass
+class _FuncInst:
+    tmpl: _Function
+    fn: _Fn
+    names: Dict[str, str]
+    label: str
+    code: str = ""
+
+
+# ---------------------------------------------------------------------------
+# Scanning helpers. They look at a "mask": the text with comments and
+# literals blanked, same length, so positions carry over to the text.
+
+_OPEN = {"(": ")", "[": "]", "{": "}", "<": ">"}
+
+
+def _match(mask: str, i: int) -> int:
+    """Index of the bracket that closes the one at `i`, or -1."""
+    o, c = mask[i], _OPEN[mask[i]]
+    depth = 0
+    j = i
+    while j < len(mask):
+        ch = mask[j]
+        if ch == o:
+            depth += 1
+        elif ch == c:
+            depth -= 1
+            if depth == 0:
+                return j
+        elif o == "<":
+            if ch == "(":
+                # a parenthesized template argument
+                j = _match(mask, j)
+                if j < 0:
+                    return -1
+            elif ch in ";{})":
+                return -1
+        j += 1
+    return -1
+
+
+def _split(text: str, mask: str, angles: bool = True) -> List[str]:
+    """`text` split at the commas outside brackets. Call arguments pass
+    `angles=False`, since `a < b` there is a comparison."""
+    opens, closes = ("([{<", ")]}>") if angles else ("([{", ")]}")
+    parts: List[str] = []
+    depth = last = 0
+    for j, ch in enumerate(mask):
+        if ch in opens:
+            depth += 1
+        elif ch in closes:
+            depth -= 1
+        elif ch == "," and depth == 0:
+            parts.append(text[last:j].strip())
+            last = j + 1
+    tail = text[last:].strip()
+    if tail or parts:
+        parts.append(tail)
+    return parts
+
+
+def _split_text(text: str, angles: bool = True) -> List[str]:
+    return _split(text, _blank_comments(text), angles)
+
+
+def _prev(mask: str, i: int) -> str:
+    """The two characters before `i`, whitespace skipped."""
+    j = i
+    while j > 0 and mask[j - 1].isspace():
+        j -= 1
+    return mask[max(0, j - 2):j]
+
+
+def _skip_ws(mask: str, i: int) -> int:
+    while i < len(mask) and mask[i].isspace():
+        i += 1
+    return i
+
+
+def _next(mask: str, i: int) -> str:
+    """The two characters from `i`, whitespace skipped."""
+    j = _skip_ws(mask, i)
+    return mask[j:j + 2]
+
+
+def _member_name(mask: str, s: int) -> bool:
+    """The identifier at `s` follows `.`, `->` or `::`."""
+    return _prev(mask, s)[-1:] == "." or _prev(mask, s) in ("->", "::")
+
+
+def _apply(text: str, edits: Iterable[Edit]) -> str:
+    """Apply (start, end, replacement) edits. Edits must not overlap; two
+    insertions at one position keep their order."""
+    ordered = sorted(enumerate(edits), key=lambda e: (e[1][0], e[0]), reverse=True)
+    for _, (s, e, r) in ordered:
+        text = text[:s] + r + text[e:]
+    return text
+
+
+def _norm(t: str) -> str:
+    return _type_punct.sub(r"\1", " ".join(t.split()))
+
+
+def _mangle(t: str) -> str:
+    return _non_word.sub("_", _norm(t).replace("*", " ptr").replace("&", "")).strip("_")
+
+
+def _snake(name: str) -> str:
+    return _camel.sub("_", name).lower()
+
+
+def _dedent(text: str, col: int) -> str:
+    """Strip up to `col` columns of indentation from every line but the first."""
+    lines = text.split("\n")
+    for k in range(1, len(lines)):
+        ln = lines[k]
+        cut = len(ln) - len(ln.lstrip(" \t"))
+        lines[k] = ln[min(cut, col):]
+    return "\n".join(lines)
+
+
+def _column(text: str, i: int) -> int:
+    return i - (text.rfind("\n", 0, i) + 1)
+
+
+def _indent_at(text: str, i: int) -> str:
+    line = text[text.rfind("\n", 0, i) + 1:]
+    return line[:len(line) - len(line.lstrip(" \t"))]
+
+
+def _lead(text: str, start: int, end: int) -> str:
+    """The comment lines between two members."""
+    chunk = text[start:end]
+    if "//" not in chunk and "/*" not in chunk:
+        return ""
+    return "\n".join(ln.strip() for ln in chunk.strip().split("\n") if ln.strip())
+
+
+def _first_line(text: str) -> str:
+    return " ".join(text.split("{", 1)[0].split())
+
+
+# ---------------------------------------------------------------------------
+# Parsing the templates
+
+
+def _tparams(text: str) -> List[_TParam]:
+    out = []
+    for p in _split_text(text):
+        m = _tparam_type.match(p) or _tparam_value.match(p)
+        if not m or "..." in p:
+            raise _Unsupported(p)
+        default = m.group("default")
+        out.append(_TParam(m.group("name"), default.strip() if default else None))
+    return out
+
+
+def _body_end(mask: str, i: int) -> Tuple[int, str]:
+    """From `i`, the first top-level ';', or the '{' that opens a body.
+    Parentheses and the brace initializers of a constructor's initializer
+    list are skipped. Returns (index, ';' or '{')."""
+    j = i
+    init_list = False
+    while j < len(mask):
+        ch = mask[j]
+        if ch == "(":
+            j = _match(mask, j)
+            if j < 0:
+                raise _Unsupported("unbalanced")
+        elif ch == ":" and mask[j + 1:j + 2] != ":" and mask[j - 1:j] != ":":
+            init_list = True
+        elif ch == ";" or ch == "}":
+            return j, ";"
+        elif ch == "{":
+            before = _prev(mask, j)
+            if init_list and before and (before[-1].isalnum() or before[-1] == "_"):
+                # `: next{nullptr}` in an initializer list
+                j = _match(mask, j)
+                if j < 0:
+                    raise _Unsupported("unbalanced")
+            else:
+                return j, "{"
+        j += 1
+    raise _Unsupported("no body")
+
+
+def _function_tail(text: str, mask: str, paren: int) -> Tuple[str, str, bool, int, Optional[int]]:
+    """Parse `(params) const : inits {...}` from the parenthesis at `paren`.
+    Returns (params, inits, const, where the body or ';' is, body end)."""
+    close = _match(mask, paren)
+    if close < 0:
+        raise _Unsupported("params")
+    params = text[paren + 1:close]
+    at, kind = _body_end(mask, close + 1)
+    between = mask[close + 1:at]
+    colon = between.find(":")
+    inits = "" if colon < 0 else text[close + 2 + colon:at].strip()
+    const = False
+    for q in (between if colon < 0 else between[:colon]).replace("=", " = ").split():
+        if q == "const":
+            const = True
+        elif q not in ("noexcept", "override", "final", "=", "default", "delete", "0"):
+            raise _Unsupported(q)
+    if kind == ";":
+        return params, inits, const, at, None
+    end = _match(mask, at)
+    if end < 0:
+        raise _Unsupported("body")
+    return params, inits, const, at, end
+
+
+def _parse_class(name: str, tparams: List[_TParam], text: str, mask: str) -> _Class:
+    """The members of a class body (`text` is what is between its braces)."""
+    cls = _Class(name, tparams, [], [])
+    pos = prev_end = 0
+    n = len(mask)
+    while True:
+        pos = _skip_ws(mask, pos)
+        if pos >= n:
+            break
+        m = _access.match(mask, pos)
+        if m:
+            pos = prev_end = m.end()
+            continue
+        start = pos
+        col = _column(text, start)
+        lead = _lead(text, prev_end, start)
+        end, kind = _body_end(mask, start)
+        head_mask = mask[start:end]
+        head = text[start:end]
+        if _UNSUPPORTED.search(head_mask):
+            raise _Unsupported(head.strip())
+        nested = _class_head.match(head_mask)
+        if kind == "{" and nested:
+            close = _match(mask, end)
+            semi = mask.find(";", close)
+            if close < 0 or semi < 0 or mask[close + 1:semi].strip():
+                raise _Unsupported(head)
+            cls.nested.append(_parse_class(nested.group("name"), [], text[end + 1:close], mask[end + 1:close]))
+            pos = prev_end = semi + 1
+            continue
+        if kind == ";" and _class_decl.match(head_mask):
+            # forward declaration of a nested class
+            pos = prev_end = end + 1
+            continue
+        paren = head_mask.find("(")
+        if paren < 0:
+            if kind != ";":
+                raise _Unsupported(head)
+            cls.members.append(_field(head, head_mask, lead))
+            pos = prev_end = end + 1
+            continue
+        fm = _member_fn.search(head_mask[:paren])
+        if not fm:
+            raise _Unsupported(head)
+        ret = _specifiers.sub("", head[:fm.start()]).strip()
+        mname = fm.group("name")
+        params, inits, const, body_at, body_close = _function_tail(text, mask, start + paren)
+        if fm.group("dtor"):
+            if mname != name:
+                raise _Unsupported(head)
+            mkind = "dtor"
+        elif mname == name and not ret:
+            mkind = "ctor"
+        elif ret:
+            mkind = "method"
+        else:
+            raise _Unsupported(head)
+        stmt_end = body_at + 1
+        if body_close is None:
+            if "=" in mask[start:body_at]:
+                # `= default` / `= delete`: nothing to generate
+                pos = prev_end = stmt_end
+                continue
+            body = None
+        else:
+            body = _dedent(text[body_at:body_close + 1], col)
+            stmt_end = body_close + 1
+            if _next(mask, stmt_end)[:1] == ";":
+                stmt_end = mask.index(";", stmt_end) + 1
+        cls.members.append(_Member(mkind, mname, ret, params, inits, body, const, lead=lead))
+        pos = prev_end = stmt_end
+    return cls
+
+
+def _field(text: str, mask: str, lead: str) -> _Member:
+    parts = _split(text, mask)
+    m = _field_type.match(_blank_comments(parts[0]))
+    if not m:
+        raise _Unsupported(text)
+    base = parts[0][:m.end()].replace("mutable ", "").strip()
+    decls = []
+    for p in [parts[0][m.end():]] + parts[1:]:
+        d = _declarator.match(p.strip())
+        if not d or "&" in d.group("ptr"):
+            raise _Unsupported(text)
+        init = d.group("init")
+        if init:
+            init = init[1:].strip() if init.startswith("=") else (init[1:-1].strip() or "0")
+        decls.append((d.group("name"), base + "".join(d.group("ptr").split()), d.group("arr").strip(), init))
+    return _Member("field", decls=decls, lead=lead)
+
+
+def _parse(code: str, mask: str) -> _Parsed:
+    out = _Parsed()
+    bad: Set[str] = set()
+    out_of_class: List[Tuple[str, List[str], _Member]] = []
+    depth = pos = 0
+    while True:
+        m = _template_kw.search(mask, pos)
+        if not m:
+            break
+        pos = m.end()
+        tok = m.group(0)
+        if tok == "{" or tok == "}":
+            depth += 1 if tok == "{" else -1
+            continue
+        if depth:
+            continue
+        s = m.start()
+        lt = m.end() - 1
+        gt = _match(mask, lt)
+        if gt < 0:
+            break
+        try:
+            at, kind = _body_end(mask, gt + 1)
+        except _Unsupported:
+            break
+        stop = at + 1
+        if kind == "{":
+            close = _match(mask, at)
+            if close < 0:
+                break
+            stop = close + 1
+            if _next(mask, stop)[:1] == ";":
+                stop = mask.index(";", stop) + 1
+        head = mask[gt + 1:at]
+        name: Optional[str] = None
+        span_kind = "class"
+        try:
+            if not mask[lt + 1:gt].strip():
+                raise _Unsupported("explicit specialization")
+            if head.lstrip().startswith("template"):
+                raise _Unsupported("member template")
+            tparams = _tparams(code[lt + 1:gt])
+            cm = _class_head.match(head)
+            if cm:
+                name = cm.group("name")
+                if kind == ";":
+                    span_kind = "decl"
+                else:
+                    if name in out.classes:
+                        raise _Unsupported("redefinition")
+                    close = _match(mask, at)
+                    out.classes[name] = _parse_class(name, tparams, code[at + 1:close], mask[at + 1:close])
+            else:
+                paren = head.find("(")
+                if paren < 0:
+                    # a partial specialization, `class Deque<T*> {` and such
+                    sm = re.match(rf"\s*(?:class|struct)\s+({_ID})", head)
+                    name = sm.group(1) if sm else None
+                    raise _Unsupported(head)
+                om = _out_of_class.match(head[:paren + 1])
+                fm = None if om else _func_head.match(head[:paren + 1])
+                params, inits, const, body_at, body_close = _function_tail(code, mask, gt + 1 + paren)
+                if om:
+                    name = om.group("cls")
+                    span_kind = "member"
+                    mname = om.group("name")
+                    ret = _specifiers.sub("", code[gt + 1:gt + 1 + om.start("cls")]).strip()
+                    mkind = "dtor" if om.group("dtor") else ("ctor" if mname == name and not ret else "method")
+                    if body_close is None:
+                        raise _Unsupported("member declaration")
+                    out_of_class.append((name, [t.name for t in tparams], _Member(
+                        mkind, mname, ret, params, inits, _dedent(code[body_at:body_close + 1], 0), const)))
+                elif fm and fm.group("name") not in _KEYWORDS:
+                    name = fm.group("name")
+                    ret = _specifiers.sub("", fm.group("ret")).strip()
+                    if not ret or inits or const:
+                        raise _Unsupported(head)
+                    if body_close is None:
+                        span_kind = "proto"
+                    else:
+                        span_kind = "function"
+                        if name in out.functions:
+                            # overloads would need overload resolution
+                            raise _Unsupported("overloaded function template")
+                        out.functions[name] = _Function(name, tparams, ret, params, code[body_at:body_close + 1])
+                else:
+                    raise _Unsupported(head)
+        except _Unsupported:
+            if name:
+                bad.add(name)
+            out.spans.append(_Span(s, stop, None, "keep"))
+            pos = stop
+            continue
+        out.spans.append(_Span(s, stop, name, span_kind))
+        pos = stop
+    for cname, tnames, member in out_of_class:
+        cls = out.classes.get(cname)
+        if cls is None or len(tnames) != len(cls.tparams) or not _define(cls, member):
+            bad.add(cname)
+        member.tnames = tnames
+    for cls in out.classes.values():
+        if _undefined(cls):
+            bad.add(cls.name)
+    for name in bad:
+        out.classes.pop(name, None)
+        out.functions.pop(name, None)
+    for sp in out.spans:
+        if sp.name not in out.classes and sp.name not in out.functions:
+            sp.name, sp.kind = None, "keep"
+    return out
+
+
+def _define(cls: _Class, member: _Member) -> bool:
+    """Put an out-of-class member definition in place of its declaration."""
+    for k, mem in enumerate(cls.members):
+        if mem.kind == member.kind and mem.name == member.name and mem.body is None \
+                and _param_types(mem.params) == _param_types(member.params):
+            member.lead = mem.lead
+            # the declaration in the class has the default arguments
+            member.params = _merge_defaults(mem.params, member.params)
+            cls.members[k] = member
+            return True
+    return False
+
+
+def _undefined(cls: _Class) -> bool:
+    return any(m.kind != "field" and m.body is None for m in cls.members) or any(_undefined(c) for c in cls.nested)
+
+
+def _param_types(params: str) -> List[str]:
+    out = []
+    for p in _split_text(params):
+        pm = _param.match(p)
+        out.append(_norm(f"{pm.group('type')}{pm.group('ptr')}" if pm else p))
+    return out
+
+
+def _merge_defaults(decl: str, definition: str) -> str:
+    dparts = _split_text(decl)
+    parts = _split_text(definition)
+    if len(dparts) != len(parts):
+        return definition
+    out = []
+    for d, p in zip(dparts, parts):
+        dm = _param.match(d)
+        if dm and dm.group("default") and "=" not in p:
+            p = f"{p} = {dm.group('default')}"
+        out.append(p)
+    return ", ".join(out)
+
+
+# ---------------------------------------------------------------------------
+# Call sites
+
+
+def _call_args(text: str, mask: str, paren: int) -> Tuple[List[str], int]:
+    close = _match(mask, paren)
+    if close < 0:
+        return [], -1
+    return _split(text[paren + 1:close], mask[paren + 1:close], angles=False), close
+
+
+def _pick(fns: List[_Fn], n: int) -> Optional[int]:
+    """The first overload that takes `n` arguments."""
+    for k, fn in enumerate(fns):
+        required = sum(1 for p in fn.params if p.default is None)
+        if required <= n <= len(fn.params):
+            return k
+    return None
+
+
+def _call_fixups(fn: _Fn, nargs: int, mask: str, start: int, close: int) -> List[Edit]:
+    """`&` for the arguments of reference parameters, and the default
+    arguments C lacks. The arguments are `mask[start:close]`."""
+    edits: List[Edit] = []
+    spans = []
+    depth = 0
+    last = start
+    for j in range(start, close):
+        ch = mask[j]
+        if ch in "([{":
+            depth += 1
+        elif ch in ")]}":
+            depth -= 1
+        elif ch == "," and depth == 0:
+            spans.append((last, j))
+            last = j + 1
+    if nargs:
+        spans.append((last, close))
+    for (a, b), p in zip(spans, fn.params):
+        if not p.ref:
+            continue
+        a = _skip_ws(mask, a)
+        arg = mask[a:b].rstrip()
+        if _lvalue.fullmatch(arg):
+            edits.append((a, a, "&"))
+        else:
+            edits.append((a, a, "&("))
+            edits.append((a + len(arg), a + len(arg), ")"))
+    missing = fn.params[nargs:]
+    if missing:
+        edits.append((close, close, (", " if nargs else "") + ", ".join(p.default or "0" for p in missing)))
+    return edits
+
+
+def _destroys(text: str, mask: str, decl: int, end: int, name: str, call: str) -> List[Edit]:
+    """Destructor calls for a local declared at `decl`: before every return
+    after it, and at the end of its block."""
+    depth = 0
+    j = decl - 1
+    while j >= 0:
+        ch = mask[j]
+        if ch == "}":
+            depth += 1
+        elif ch == "{":
+            if depth == 0:
+                break
+            depth -= 1
+        j -= 1
+    close = _match(mask, j) if j >= 0 else -1
+    if close < 0:
+        return []
+    edits: List[Edit] = []
+    uses = re.compile(rf"\b{re.escape(name)}\b")
+    for m in _return.finditer(mask, end, close):
+        semi = mask.find(";", m.end(), close)
+        if semi < 0 or uses.search(mask, m.end(), semi):
+            # `return dq.size();` needs the object, so it can't be destroyed first
+            continue
+        edits.extend(_before_stmt(text, mask, m.start(), semi + 1, call))
+    # the end of the block, unless it ends in a return
+    k = close - 1
+    while k > end and mask[k].isspace():
+        k -= 1
+    stmt = mask[max(mask.rfind(";", end, k), mask.rfind("{", end, k), mask.rfind("}", end, k), end - 1) + 1:k + 1]
+    if mask[k] == ";" and re.match(r"\s*return\b", stmt):
+        return edits
+    line_start = text.rfind("\n", 0, close) + 1
+    if not text[line_start:close].strip():
+        edits.append((line_start, line_start, f"{_indent_at(text, decl)}{call}\n"))
+    else:
+        edits.append((close, close, f" {call} "))
+    return edits
+
+
+def _before_stmt(text: str, mask: str, start: int, end: int, call: str) -> List[Edit]:
+    """`call` ahead of the statement at `start`; the body of a braceless
+    `if`/`else`/loop gets braces."""
+    before = _prev(mask, start)
+    word = _word_at_end.search(mask, max(0, start - 64), start)
+    if before[-1:] == ")" or (word and word.group(1) in ("else", "do")):
+        return [(start, start, f"{{ {call} "), (end, end, " }")]
+    return [(start, start, f"{call}\n{_indent_at(text, start)}")]
+
+
+def _prepend(body: str, stmts: List[str]) -> str:
+    """Statements at the top of a `{...}` body."""
+    if not stmts:
+        return body
+    lines = "".join(f"\n    {s}" for s in stmts)
+    inner = body[1:-1]
+    if "\n" not in inner:
+        # `{ inner.push(first); }` gets a line of its own
+        return "{" + lines + (f"\n    {inner.strip()}" if inner.strip() else "") + "\n}"
+    return "{" + lines + body[1:]
+
+
+def _append(body: str, stmts: List[str]) -> str:
+    """Statements at the end of a `{...}` body."""
+    if not stmts:
+        return body
+    inner = body[1:-1]
+    if "\n" not in inner:
+        body = "{" + (f"\n    {inner.strip()}" if inner.strip() else "") + "\n}"
+    return body[:-1].rstrip() + "".join(f"\n    {s}" for s in stmts) + "\n}"
+
+
+def _with_prototypes(fns: List[Tuple[_Fn, str, str]]) -> List[str]:
+    """The (fn, signature, text) definitions, led by prototypes when one of
+    them calls a function defined after it."""
+    names = [f.cname for f, _, _ in fns]
+    needed = any(re.search(rf"\b{re.escape(later)}\s*\(", text.split(sig, 1)[-1])
+                 for k, (_, sig, text) in enumerate(fns) for later in names[k + 1:])
+    texts = [t for _, _, t in fns]
+    if needed:
+        texts.insert(0, "\n".join(sig + ";" for _, sig, _ in fns))
+    return texts
+
+
+# ---------------------------------------------------------------------------
+# Lowering
+
+
+class _Monomorphizer:
+    def __init__(self, parsed: _Parsed, ctx: _ConversionContext) -> None:
+        self.parsed = parsed
+        self.ctx = ctx
+        self.classes: Dict[Tuple[str, Tuple[str, ...]], _ClassInst] = {}
+        self.by_struct: Dict[str, _ClassInst] = {}
+        self.functions: Dict[Tuple[str, Tuple[str, ...]], _FuncInst] = {}
+        self.pending: List[object] = []
+        # template uses whose arguments couldn't be worked out -> first one
+        self.unresolved: Dict[str, str] = {}
+        # return types of the plain functions, for deduction from calls
+        self.returns: Dict[str, str] = {}
+
+    # -- instances ---------------------------------------------------------
+
+    def _key(self, tparams: List[_TParam], args: List[str]) -> Optional[Tuple[str, ...]]:
+        """Normalized template arguments, defaults filled in."""
+        if len(args) > len(tparams) or not all(args):
+            return None
+        out = [_norm(a) for a in args]
+        for tp in tparams[len(args):]:
+            if tp.default is None:
+                return None
+            out.append(_norm(self.lower(tp.default, {t.name: a for t, a in zip(tparams, out)})))
+        return tuple(out)
+
+    def class_inst(self, name: str, args: Tuple[str, ...]) -> _ClassInst:
+        inst = self.classes.get((name, args))
+        if inst is not None:
+            return inst
+        cls = self.parsed.classes[name]
+        mangled = "_".join(_mangle(a) for a in args)
+        inst = _ClassInst(cls, f"{name}_{mangled}", f"{_snake(name)}_{mangled.lower()}",
+                          f"{name}<{', '.join(args)}>")
+        # registered first: `Node<T>* next` in Node<T> finds it
+        self.classes[(name, args)] = inst
+        self._shells(inst)
+        self._names(inst, {t.name: a for t, a in zip(cls.tparams, args)})
+        self._declare(inst)
+        self.pending.append(inst)
+        return inst
+
+    def _shells(self, inst: _ClassInst) -> None:
+        self.by_struct[inst.struct] = inst
+        for c in inst.cls.nested:
+            child = _ClassInst(c, f"{inst.struct}_{c.name}", f"{inst.prefix}_{_snake(c.name)}",
+                               f"{inst.label}::{c.name}", outer=inst)
+            inst.nested.append(child)
+            self._shells(child)
+
+    def _names(self, inst: _ClassInst, base: Dict[str, str]) -> None:
+        inst.names = dict(base)
+        inst.names.update({c.cls.name: c.struct for c in inst.nested})
+        inst.names[inst.cls.name] = inst.struct
+        for c in inst.nested:
+            self._names(c, inst.names)
+
+    def _member_names(self, inst: _ClassInst, mem: Optional[_Member]) -> Dict[str, str]:
+        if mem is None or not mem.tnames:
+            return inst.names
+        # an out-of-class definition may name the parameters differently
+        top = inst
+        while top.outer is not None:
+            top = top.outer
+        names = dict(inst.names)
+        for tp, tn in zip(top.cls.tparams, mem.tnames):
+            names[tn] = top.names[tp.name]
+        return names
+
+    def _declare(self, inst: _ClassInst) -> None:
+        """Field types and function signatures; the bodies come later."""
+        for c in inst.nested:
+            self._declare(c)
+        counts: Dict[str, int] = {}
+        for mem in inst.cls.members:
+            names = self._member_names(inst, mem)
+            if mem.kind == "field":
+                for fname, raw, arr, init in mem.decls:
+                    ctype = _norm(self.lower(raw, names))
+                    arr = self.lower(arr, names)
+                    inst.fields.append((fname, ctype, arr, init and self.lower(init, names)))
+                    if not arr:
+                        inst.field_types[fname] = ctype
+                        dep = self.by_struct.get(ctype)
+                        if dep is not None and dep not in inst.deps:
+                            inst.deps.append(dep)
+                continue
+            params = self.params(mem.params, names)
+            if mem.kind == "ctor":
+                n = len(inst.ctors) + 1
+                inst.ctors.append(_Fn(f"{inst.prefix}_init{n if n > 1 else ''}", "void", params, mem))
+            elif mem.kind == "dtor":
+                inst.dtor = _Fn(f"{inst.prefix}_destroy", "void", params, mem)
+            else:
+                n = counts[mem.name] = counts.get(mem.name, 0) + 1
+                ret = _norm(self.lower(mem.ret, names)).replace("&", "")
+                fn = _Fn(f"{inst.prefix}_{mem.name}{n if n > 1 else ''}", ret, params, mem, const=mem.const)
+                inst.methods.setdefault(mem.name, []).append(fn)
+                # for `std::cout << dq.get_front()` (see _expr_ctype)
+                self.ctx.types[f"{fn.cname}()"] = ret
+        # implicit constructor/destructor for the members that need one
+        if not inst.ctors and any(init is not None or self._has_init(t) for _, t, _, init in inst.fields):
+            inst.ctors.append(_Fn(f"{inst.prefix}_init", "void", [], None))
+        if inst.dtor is None and any(self._has_destroy(t) for _, t, arr, _ in inst.fields if not arr):
+            inst.dtor = _Fn(f"{inst.prefix}_destroy", "void", [], None)
+
+    def _has_init(self, ctype: str) -> bool:
+        inst = self.by_struct.get(ctype)
+        return bool(inst and inst.ctors)
+
+    def _has_destroy(self, ctype: str) -> bool:
+        inst = self.by_struct.get(ctype)
+        return bool(inst and inst.dtor)
+
+    def func_inst(self, name: str, args: Tuple[str, ...]) -> _FuncInst:
+        inst = self.functions.get((name, args))
+        if inst is not None:
+            return inst
+        tmpl = self.parsed.functions[name]
+        names = {t.name: a for t, a in zip(tmpl.tparams, args)}
+        cname = f"{name}_{'_'.join(_mangle(a) for a in args)}"
+        ret = _norm(self.lower(tmpl.ret, names)).replace("&", "")
+        inst = _FuncInst(tmpl, _Fn(cname, ret, self.params(tmpl.params, names), None), names,
+                         f"{name}<{', '.join(args)}>")
+        self.functions[(name, args)] = inst
+        self.ctx.types[f"{cname}()"] = ret
+        self.pending.append(inst)
+        return inst
+
+    def params(self, text: str, names: Dict[str, str]) -> List[_Param]:
+        out = []
+        for p in _split_text(text):
+            if not p or p == "void":
+                continue
+            m = _param.match(p)
+            if not m:
+                raise _Unsupported(p)
+            base = self.lower(m.group("type"), names)
+            ptr = "".join(m.group("ptr").split())
+            ref = False
+            if "&" in ptr:
+                if ptr.endswith("&&") or _leading_const.match(base):
+                    # by value; the const of a copy adds nothing
+                    base = _leading_const.sub("", base)
+                    ptr = ptr.replace("&", "")
+                else:
+                    ref = True
+                    ptr = ptr.replace("&", "*")
+            ctype = _norm(base + ptr + ("*" if m.group("arr") else ""))
+            default = m.group("default")
+            out.append(_Param(f"{ctype} {m.group('name')}", m.group("name"), ctype, ref,
+                              default and self.lower(default.strip(), names)))
+        return out
+
+    # -- types -------------------------------------------------------------
+
+    def lower(self, text: str, names: Dict[str, str]) -> str:
+        """`text` with the template parameters in `names` substituted and every
+        `Name<args>` of a template replaced by its instantiation."""
+        if not text:
+            return text
+        mask = _blank_comments(text)
+        edits: List[Edit] = []
+        pos = 0
+        while True:
+            m = _word.search(mask, pos)
+            if not m:
+                break
+            s, e = m.span()
+            w = m.group(0)
+            pos = e
+            if _member_name(mask, s):
+                continue
+            after = _next(mask, e)[:1]
+            if w == "typename":
+                edits.append((s, _skip_ws(mask, e), ""))
+            elif after == "<" and (w in self.parsed.classes or w in self.parsed.functions):
+                lt = mask.index("<", e)
+                gt = _match(mask, lt)
+                if gt < 0:
+                    continue
+                pos = gt + 1
+                args = _split_text(self.lower(text[lt + 1:gt], names))
+                if w in self.parsed.classes:
+                    key = self._key(self.parsed.classes[w].tparams, args)
+                    if key is None:
+                        self.unresolved.setdefault(w, text[s:gt + 1])
+                        continue
+                    repl, pos = self._scoped(self.class_inst(w, key), mask, gt + 1)
+                else:
+                    key = self._key(self.parsed.functions[w].tparams, args)
+                    if key is None or _next(mask, gt + 1)[:1] != "(":
+                        self.unresolved.setdefault(w, text[s:gt + 1])
+                        continue
+                    repl = self.func_inst(w, key).fn.cname
+                edits.append((s, pos, repl))
+            elif w in names and after != "<":
+                inst = self.by_struct.get(names[w])
+                if inst is None:
+                    edits.append((s, e, names[w]))
+                else:
+                    repl, pos = self._scoped(inst, mask, e)
+                    edits.append((s, pos, repl))
+        return _apply(text, edits)
+
+    def _scoped(self, inst: _ClassInst, mask: str, i: int) -> Tuple[str, int]:
+        """The instance's name, followed through `::Node` at `i`; a
+        `::method` gives the method's C name. Returns it and where it ends."""
+        m = _scope_ref.match(mask, i)
+        while m:
+            name = m.group("name")
+            child = next((c for c in inst.nested if c.cls.name == name), None)
+            if child is None:
+                fns = inst.methods.get(name)
+                if fns:
+                    return fns[0].cname, m.end()
+                break
+            inst, i = child, m.end()
+            m = _scope_ref.match(mask, i)
+        return inst.struct, i
+
+    def scope(self, text: str) -> Dict[str, str]:
+        """name -> C type of the parameters and locals declared in `text`."""
+        out = {}
+        for m in _local_decl.finditer(_blank_comments(text)):
+            t = m.group("type")
+            if t in _KEYWORDS or m.group("name") in _KEYWORDS:
+                continue
+            q = " ".join(w for w in m.group("q").split() if w in ("unsigned", "signed", "long", "short"))
+            # an array is typed as the pointer it decays to, for `a[i]`
+            arr = "*" if m.group("next") == "[" else ""
+            out[m.group("name")] = _norm(f"{q} {t}{m.group('ptr').replace('&', '')}{arr}".strip())
+        return out
+
+    def type_of(self, expr: str, scope: Dict[str, str]) -> Optional[str]:
+        """The C type of a simple argument expression, for deduction."""
+        expr = expr.strip()
+        im = _int_lit.match(expr)
+        if im:
+            sfx = im.group("sfx").lower()
+            return ("unsigned " if "u" in sfx else "") + ("long" if "l" in sfx else "int")
+        fm = _float_lit.match(expr)
+        if fm:
+            return {"f": "float", "l": "long double"}.get(fm.group("f").lower(), "double")
+        if len(expr) >= 3 and expr[0] == "'" and expr[-1] == "'":
+            return "char"
+        if _str_lit.match(expr):
+            return "const char*"
+        if expr in ("true", "false"):
+            return "bool"
+        if expr[:1] == "&":
+            t = self.type_of(expr[1:], scope)
+            return t and t + "*"
+        if expr[:1] == "*":
+            t = self.type_of(expr[1:], scope)
+            return t[:-1] if t and t.endswith("*") else None
+        mask = _blank_comments(expr)
+        if expr[-1:] in ")]":
+            return self._type_of_suffix(expr, mask, scope)
+        parts = _member_path.split(expr)
+        if not all(re.fullmatch(_ID, p) for p in parts[::2]):
+            return None
+        t = scope.get(parts[0]) or self.ctx.types.get(parts[0])
+        for op, name in zip(parts[1::2], parts[2::2]):
+            inst = t and self.by_struct.get(t.rstrip("*"))
+            if not inst or (op == "->") != t.endswith("*"):
+                return None
+            t = inst.field_types.get(name)
+        return t
+
+    def _type_of_suffix(self, expr: str, mask: str, scope: Dict[str, str]) -> Optional[str]:
+        """type_of for `(e)`, a cast, `a[i]` and calls: what ends in `)` or `]`."""
+        if expr[0] == "(":
+            return self.type_of(expr[1:-1], scope) if _match(mask, 0) == len(expr) - 1 else None
+        if expr[-1] == "]":
+            open_ = mask.find("[")
+            if open_ < 0 or _match(mask, open_) != len(expr) - 1:
+                return None
+            t = self.type_of(expr[:open_], scope)
+            return t[:-1] if t and t.endswith("*") else None
+        if _cast.match(mask):
+            lt = mask.index("<")
+            gt = _match(mask, lt)
+            paren = _skip_ws(mask, gt + 1) if gt >= 0 else -1
+            if paren < 0 or mask[paren:paren + 1] != "(" or _match(mask, paren) != len(expr) - 1:
+                return None
+            return _norm(self.lower(expr[lt + 1:gt], {}))
+        m = _callee.match(mask)
+        if not m:
+            return None
+        args, close = _call_args(expr, mask, m.end() - 1)
+        if close != len(expr) - 1:
+            return None
+        callee = _ws.sub("", expr[:m.end("callee")])
+        parts = _member_path.split(callee)
+        if len(parts) > 1:
+            # a method of an instantiated struct
+            recv, op, name = "".join(parts[:-2]), parts[-2], parts[-1]
+            t = self.type_of(recv, scope)
+            inst = t and self.by_struct.get(t.rstrip("*"))
+            fns = inst.methods.get(name) if inst else None
+            if not fns or (op == "->") != t.endswith("*"):
+                return None
+            k = _pick(fns, len(args))
+            return fns[k].ret if k is not None else None
+        tmpl = self.parsed.functions.get(callee)
+        if tmpl is not None:
+            key = self._deduce(tmpl, args, scope)
+            return self.func_inst(callee, key).fn.ret if key is not None else None
+        return self.returns.get(callee) or self.ctx.types.get(f"{callee}()")
+
+    # -- code --------------------------------------------------------------
+
+    def rewrite(self, text: str, scope: Dict[str, str]) -> str:
+        """Method calls, function template calls, `new`/`delete` and object
+        declarations of the instances in `text`."""
+        mask = _blank_comments(text)
+        edits: List[Edit] = []
+        for m in _call_method.finditer(mask):
+            recv = _ws.sub("", text[m.start("recv"):m.end("recv")])
+            t = self.type_of(recv, scope)
+            inst = t and self.by_struct.get(t.rstrip("*"))
+            fns = inst.methods.get(m.group("m")) if inst else None
+            if not fns or (m.group("op") == "->") != t.endswith("*"):
+                continue
+            args, close = _call_args(text, mask, m.end() - 1)
+            k = _pick(fns, len(args))
+            if k is None or close < 0:
+                continue
+            this = recv if t.endswith("*") else f"&{recv}"
+            edits.append((m.start(), m.end(), f"{fns[k].cname}({this}{', ' if args else ''}"))
+            edits.extend(_call_fixups(fns[k], len(args), mask, m.end(), close))
+        for m in _call_free.finditer(mask):
+            name = m.group("name")
+            if name not in self.parsed.functions or _member_name(mask, m.start()):
+                continue
+            args, close = _call_args(text, mask, m.end() - 1)
+            key = self._deduce(self.parsed.functions[name], args, scope)
+            if key is None or close < 0:
+                self.unresolved.setdefault(name, text[m.start():close + 1] if close >= 0 else name)
+                continue
+            fn = self.func_inst(name, key).fn
+            edits.append((m.start("name"), m.end("name"), fn.cname))
+            edits.extend(_call_fixups(fn, len(args), mask, m.end(), close))
+        for m in _new_expr.finditer(mask):
+            inst = self.by_struct.get(m.group("T"))
+            if inst is None:
+                continue
+            paren = m.start("open") if m.group("open") else -1
+            if not inst.ctors:
+                if m.group("open") == "(" and _next(mask, paren + 1)[:1] == ")":
+                    # `new X()` of a class without constructors
+                    edits.append((m.end("T"), mask.index(")", paren) + 1, ""))
+                continue
+            args, close = _call_args(text, mask, paren) if paren >= 0 else ([], -1)
+            k = _pick(inst.ctors, len(args))
+            if k is None or (paren >= 0 and close < 0):
+                continue
+            inst.new.add(k)
+            ctor = inst.ctors[k]
+            name = ctor.cname.replace("_init", "_new", 1)
+            if paren < 0:
+                edits.append((m.start(), m.end("T"), f"{name}()"))
+                continue
+            edits.append((m.start(), paren + 1, f"{name}("))
+            if m.group("open") == "{":
+                edits.append((close, close + 1, ")"))
+            edits.extend(_call_fixups(ctor, len(args), mask, paren + 1, close))
+        for m in _delete_stmt.finditer(mask):
+            t = scope.get(m.group("name"), "")
+            inst = self.by_struct.get(t[:-1]) if t.endswith("*") else None
+            if inst and inst.dtor:
+                edits.extend(_before_stmt(text, mask, m.start(), m.end(),
+                                          f"{inst.dtor.cname}({m.group('name')});"))
+        edits.extend(self._objects(text, mask))
+        return _apply(text, edits)
+
+    def _deduce(self, tmpl: _Function, args: List[str], scope: Dict[str, str]) -> Optional[Tuple[str, ...]]:
+        params = [_param.match(p) for p in _split_text(tmpl.params) if p and p != "void"]
+        if len(args) > len(params) or not all(params):
+            return None
+        tnames = {t.name for t in tmpl.tparams}
+        got: Dict[str, str] = {}
+        for pm, arg in zip(params, args):
+            ptype = _leading_const.sub("", pm.group("type")).strip()
+            if ptype not in tnames:
+                continue
+            t = self.type_of(arg, scope)
+            if t is None:
+                return None
+            t = _leading_const.sub("", t)
+            ptr = "".join(pm.group("ptr").split()).replace("&", "")
+            if ptr:
+                if not t.endswith(ptr):
+                    return None
+                t = t[:-len(ptr)]
+            if got.setdefault(ptype, t) != t:
+                return None
+        given = []
+        for tp in tmpl.tparams:
+            if tp.name not in got:
+                break
+            given.append(got[tp.name])
+        return self._key(tmpl.tparams, given)
+
+    def _objects(self, text: str, mask: str) -> List[Edit]:
+        """Constructor calls after each object declaration, destructor calls
+        before the returns and at the end of its block."""
+        edits: List[Edit] = []
+        names = "|".join(re.escape(s) for s in sorted(self.by_struct, key=len, reverse=True))
+        if not names:
+            return edits
+        decl = re.compile(rf"(?:^|(?<=[;{{}}]))[ \t]*(?P<T>{names})[ \t]+(?P<name>{_ID})\s*(?P<tail>[({{;])",
+                          re.MULTILINE)
+        for m in decl.finditer(mask):
+            inst = self.by_struct[m.group("T")]
+            name = m.group("name")
+            indent = _indent_at(text, m.start("T"))
+            if m.group("tail") == ";":
+                end = m.end()
+                if inst.ctors:
+                    k = _pick(inst.ctors, 0)
+                    if k is None:
+                        continue
+                    edits.append((end, end, f"\n{indent}{inst.ctors[k].cname}(&{name});"))
+            else:
+                paren = m.start("tail")
+                args, close = _call_args(text, mask, paren)
+                if close < 0 or _next(mask, close + 1)[:1] != ";":
+                    continue
+                end = mask.index(";", close + 1) + 1
+                if inst.ctors:
+                    k = _pick(inst.ctors, len(args))
+                    if k is None:
+                        continue
+                    ctor = inst.ctors[k]
+                    edits.append((paren, paren + 1, f";\n{indent}{ctor.cname}(&{name}{', ' if args else ''}"))
+                    edits.append((close, close + 1, ")"))
+                    edits.extend(_call_fixups(ctor, len(args), mask, paren + 1, close))
+                elif m.group("tail") == "{":
+                    # aggregate initialization
+                    edits.append((paren, paren, "= " if mask[paren - 1].isspace() else " = "))
+                    if not args:
+                        edits.append((paren + 1, paren + 1, "0"))
+                else:
+                    continue
+            if inst.dtor is not None:
+                edits.extend(_destroys(text, mask, m.start("T"), end, name, f"{inst.dtor.cname}(&{name});"))
+        return edits
+
+    # -- generation --------------------------------------------------------
+
+    def run(self, code: str) -> str:
+        pieces = []
+        last = 0
+        for sp in self.parsed.spans:
+            pieces.append(code[last:sp.start])
+            last = sp.end
+        pieces.append(code[last:])
+        free = [self.lower(p, {}) for p in pieces]
+        for piece in free:
+            for m in _fn_decl.finditer(_blank_comments(piece)):
+                ret = " ".join(w for w in m.group("ret").split() if w not in ("static", "inline", "extern"))
+                if m.group("name") not in _KEYWORDS and ret and ret not in _KEYWORDS:
+                    self.returns[m.group("name")] = _norm(ret).replace("&", "")
+        globals_: Dict[str, str] = {}
+        for k, piece in enumerate(free):
+            free[k] = self._free_code(piece, globals_)
+        for k, piece in enumerate(free):
+            free[k] = self._global_inits(piece, globals_)
+        while self.pending:
+            item = self.pending.pop(0)
+            if isinstance(item, _ClassInst):
+                self._generate_class(item)
+            else:
+                self._generate_function(item)  # type: ignore[arg-type]
+        if self.unresolved:
+            name, use = next(iter(self.unresolved.items()))
+            raise ConversionError(
+                f"can't work out the template arguments of {name} in `{' '.join(use.split())}`; "
+                f"give them explicitly ({name}<int>(...)) or through a typed variable")
+        return self._assemble(code, free)
+
+    def _free_code(self, text: str, globals_: Dict[str, str]) -> str:
+        """Rewrite the code outside the templates one top-level block at a
+        time, so every function sees its own declarations. File-scope
+        objects go into `globals_`."""
+        mask = _blank_comments(text)
+        out: List[str] = []
+        pos = 0
+        while True:
+            i = mask.find("{", pos)
+            close = _match(mask, i) if i >= 0 else -1
+            if close < 0:
+                break
+            head = max(mask.rfind(";", pos, i), mask.rfind("}", pos, i), pos - 1) + 1
+            outside = text[pos:head]
+            out.append(outside)
+            self._globals(outside, globals_)
+            block = text[head:close + 1]
+            if _block_kw.search(mask[head:i]):
+                out.append(block)
+            else:
+                scope = {**globals_, **self.scope(block)}
+                out.append(self._io(self.rewrite(block, scope), scope))
+            pos = close + 1
+        out.append(text[pos:])
+        self._globals(text[pos:], globals_)
+        return "".join(out)
+
+    def _globals(self, text: str, globals_: Dict[str, str]) -> None:
+        for name, t in self.scope(text).items():
+            if t in self.by_struct:
+                globals_[name] = t
+
+    def _global_inits(self, text: str, globals_: Dict[str, str]) -> str:
+        """File-scope objects are constructed at the top of main()."""
+        m = _main_open.search(_blank_comments(text))
+        if not m:
+            return text
+        calls = []
+        for name, t in globals_.items():
+            inst = self.by_struct[t]
+            k = _pick(inst.ctors, 0)
+            if k is not None:
+                calls.append(f"\n    {inst.ctors[k].cname}(&{name});")
+        return text[:m.end()] + "".join(calls) + text[m.end():]
+
+    def _body(self, body: str, inst: Optional[_ClassInst], fn: _Fn, names: Dict[str, str],
+              first: Iterable[str] = (), last: Iterable[str] = ()) -> str:
+        """A member function or function template body in C. `first` and
+        `last` are statements (already C) to open and close it with."""
+        text = self.lower(body, names)
+        mask = _blank_comments(text)
+        locals_ = self.scope(text)
+        params = {p.name: p for p in fn.params}
+        edits: List[Edit] = []
+        if inst is not None:
+            for m in _this.finditer(mask):
+                edits.append((m.start(), m.end(), "(*self)" if "*" in m.group(0) else "self"))
+        for m in _word.finditer(mask):
+            w = m.group(0)
+            if _member_name(mask, m.start()):
+                continue
+            p = params.get(w)
+            if p is not None:
+                if p.ref:
+                    dot = _skip_ws(mask, m.end())
+                    if mask[dot:dot + 1] == "." and not mask[dot + 1:dot + 2].isdigit():
+                        edits.append((m.start(), dot + 1, f"{w}->"))
+                    else:
+                        edits.append((m.start(), m.end(), f"(*{w})"))
+                continue
+            if inst is None or w in locals_:
+                continue
+            if any(f[0] == w for f in inst.fields) or (w in inst.methods and _next(mask, m.end())[:1] == "("):
+                edits.append((m.start(), m.start(), "self->"))
+        text = _prepend(_apply(text, edits), list(first))
+        scope = {**locals_, **{p.name: p.ctype for p in fn.params}}
+        if inst is not None:
+            scope["self"] = inst.struct + "*"
+        text = _append(self.rewrite(text, scope), list(last))
+        return self._io(text, scope)
+
+    def _io(self, text: str, scope: Dict[str, str]) -> str:
+        """Run the I/O rules with the function's own types, so `std::cout <<
+        self->data` gets the format of this instantiation."""
+        local: Dict[str, str] = {}
+        for name, t in scope.items():
+            local[name] = t
+            inst = self.by_struct.get(t.rstrip("*"))
+            if inst is not None:
+                op = "->" if t.endswith("*") else "."
+                for f, ft in inst.field_types.items():
+                    local[f"{name}{op}{f}"] = ft
+        saved = self.ctx.types
+        self.ctx.types = ChainMap(local, saved)  # type: ignore[assignment]
+        try:
+            return _run_rules(text, "c", self.ctx, stage="io")
+        finally:
+            self.ctx.types = saved
+
+    def _signature(self, fn: _Fn, inst: Optional[_ClassInst]) -> str:
+        params = [p.decl for p in fn.params]
+        if inst is not None:
+            params.insert(0, f"{'const ' if fn.const else ''}{inst.struct}* self")
+        return f"{fn.ret} {fn.cname}({', '.join(params) or 'void'})"
+
+    def _function(self, fn: _Fn, inst: _ClassInst, body: str, **kw) -> Tuple[_Fn, str, str]:
+        mem = fn.member
+        sig = self._signature(fn, inst)
+        text = self._body(body, inst, fn, self._member_names(inst, mem), **kw)
+        return fn, sig, (f"{mem.lead}\n" if mem and mem.lead else "") + f"{sig} {text}"
+
+    def _generate_class(self, inst: _ClassInst) -> None:
+        for c in inst.nested:
+            self._generate_class(c)
+        lines = [f"struct {inst.struct} {{"]
+        for mem in inst.cls.members:
+            if mem.kind != "field":
+                continue
+            lines.extend(f"    {ln}" for ln in mem.lead.split("\n") if ln)
+            for fname, _, _, _ in mem.decls:
+                ctype, arr = next((t, a) for n, t, a, _ in inst.fields if n == fname)
+                lines.append(f"    {ctype} {fname}{arr};")
+        if len(lines) == 1:
+            lines.append("    char unused;  /* a C struct can't be empty */")
+        inst.struct_code = "\n".join(lines + ["};"])
+        ctors = [self._function(c, inst, c.member.body if c.member else "{\n}",
+                                first=self._field_inits(inst, c)) for c in inst.ctors]
+        fns = []
+        for mem in inst.cls.members:
+            if mem.kind == "method":
+                fn = next(f for f in inst.methods[mem.name] if f.member is mem)
+                fns.append(self._function(fn, inst, mem.body or "{\n}"))
+        # after the methods, so the destructor's calls need no prototypes
+        if inst.dtor is not None:
+            last = [f"{self.by_struct[t].dtor.cname}(&self->{n});"  # type: ignore[union-attr]
+                    for n, t, arr, _ in reversed(inst.fields) if not arr and self._has_destroy(t)]
+            mem = inst.dtor.member
+            fns.append(self._function(inst.dtor, inst, mem.body if mem else "{\n}", last=last))
+        texts = _with_prototypes(ctors + fns)
+        split = len(texts) - len(fns)
+        inst.ctor_code, inst.fn_code = texts[:split], texts[split:]
+
+    def _field_inits(self, inst: _ClassInst, ctor: _Fn) -> List[str]:
+        """Initializer list and default member initializers, in field order."""
+        names = self._member_names(inst, ctor.member)
+        given: Dict[str, str] = {}
+        if ctor.member and ctor.member.inits:
+            for item in _split_text(ctor.member.inits, angles=False):
+                im = _init_item.match(item)
+                if not im:
+                    raise _Unsupported(item)
+                expr = im.group("p") if im.group("p") is not None else im.group("b")
+                given[im.group("name")] = self.lower(expr.strip(), names)
+        out = []
+        for fname, ctype, arr, default in inst.fields:
+            expr = given.get(fname, default)
+            child = self.by_struct.get(ctype)
+            if child is not None and child.ctors:
+                args = [] if expr is None else _split_text(expr, angles=False)
+                k = _pick(child.ctors, len(args))
+                if k is not None:
+                    out.append(f"{child.ctors[k].cname}(&self->{fname}{''.join(', ' + a for a in args)});")
+            elif expr is not None and not arr:
+                out.append(f"self->{fname} = {expr or '0'};")
+        return out
+
+    def _generate_function(self, inst: _FuncInst) -> None:
+        inst.code = f"{self._signature(inst.fn, None)} {self._body(inst.tmpl.body, None, inst.fn, inst.names)}"
+
+    def _new_functions(self, inst: _ClassInst) -> List[str]:
+        out = []
+        for k in sorted(inst.new):
+            ctor = inst.ctors[k]
+            params = ", ".join(p.decl for p in ctor.params) or "void"
+            args = "".join(f", {p.name}" for p in ctor.params)
+            out.append(
+                f"{inst.struct}* {ctor.cname.replace('_init', '_new', 1)}({params}) {{\n"
+                f"    {inst.struct}* self = new {inst.struct};\n"
+                f"    {ctor.cname}(self{args});\n"
+                f"    return self;\n"
+                f"}}")
+        return out
+
+    def _parts(self, inst: _ClassInst) -> List[str]:
+        """Nested classes first, then the struct, constructors, `_new`,
+        methods and destructor."""
+        out: List[str] = []
+        for c in inst.nested:
+            out.extend(self._parts(c))
+        return out + [inst.struct_code] + inst.ctor_code + self._new_functions(inst) + inst.fn_code
+
+    def _emit_class(self, inst: _ClassInst, done: Set[int]) -> List[str]:
+        if id(inst) in done:
+            return []
+        done.add(id(inst))
+        out: List[str] = []
+        for dep in inst.deps:
+            # held by value: its struct must come first
+            if dep.cls is inst.cls:
+                out.extend(self._emit_class(dep, done))
+        out.append(f"// {inst.label}\n" + "\n\n".join(self._parts(inst)))
+        return out
+
+    def _assemble(self, code: str, free: List[str]) -> str:
+        out = [free[0]]
+        typedefs = bool(self.classes)
+        done: Set[int] = set()
+        for k, sp in enumerate(self.parsed.spans):
+            block: List[str] = []
+            if typedefs and sp.name is not None:
+                structs: List[_ClassInst] = []
+                stack = list(self.classes.values())
+                for inst in stack:
+                    stack.extend(inst.nested)
+                    structs.append(inst)
+                block.append("\n".join(f"typedef struct {i.struct} {i.struct};" for i in structs))
+                typedefs = False
+            text = code[sp.start:sp.end]
+            if sp.name is None:
+                block.append(text)
+            if sp.kind == "class":
+                insts = [i for (n, _), i in self.classes.items() if n == sp.name]
+                for inst in insts:
+                    block.extend(self._emit_class(inst, done))
+                if not insts:
+                    block.append(f"/* {_first_line(text)}: not instantiated */")
+            elif sp.kind in ("function", "proto"):
+                insts = [i for (n, _), i in self.functions.items() if n == sp.name]
+                for fi in insts:
+                    block.append(f"// {fi.label}\n{fi.code}" if sp.kind == "function"
+                                 else self._signature(fi.fn, None) + ";")
+                if not insts and sp.kind == "function":
+                    block.append(f"/* {_first_line(text)}: not instantiated */")
+            out.append("\n\n".join(block))
+            # a member defined out of class leaves nothing behind, nor its blank lines
+            out.append(free[k + 1] if block else free[k + 1].lstrip("\n"))
+        return "".join(out)
+
+
+def monomorphize(code: str, ctx: _ConversionContext) -> str:
+    """`code` with its class and function templates replaced by C code for
+    each instantiation used (see the module docstring)."""
+    parsed = _parse(code, _blank_comments(code))
+    if not parsed.classes and not parsed.functions:
+        return code
+    try:
+        out = _Monomorphizer(parsed, ctx).run(code)
+    except (_Unsupported, RecursionError):
+        return code
+    # the later passes need the declarations of the generated code
+    ctx.update(out)
+    return out
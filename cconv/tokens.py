@@ -0,0 +1,388 @@
+"""Single-pass C -> C++ engine (``--engine=tokens``).
+
+The regex engine in `converter.py` runs a dozen whole-file `re.sub` passes.
+This engine lexes the input once: one scanner finds comments, string/char
+literals, preprocessor lines and the handful of trigger identifiers the rules
+care about (`printf`, `malloc`, `free`, `NULL`, ...). Everything between two
+tokens is copied through untouched, and every rewrite rule is applied at its
+trigger during a single left-to-right walk.
+
+Output matches the regex engine on ordinary code. The differences are
+deliberate: nothing is rewritten inside comments or string literals, calls may
+span several lines, and identifiers such as `myfree` are not mistaken for
+`free`.
+"""
+from __future__ import annotations
+
+import re
+import time
+from typing import Callable, Dict, FrozenSet, List, Optional, Tuple, Union
+
+from .converter import (
+    _ARG,
+    _ConversionContext,
+    _fflush_stdout,
+    _printf_statement,
+    _read_after,
+    _run_rules,
+    _scanf_statement,
+    _stdio_include,
+)
+
+_ID = r"[A-Za-z_][A-Za-z0-9_]*"
+
+# One scanner for everything the walk has to see. Alternatives are tried in
+# order at each position, so a comment or literal always hides the trigger
+# words inside it.
+_SCAN = re.compile(
+    # cheap first-character gate before trying the alternatives
+    r"(?=[/\"'# \tpsmcfN])(?:"
+    r"(?P<comment>//[^\n]*|/\*.*?(?:\*/|\Z))"
+    r"|(?P<str>\"(?:[^\"\\\n]|\\.)*\"|'(?:[^'\\\n]|\\.)*')"
+    r"|(?P<pp>^[ \t]*#(?:[^\n\\]|\\(?:\r?\n|.))*)"
+    r"|(?P<kw>\b(?:printf|scanf|fflush|malloc|calloc|free|struct|NULL)\b))",
+    re.MULTILINE | re.DOTALL,
+)
+
+_PP_INCLUDE_STDIO = re.compile(r"[ \t]*#\s*include\s*<stdio\.h>\s*")
+_PP_DEFINE = re.compile(r"[ \t]*#\s*define\b")
+
+_CALL_TAIL = re.compile(r"\s*;")
+_OPEN_PAREN = re.compile(r"\s*\(")
+
+# Allocation rules. Each is split into the part before the trigger word
+# (matched backwards against the text already walked) and the part from the
+# trigger word on. They mirror the patterns of
+# `_convert_malloc_free_to_new_delete` one for one.
+_BACK_WINDOW = 256
+_BACK_CAST = re.compile(
+    rf"(?P<name>{_ID})\s*=\s*\(\s*(?:struct\s+)?(?P<T>{_ID})\s*\*\s*\)\s*\Z"
+)
+_BACK_PLAIN = re.compile(rf"(?P<name>{_ID})\s*=\s*\Z")
+_BACK_TYPED = re.compile(
+    rf"(?:(?P<semi>;)|^)(?P<ws>\s*)(?:struct\s+)?(?P<T>{_ID})\s*\*\s*(?P<name>{_ID})\s*=\s*\Z"
+)
+_MALLOC_SIZEOF_T = re.compile(
+    rf"malloc\s*\(\s*sizeof\(\s*(?:struct\s+)?(?P<T>{_ID})\s*\)\s*(?:\*\s*(?P<n>[^\)]{_ARG}))?\)\s*;"
+)
+_MALLOC_SIZEOF_PTR = re.compile(
+    rf"malloc\s*\(\s*sizeof\s*\(\s*\*\s*(?P<v>{_ID})\s*\)\s*(?:\*\s*(?P<n>[^\)]{_ARG}))?\)\s*;"
+)
+_CALLOC_SIZEOF_T = re.compile(
+    rf"calloc\s*\(\s*(?P<n>[^,]{_ARG})\s*,\s*sizeof\(\s*(?:struct\s+)?(?P<T>{_ID})\s*\)\s*\)\s*;"
+)
+_CALLOC_SIZEOF_PTR = re.compile(
+    rf"calloc\s*\(\s*(?P<n>[^,]{_ARG})\s*,\s*sizeof\(\s*\*\s*(?P<v>{_ID})\s*\)\s*\)\s*;"
+)
+
+_FFLUSH_STDOUT = re.compile(r"fflush\s*\(\s*stdout\s*\)\s*;")
+_FREE = re.compile(rf"free\s*\(\s*(?P<name>{_ID})\s*\)\s*;")
+_STRUCT_PTR = re.compile(rf"struct\s+(?P<name>{_ID})\s*\*")
+
+# Pass order of the regex engine; when one name is allocated by several
+# statements, the rank decides which kind `free` sees, exactly as there.
+_RANK_CAST_ARRAY, _RANK_CAST_SCALAR, _RANK_SIZEOF_PTR = 0, 1, 2
+_RANK_TYPED_ARRAY, _RANK_TYPED_SCALAR = 3, 4
+_RANK_CALLOC_CAST, _RANK_CALLOC_PTR = 5, 6
+# the matching entries of `converter.RULES`, so `disabled_rules` works here too
+_RANK_RULE = (
+    "malloc-cast-array", "malloc-cast-scalar", "malloc-sizeof-ptr",
+    "malloc-typed-array", "malloc-typed-scalar", "calloc-cast", "calloc-sizeof-ptr",
+)
+
+# An output piece: (source start, source end, text or a resolver run after
+# the walk, once every allocation has been seen).
+_Piece = Tuple[int, int, Union[str, Callable[[], str]]]
+
+
+def _join(pieces: List[_Piece]) -> str:
+    return "".join(t if isinstance(t, str) else t() for _, _, t in pieces)
+
+
+def _call_ends(code: str, open_pos: int) -> Dict[int, int]:
+    """Index just past the `)` matching the `(` at `open_pos`, or -1, and
+    the same for every `(` the scan passed on the way: a later call inside
+    an unclosed one is answered without scanning to the end again."""
+    ends: Dict[int, int] = {}
+    opened: List[int] = []
+    quote: Optional[str] = None
+    i = open_pos
+    n = len(code)
+    while i < n:
+        ch = code[i]
+        if quote:
+            if ch == "\\":
+                i += 1
+            elif ch == quote:
+                quote = None
+        elif ch in ('"', "'"):
+            quote = ch
+        elif ch == "(":
+            opened.append(i)
+        elif ch == ")":
+            ends[opened.pop()] = i + 1
+            if not opened:
+                return ends
+        i += 1
+    for pos in opened:
+        ends[pos] = -1
+    return ends
+
+
+class _Walker:
+    def __init__(self, code: str, ctx: _ConversionContext, disabled: FrozenSet[str] = frozenset(),
+                 alloc_log: Optional[List[Tuple[int, int, str, str]]] = None) -> None:
+        self.code = code
+        self.ctx = ctx
+        self.disabled = disabled
+        self.out: List[_Piece] = []
+        # (rank, position, name, kind) for every allocation rewritten
+        self.alloc_log = alloc_log if alloc_log is not None else []
+        # (source position, rule name) of every rewrite still in the output
+        self.hits: List[Tuple[int, str]] = []
+        # `(` position -> just past its `)`, or -1; see `_call_ends`
+        self.call_ends: Dict[int, int] = {}
+
+    # -- output helpers -------------------------------------------------
+    def emit(self, start: int, end: int, text: Union[str, Callable[[], str]]) -> None:
+        self.out.append((start, end, text))
+
+    def hit(self, start: int, rule: str) -> None:
+        self.hits.append((start, rule))
+
+    def copy(self, start: int, end: int) -> None:
+        if end > start:
+            self.out.append((start, end, self.code[start:end]))
+
+    def retract(self, start: int) -> bool:
+        """Drop output produced from source offsets >= `start`.
+
+        Verbatim pieces straddling `start` are cut; a rewritten piece that
+        straddles it cannot be undone, so the caller's rule doesn't apply.
+        """
+        out = self.out
+        k = len(out)
+        while k and out[k - 1][0] >= start:
+            k -= 1
+        if k and out[k - 1][1] > start:
+            s, e, text = out[k - 1]
+            if not isinstance(text, str) or text != self.code[s:e]:
+                return False
+            out[k - 1] = (s, start, self.code[s:start])
+        del out[k:]
+        hits = self.hits
+        while hits and hits[-1][0] >= start:
+            hits.pop()
+        return True
+
+    def rewrite_sub(self, start: int, end: int) -> List[_Piece]:
+        """Walk a nested fragment (call arguments, macro bodies)."""
+        sub = _Walker(self.code[start:end], self.ctx, self.disabled, self.alloc_log)
+        sub.walk()
+        self.hits.extend((start + pos, rule) for pos, rule in sub.hits)
+        return sub.out
+
+    # -- rules ------------------------------------------------------------
+    def rule_io(self, word: str, start: int) -> int:
+        if ("printf-to-cout" if word == "printf" else "scanf-to-cin") in self.disabled:
+            return -1
+        code = self.code
+        m = _OPEN_PAREN.match(code, start + len(word))
+        if not m:
+            return -1
+        open_pos = m.end() - 1
+        if open_pos not in self.call_ends:
+            self.call_ends.update(_call_ends(code, open_pos))
+        close = self.call_ends[open_pos]
+        if close < 0:
+            return -1
+        tail = _CALL_TAIL.match(code, close)
+        if not tail:
+            return -1
+        args = _join(self.rewrite_sub(open_pos + 1, close - 1))
+        call = f"{word}({args});"
+        if word == "printf":
+            new = _printf_statement(call, self.ctx, bool(_read_after.match(code, tail.end())))
+        else:
+            new = _scanf_statement(call, self.ctx)
+        if new == call:
+            new = code[start:open_pos + 1] + args + code[close - 1:tail.end()]
+        else:
+            self.hit(start, "printf-to-cout" if word == "printf" else "scanf-to-cin")
+        self.emit(start, tail.end(), new)
+        return tail.end()
+
+    def _alloc(self, back_start: int, end: int, rank: int, name: str, kind: str, new: str) -> int:
+        if _RANK_RULE[rank] in self.disabled:
+            return -1
+        if name in self.ctx.realloc_names or not self.retract(back_start):
+            return -1
+        self.alloc_log.append((rank, back_start, name, kind))
+        self.hit(back_start, _RANK_RULE[rank])
+        self.emit(back_start, end, new)
+        return end
+
+    def rule_alloc(self, word: str, start: int) -> int:
+        code = self.code
+        win_start = max(0, start - _BACK_WINDOW)
+        window = code[win_start:start]
+        types = self.ctx.types
+        if word == "malloc":
+            fw_t = _MALLOC_SIZEOF_T.match(code, start)
+            fw_p = None if fw_t else _MALLOC_SIZEOF_PTR.match(code, start)
+        else:
+            fw_t = _CALLOC_SIZEOF_T.match(code, start)
+            fw_p = None if fw_t else _CALLOC_SIZEOF_PTR.match(code, start)
+        if fw_t:
+            T, n = fw_t.group("T"), fw_t.group("n")
+            b = _BACK_CAST.search(window)
+            if b and b.group("T") == T:
+                name = b.group("name")
+                bs = win_start + b.start()
+                if word == "calloc":
+                    if n.strip() == "1":
+                        return self._alloc(bs, fw_t.end(), _RANK_CALLOC_CAST, name, "scalar", f"{name} = new {T}();")
+                    return self._alloc(bs, fw_t.end(), _RANK_CALLOC_CAST, name, "array", f"{name} = new {T}[{n}]();")
+                if n:
+                    return self._alloc(bs, fw_t.end(), _RANK_CAST_ARRAY, name, "array", f"{name} = new {T}[{n}];")
+                return self._alloc(bs, fw_t.end(), _RANK_CAST_SCALAR, name, "scalar", f"{name} = new {T};")
+            if word == "malloc":
+                b = _BACK_TYPED.search(window)
+                if b and b.group("T") == T and (b.group("semi") or win_start + b.start() == 0):
+                    # the ';' only anchors the match; it stays in the output
+                    # piece it already belongs to
+                    name = b.group("name")
+                    bs = win_start + b.start("ws")
+                    prefix = b.group("ws")
+                    if n:
+                        return self._alloc(bs, fw_t.end(), _RANK_TYPED_ARRAY, name, "array", f"{prefix}{T}* {name} = new {T}[{n}];")
+                    return self._alloc(bs, fw_t.end(), _RANK_TYPED_SCALAR, name, "scalar", f"{prefix}{T}* {name} = new {T};")
+            return -1
+        if fw_p:
+            v, n = fw_p.group("v"), fw_p.group("n")
+            if word == "malloc":
+                b = _BACK_CAST.search(window) or _BACK_PLAIN.search(window)
+                if not b or b.group("name") != v:
+                    return -1
+                T = b.groupdict().get("T")
+                if not T:
+                    decl = types.get(v)
+                    if decl:
+                        T = decl.replace("*", "").replace(" ", "")
+                T = T or "int"
+                bs = win_start + b.start()
+                if n:
+                    return self._alloc(bs, fw_p.end(), _RANK_SIZEOF_PTR, v, "array", f"{v} = new {T}[{n}];")
+                return self._alloc(bs, fw_p.end(), _RANK_SIZEOF_PTR, v, "scalar", f"{v} = new {T};")
+            b = _BACK_PLAIN.search(window)
+            if not b or b.group("name") != v:
+                return -1
+            T = types.get(v, "int").replace("*", "").replace(" ", "") or "int"
+            bs = win_start + b.start()
+            if n.strip() == "1":
+                return self._alloc(bs, fw_p.end(), _RANK_CALLOC_PTR, v, "scalar", f"{v} = new {T}();")
+            return self._alloc(bs, fw_p.end(), _RANK_CALLOC_PTR, v, "array", f"{v} = new {T}[{n}]();")
+        return -1
+
+    def rule_free(self, start: int) -> int:
+        if "free-to-delete" in self.disabled:
+            return -1
+        m = _FREE.match(self.code, start)
+        if not m:
+            return -1
+        name = m.group("name")
+        allocs = self.ctx.allocs
+
+        def resolve() -> str:
+            if allocs.get(name) == "array":
+                return f"delete[] {name};"
+            return f"delete {name};"
+
+        self.hit(start, "free-to-delete")
+        self.emit(start, m.end(), resolve)
+        return m.end()
+
+    def rule_pp(self, start: int, end: int) -> None:
+        text = self.code[start:end]
+        if _PP_INCLUDE_STDIO.fullmatch(text) and "include-stdio" not in self.disabled:
+            self.hit(start, "include-stdio")
+            self.emit(start, end, _stdio_include(self.ctx))
+        elif _PP_DEFINE.match(text):
+            # macro bodies get the same rewrites as ordinary code
+            body = start + text.index("#") + 1
+            head = self.code[start:body]
+            pieces = self.rewrite_sub(body, end)
+            self.emit(start, end, lambda: head + _join(pieces))
+        else:
+            self.copy(start, end)
+
+    # -- the walk ---------------------------------------------------------
+    def walk(self) -> None:
+        code = self.code
+        pos = 0
+        search = _SCAN.search
+        tokens = 0
+        while True:
+            m = search(code, pos)
+            if not m:
+                break
+            tokens += 1
+            if not tokens & 4095:
+                self.ctx.check_time()
+            start, end = m.span()
+            self.copy(pos, start)
+            kind = m.lastgroup
+            nxt = -1
+            if kind == "kw":
+                word = m.group("kw")
+                if word in ("printf", "scanf"):
+                    nxt = self.rule_io(word, start)
+                elif word in ("malloc", "calloc"):
+                    nxt = self.rule_alloc(word, start)
+                elif word == "free":
+                    nxt = self.rule_free(start)
+                elif word == "fflush":
+                    f = _FFLUSH_STDOUT.match(code, start)
+                    new = _fflush_stdout(self.ctx) if f and "fflush-stdout" not in self.disabled else None
+                    if new:
+                        self.hit(start, "fflush-stdout")
+                        self.emit(start, f.end(), new)
+                        nxt = f.end()
+                elif word == "struct":
+                    s = _STRUCT_PTR.match(code, start) if "struct-ptr" not in self.disabled else None
+                    if s:
+                        self.hit(start, "struct-ptr")
+                        self.emit(start, s.end(), s.group("name") + "*")
+                        nxt = s.end()
+                elif "null-to-nullptr" not in self.disabled:
+                    self.hit(start, "null-to-nullptr")
+                    self.emit(start, end, "nullptr")
+                    nxt = end
+            elif kind == "pp":
+                self.rule_pp(start, end)
+                nxt = end
+            if nxt < 0:
+                self.copy(start, end)
+                nxt = end
+            pos = nxt
+        self.copy(pos, len(code))
+
+
+def convert_c_to_cpp_tokens(code: str, ctx: Optional[_ConversionContext] = None) -> str:
+    ctx = ctx or _ConversionContext(code)
+    # containers and node pools replace whole statements or struct bodies;
+    # the walk then sees no malloc/free for them (a no-op unless enabled)
+    code = _run_rules(code, "cpp", ctx, stage="ownership")
+    t0 = time.perf_counter()
+    w = _Walker(code, ctx, ctx.options.disabled_rules)
+    w.walk()
+    # settle array/scalar kinds in the regex engine's pass order, then let the
+    # deferred `free` pieces pick delete or delete[]
+    for _, _, name, kind in sorted(w.alloc_log):
+        ctx.note_alloc(name, kind)
+    out = _join(w.out)
+    if ctx.stats is not None:
+        ctx.stats.add_pass("token-walk", time.perf_counter() - t0)
+        for _, rule in w.hits:
+            ctx.stats.count(rule)
+    return _run_rules(out, "cpp", ctx, stage="finish")
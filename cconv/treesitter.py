@@ -0,0 +1,522 @@
+"""Parser-backed C -> C++ engine (``--engine=tree-sitter``, optional).
+
+Needs the `tree-sitter` and `tree-sitter-c` packages; they are imported on
+first use only, so the rest of cconv never depends on them.
+
+The input is parsed once into a concrete syntax tree and rewritten bottom-up:
+each node's output is its children's output spliced with the source bytes
+between them, so every rewrite is a byte-range edit and comments, literals
+and layout survive untouched. What the tree buys over the other engines:
+
+- statements and calls are whole nodes, however many lines they span;
+- declarations are read from the tree with their scopes (function
+  parameters, blocks, `for` initializers), so a name shadowed in one
+  function has its own type there, for printf/scanf formats and for picking
+  `delete` vs `delete[]`;
+- the leaf rewrites themselves are the shared helpers of converter.py
+  (`_printf_statement`, `_scanf_statement`, the memory-stage rules), so
+  the output is what the other engines produce for the same statement.
+
+`TreeSitterSession` keeps the tree between calls: `convert(new_code)` diffs
+against the last input, reparses incrementally, and reuses the converted
+output of every function whose text and surrounding globals are unchanged.
+"""
+from __future__ import annotations
+
+import hashlib
+import re
+import time
+from collections import ChainMap
+from typing import Callable, Dict, List, Optional, Tuple, Union
+
+from .converter import (
+    ConvertOptions,
+    _ConversionContext,
+    _fflush_stdout,
+    _infer_decl_types,
+    _printf_statement,
+    _read_after,
+    _run_rules,
+    _scanf_statement,
+    _stdio_include,
+)
+
+# py-tree-sitter 0.22 is the first with Parser(language) and capsule
+# languages; tree-sitter-c 0.23 the first whose language() is a capsule
+SUPPORTED = "tree-sitter>=0.22,<0.26 tree-sitter-c>=0.23,<0.25"
+INSTALL_HINT = f"the tree-sitter engine needs `pip install {' '.join(repr(r) for r in SUPPORTED.split())}`"
+
+_STAR_AFTER = re.compile(rb"\s*\*")
+_INCLUDE_STDIO = re.compile(r"#\s*include\s*<stdio\.h>")
+_FFLUSH_STDOUT = re.compile(r"fflush\s*\(\s*stdout\s*\)\s*;")
+_FREE = re.compile(r"free\s*\(\s*(?P<name>[A-Za-z_]\w*)\s*\)\s*;")
+_ALLOC_CALLS = (b"malloc", b"calloc")
+# the file-scope nodes whose output may be reused when only other code changed
+_MEMO_TYPES = ("function_definition",)
+_SCOPE_TYPES = ("compound_statement", "for_statement")
+
+# An output piece: text, or a resolver run once every allocation is known.
+_Piece = Union[str, Callable[[], str]]
+
+_parser_cache = None
+
+
+def _installed(dist: str) -> str:
+    from importlib import metadata
+    try:
+        return metadata.version(dist)
+    except metadata.PackageNotFoundError:
+        return "?"
+
+
+def _parser():
+    """A tree-sitter parser for C; raises ImportError with INSTALL_HINT when
+    the packages are missing or aren't a version pair this engine supports."""
+    global _parser_cache
+    if _parser_cache is None:
+        try:
+            import tree_sitter
+            import tree_sitter_c
+        except ImportError as e:
+            raise ImportError(f"{INSTALL_HINT} ({e})") from None
+        try:
+            # bindings before 0.22 take Language(path, name) and have no
+            # Parser(language); a grammar built for an ABI the bindings
+            # don't know fails with a ValueError
+            parser = tree_sitter.Parser(tree_sitter.Language(tree_sitter_c.language()))
+        except (TypeError, ValueError, AttributeError) as e:
+            raise ImportError(
+                f"tree-sitter {_installed('tree-sitter')} with tree-sitter-c {_installed('tree-sitter-c')} "
+                f"can't be used ({e}); {INSTALL_HINT}") from None
+        _parser_cache = parser
+    return _parser_cache
+
+
+def _join(pieces: List[_Piece]) -> str:
+    return "".join(p if isinstance(p, str) else p() for p in pieces)
+
+
+def _point(src: bytes, offset: int) -> Tuple[int, int]:
+    row = src.count(b"\n", 0, offset)
+    return row, offset - (src.rfind(b"\n", 0, offset) + 1)
+
+
+class _Symbol:
+    __slots__ = ("name", "ctype", "kind")
+
+    def __init__(self, name: str, ctype: str) -> None:
+        self.name = name
+        self.ctype = ctype
+        # "array" / "scalar" once an allocation assigned it
+        self.kind: Optional[str] = None
+
+
+class _StatementContext:
+    """The conversion context as one statement sees it: the types visible in
+    its scope, and its allocations handed to `on_alloc` instead of recorded.
+    Everything else is the shared context's."""
+
+    def __init__(self, ctx: _ConversionContext, types,
+                 on_alloc: Optional[Callable[[str, str], None]] = None) -> None:
+        self._ctx = ctx
+        self.types = types
+        self._on_alloc = on_alloc or ctx.note_alloc
+
+    def note_alloc(self, name: str, kind: str) -> None:
+        self._on_alloc(name, kind)
+
+    def __getattr__(self, name: str):
+        return getattr(self._ctx, name)
+
+
+class _Rewriter:
+    """One bottom-up rewrite of a parsed file."""
+
+    def __init__(self, src: bytes, ctx: _ConversionContext, session: "TreeSitterSession",
+                 file_types: Dict[str, str]) -> None:
+        self.src = src
+        self.ctx = ctx
+        self.session = session
+        # what the regex analysis finds in the file-scope declarations, and
+        # in the function being rewritten: a memoized function's output may
+        # only depend on its own text and the file scope
+        self.file_types = file_types
+        self.local_types: Dict[str, str] = {}
+        self.disabled = ctx.options.disabled_rules
+        self.scopes: List[Dict[str, _Symbol]] = [{}]
+        self.hits: Dict[str, int] = {}
+        self.handlers = {
+            "function_definition": self.function,
+            "expression_statement": self.statement,
+            "declaration": self.declaration,
+            "parameter_declaration": self.declaration,
+            "null": self.null,
+            "identifier": self.null,
+            "struct_specifier": self.struct,
+            "preproc_include": self.include,
+            "preproc_def": self.define,
+            "preproc_function_def": self.define,
+            "comment": self.verbatim,
+            "string_literal": self.verbatim,
+            "char_literal": self.verbatim,
+            "system_lib_string": self.verbatim,
+        }
+        # allocations assigned to file-scope names by the node being rewritten
+        self.global_notes: List[Tuple[str, str]] = []
+
+    # -- helpers -----------------------------------------------------------
+    def text(self, start: int, end: int) -> str:
+        return self.src[start:end].decode("utf-8")
+
+    def hit(self, rule: str) -> None:
+        self.hits[rule] = self.hits.get(rule, 0) + 1
+
+    def lookup(self, name: str) -> Optional[_Symbol]:
+        for scope in reversed(self.scopes):
+            sym = scope.get(name)
+            if sym is not None:
+                return sym
+        return None
+
+    def types(self) -> ChainMap:
+        """The visible name -> C type map, innermost scope first."""
+        maps = [{n: s.ctype for n, s in scope.items()} for scope in reversed(self.scopes)]
+        # the regex analysis still knows names the tree can't see (macros)
+        return ChainMap(*maps, self.local_types, self.file_types)
+
+    # -- the walk ------------------------------------------------------------
+    def rewrite(self, node) -> List[_Piece]:
+        handler = self.handlers.get(node.type)
+        if handler is not None:
+            pieces = handler(node)
+            if pieces is not None:
+                return pieces
+        return self.splice(node)
+
+    def splice(self, node) -> List[_Piece]:
+        if not node.children:
+            return [self.text(node.start_byte, node.end_byte)]
+        scoped = node.type in _SCOPE_TYPES
+        if scoped:
+            self.scopes.append({})
+        pieces: List[_Piece] = []
+        pos = node.start_byte
+        for child in node.children:
+            if child.start_byte > pos:
+                pieces.append(self.text(pos, child.start_byte))
+            pieces.extend(self.rewrite(child))
+            pos = child.end_byte
+        if node.end_byte > pos:
+            pieces.append(self.text(pos, node.end_byte))
+        if scoped:
+            self.scopes.pop()
+        return pieces
+
+    def top_level(self, node) -> List[_Piece]:
+        """A file-scope node, reused from the session when it can be."""
+        if node.type not in _MEMO_TYPES:
+            return self.rewrite(node)
+        key = self.src[node.start_byte:node.end_byte]
+        memo = self.session.memo_get(key)
+        if memo is not None:
+            # stats count the rewrites done by this call, so none for these
+            pieces, notes = memo
+            for name, kind in notes:
+                self.session.global_kinds[name] = kind
+            return pieces
+        self.global_notes = []
+        pieces = self.function(node)
+        self.session.memo_put(key, (pieces, self.global_notes))
+        return pieces
+
+    def function(self, node) -> List[_Piece]:
+        # parameters live in the scope of the body
+        self.scopes.append({})
+        self.local_types = _infer_decl_types(self.text(node.start_byte, node.end_byte), self.ctx.typedefs)
+        try:
+            return self.splice(node)
+        finally:
+            self.scopes.pop()
+            self.local_types = {}
+
+    # -- declarations ----------------------------------------------------------
+    def _declarator_name(self, node) -> Tuple[Optional[str], int]:
+        """(name, pointer depth) of a declarator; arrays count as pointers."""
+        stars = 0
+        while node is not None:
+            t = node.type
+            if t == "identifier":
+                return self.text(node.start_byte, node.end_byte), stars
+            if t in ("pointer_declarator", "array_declarator"):
+                stars += 1
+            elif t == "function_declarator":
+                return None, 0
+            if t == "parenthesized_declarator":
+                node = node.named_children[0] if node.named_children else None
+            else:
+                node = node.child_by_field_name("declarator")
+        return None, 0
+
+    def declaration(self, node) -> Optional[List[_Piece]]:
+        type_node = node.child_by_field_name("type")
+        if type_node is not None:
+            if type_node.type == "struct_specifier" and type_node.child_by_field_name("name") is not None:
+                name = type_node.child_by_field_name("name")
+                base = "struct " + self.text(name.start_byte, name.end_byte)
+            else:
+                base = " ".join(self.text(type_node.start_byte, type_node.end_byte).split())
+            base = self.ctx.typedefs.get(base, base)
+            for decl in node.children_by_field_name("declarator"):
+                name, stars = self._declarator_name(decl)
+                if name:
+                    self.scopes[-1][name] = _Symbol(name, base + "*" * stars)
+        if node.type == "declaration" and self._calls(node, _ALLOC_CALLS):
+            return self.allocation(node)
+        return None
+
+    # -- statements ------------------------------------------------------------
+    def _call_name(self, node) -> Optional[bytes]:
+        if node.type != "call_expression":
+            return None
+        fn = node.child_by_field_name("function")
+        if fn is None or fn.type != "identifier":
+            return None
+        return self.src[fn.start_byte:fn.end_byte]
+
+    def _calls(self, node, names: Tuple[bytes, ...]) -> bool:
+        stack = [node]
+        while stack:
+            n = stack.pop()
+            if self._call_name(n) in names:
+                return True
+            stack.extend(n.children)
+        return False
+
+    def statement(self, node) -> Optional[List[_Piece]]:
+        expr = node.named_children[0] if node.named_children else None
+        name = self._call_name(expr) if expr is not None else None
+        if name in (b"printf", b"scanf"):
+            return self.io(node, expr, name.decode("ascii"))
+        if name == b"free":
+            return self.free(node)
+        if name == b"fflush" and "fflush-stdout" not in self.disabled:
+            text = _join(self.splice(node))
+            new = _fflush_stdout(self.ctx) if _FFLUSH_STDOUT.fullmatch(text) else None
+            if new:
+                self.hit("fflush-stdout")
+                return [new]
+            return [text]
+        if self._calls(node, _ALLOC_CALLS):
+            return self.allocation(node)
+        return None
+
+    def io(self, node, call, word: str) -> Optional[List[_Piece]]:
+        if ("printf-to-cout" if word == "printf" else "scanf-to-cin") in self.disabled:
+            return None
+        args = call.child_by_field_name("arguments")
+        # the statement may carry more than `call;` (a comment before the ';')
+        if args is None or self.src[node.end_byte - 1:node.end_byte] != b";" \
+                or self.src[call.end_byte:node.end_byte].strip() != b";":
+            return None
+        arg_pieces = self.rewrite(args)
+        stmt = f"{word}{_join(arg_pieces)};"
+        ctx = _StatementContext(self.ctx, self.types())
+        if word == "printf":
+            window = self.src[node.end_byte:node.end_byte + 256].decode("utf-8", "ignore")
+            new = _printf_statement(stmt, ctx, bool(_read_after.match(window)))
+        else:
+            new = _scanf_statement(stmt, ctx)
+        if new == stmt:
+            return [self.text(node.start_byte, args.start_byte), *arg_pieces,
+                    self.text(args.end_byte, node.end_byte)]
+        self.hit("printf-to-cout" if word == "printf" else "scanf-to-cin")
+        return [new]
+
+    def allocation(self, node) -> List[_Piece]:
+        """malloc/calloc statements go through the memory-stage rules."""
+        text = _join(self.splice(node))
+        notes: List[Tuple[str, str]] = []
+        ctx = _StatementContext(self.ctx, self.types(), lambda name, kind: notes.append((name, kind)))
+        new = _run_rules(text, "cpp", ctx, stage="memory")
+        for name, kind in notes:
+            self.ctx.note_alloc(name, kind)
+            sym = self.lookup(name)
+            if sym is not None and sym is not self.scopes[0].get(name):
+                sym.kind = kind
+            else:
+                # a file-scope name: other functions may free it
+                self.session.global_kinds[name] = kind
+                self.global_notes.append((name, kind))
+        return [new]
+
+    def free(self, node) -> Optional[List[_Piece]]:
+        if "free-to-delete" in self.disabled:
+            return None
+        m = _FREE.fullmatch(self.text(node.start_byte, node.end_byte))
+        if not m:
+            return None
+        name = m.group("name")
+        sym = self.lookup(name)
+        local = sym if sym is not None and sym is not self.scopes[0].get(name) else None
+        session = self.session
+
+        def resolve() -> str:
+            # runs at join time, possibly in a later call of the session
+            kind = local.kind if local is not None else session.global_kinds.get(name, session.allocs.get(name))
+            return f"delete[] {name};" if kind == "array" else f"delete {name};"
+
+        self.hit("free-to-delete")
+        return [resolve]
+
+    # -- leaves ----------------------------------------------------------------
+    def verbatim(self, node) -> List[_Piece]:
+        return [self.text(node.start_byte, node.end_byte)]
+
+    def null(self, node) -> Optional[List[_Piece]]:
+        if "null-to-nullptr" in self.disabled or self.src[node.start_byte:node.end_byte] != b"NULL":
+            return None
+        self.hit("null-to-nullptr")
+        return ["nullptr"]
+
+    def struct(self, node) -> Optional[List[_Piece]]:
+        name = node.child_by_field_name("name")
+        if node.child_by_field_name("body") is not None or name is None or "struct-ptr" in self.disabled:
+            return None
+        # only `struct X *`, as the struct-ptr rule of the other engines
+        if not _STAR_AFTER.match(self.src, node.end_byte):
+            return None
+        self.hit("struct-ptr")
+        return [self.text(name.start_byte, name.end_byte)]
+
+    def include(self, node) -> Optional[List[_Piece]]:
+        text = self.text(node.start_byte, node.end_byte)
+        body = text.rstrip()
+        if "include-stdio" in self.disabled or not _INCLUDE_STDIO.fullmatch(body.strip()):
+            return [text]
+        self.hit("include-stdio")
+        lead = text[:len(text) - len(text.lstrip())]
+        return [lead + _stdio_include(self.ctx) + text[len(body):]]
+
+    def define(self, node) -> Optional[List[_Piece]]:
+        value = node.child_by_field_name("value")
+        if value is None:
+            return [self.text(node.start_byte, node.end_byte)]
+        # a macro body is unparsed text; give it the token engine's rewrites
+        from .tokens import _Walker, _join as _join_tokens
+        walker = _Walker(self.text(value.start_byte, value.end_byte), self.ctx, self.disabled)
+        walker.walk()
+        for _, rule in walker.hits:
+            self.hit(rule)
+        head = self.text(node.start_byte, value.start_byte)
+        tail = self.text(value.end_byte, node.end_byte)
+        return [lambda: head + _join_tokens(walker.out) + tail]
+
+
+class TreeSitterSession:
+    """Converts successive versions of one file, reparsing incrementally.
+
+    A function whose text and file-scope context (every other top-level
+    declaration, the typedefs, the options) are unchanged since the last
+    call keeps its converted output; only edited functions are rewritten.
+    """
+
+    def __init__(self, options: Optional[ConvertOptions] = None) -> None:
+        self.options = options or ConvertOptions()
+        self.parser = _parser()
+        self.tree = None
+        self.src = b""
+        # function text -> (output pieces, allocations of file-scope names)
+        self._memo: Dict[bytes, Tuple[List[_Piece], List[Tuple[str, str]]]] = {}
+        self._next: Dict[bytes, Tuple[List[_Piece], List[Tuple[str, str]]]] = {}
+        self._context = ""
+        self.global_kinds: Dict[str, str] = {}
+        self.allocs: Dict[str, str] = {}
+
+    def memo_get(self, key: bytes):
+        entry = self._memo.get(key)
+        if entry is not None:
+            self._next[key] = entry
+        return entry
+
+    def memo_put(self, key: bytes, entry) -> None:
+        self._next[key] = entry
+
+    def _parse(self, src: bytes):
+        old = self.tree
+        if old is not None:
+            a, b = self.src, src
+            start = 0
+            limit = min(len(a), len(b))
+            while start < limit and a[start] == b[start]:
+                start += 1
+            end_a, end_b = len(a), len(b)
+            while end_a > start and end_b > start and a[end_a - 1] == b[end_b - 1]:
+                end_a -= 1
+                end_b -= 1
+            old.edit(
+                start_byte=start, old_end_byte=end_a, new_end_byte=end_b,
+                start_point=_point(a, start), old_end_point=_point(a, end_a), new_end_point=_point(b, end_b),
+            )
+            tree = self.parser.parse(src, old)
+        else:
+            tree = self.parser.parse(src)
+        self.tree, self.src = tree, src
+        return tree
+
+    def convert(self, code: str, ctx: Optional[_ConversionContext] = None) -> str:
+        ctx = ctx or _ConversionContext(code, self.options)
+        stats = ctx.stats
+        # the ownership stage rewrites whole declarations before the parse,
+        # as in the token engine (a no-op unless enabled)
+        code = _run_rules(code, "cpp", ctx, stage="ownership")
+        t0 = time.perf_counter()
+        src = code.encode("utf-8")
+        root = self._parse(src).root_node
+        t1 = time.perf_counter()
+
+        # output of a memoized function depends on everything at file scope;
+        # its types follow from the text hashed here, and a function's
+        # locals are its own (its text is the memo key)
+        h = hashlib.sha256(repr((ctx.options, sorted(ctx.typedefs.items()), sorted(ctx.realloc_names))).encode("utf-8"))
+        file_scope = []
+        for child in root.children:
+            if child.type not in _MEMO_TYPES:
+                file_scope.append(src[child.start_byte:child.end_byte])
+                h.update(file_scope[-1] + b"\0")
+        context = h.hexdigest()
+        if context != self._context:
+            self._memo = {}
+            self._context = context
+        self._next = {}
+        self.global_kinds = {}
+        self.allocs = ctx.allocs
+
+        rw = _Rewriter(src, ctx, self, _infer_decl_types(b"\n".join(file_scope).decode("utf-8"), ctx.typedefs))
+        pieces: List[_Piece] = []
+        pos = 0
+        for child in root.children:
+            if child.start_byte > pos:
+                pieces.append(rw.text(pos, child.start_byte))
+            pieces.extend(rw.top_level(child))
+            pos = child.end_byte
+        if len(src) > pos:
+            pieces.append(rw.text(pos, len(src)))
+        out = _join(pieces)
+        # entries for functions that are gone are dropped
+        self._memo = self._next
+        if stats is not None:
+            stats.add_pass("tree-sitter-parse", t1 - t0)
+            stats.add_pass("tree-sitter-walk", time.perf_counter() - t1)
+            for rule, n in rw.hits.items():
+                stats.count(rule, n)
+        return _run_rules(out, "cpp", ctx, stage="finish")
+
+
+def convert_c_to_cpp_treesitter(code: str, ctx: Optional[_ConversionContext] = None) -> str:
+    ctx = ctx or _ConversionContext(code)
+    try:
+        return TreeSitterSession(ctx.options).convert(code, ctx)
+    except RecursionError:
+        # nesting deeper than the recursive rewrite can follow
+        from .tokens import convert_c_to_cpp_tokens
+        return convert_c_to_cpp_tokens(code, _ConversionContext(code, ctx.options))
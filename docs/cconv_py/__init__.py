@@ -1,2 +0,0 @@
-__all__ = ["convert_c_to_cpp", "convert_cpp_to_c"]
-from .converter import convert_c_to_cpp, convert_cpp_to_c
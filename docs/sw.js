@@ -0,0 +1,61 @@
+// Service worker: keeps Pyodide and the converter in Cache Storage so repeat
+// visits start without touching the network.
+//
+// Pyodide's URLs are versioned and the converter wheel's URL carries its
+// content hash (`?v=`, see build.json), so both are served cache first. The
+// page, the worker and build.json are served from the cache too but refreshed
+// in the background, so a new deploy shows up on the next visit. Bump CACHE
+// when the precache list changes.
+const CACHE = 'cconv-v2';
+const PYODIDE_URL = 'https://cdn.jsdelivr.net/pyodide/v0.25.1/full/';
+const PRECACHE = [
+  './',
+  'index.html',
+  'worker.js',
+  'build.json',
+  PYODIDE_URL + 'pyodide.js',
+  PYODIDE_URL + 'pyodide.asm.js',
+  PYODIDE_URL + 'pyodide.asm.wasm',
+  PYODIDE_URL + 'python_stdlib.zip',
+  PYODIDE_URL + 'pyodide-lock.json',
+];
+
+self.addEventListener('install', (ev) => {
+  ev.waitUntil(caches.open(CACHE).then(c => c.addAll(PRECACHE)).then(() => self.skipWaiting()));
+});
+
+self.addEventListener('activate', (ev) => {
+  ev.waitUntil((async () => {
+    for (const key of await caches.keys()) {
+      if (key !== CACHE) await caches.delete(key);
+    }
+    await self.clients.claim();
+  })());
+});
+
+self.addEventListener('fetch', (ev) => {
+  const req = ev.request;
+  if (req.method !== 'GET') return;
+  const url = new URL(req.url);
+  if (req.url.startsWith(PYODIDE_URL) || (url.origin === self.location.origin && url.searchParams.has('v'))) {
+    ev.respondWith(caches.match(req).then(hit => hit || fetchAndStore(req)));
+  } else if (url.origin === self.location.origin) {
+    ev.respondWith(caches.match(req).then(hit => {
+      const fresh = fetchAndStore(req);
+      if (hit) {
+        ev.waitUntil(fresh.catch(() => {}));
+        return hit;
+      }
+      return fresh;
+    }));
+  }
+});
+
+async function fetchAndStore(req) {
+  const resp = await fetch(req);
+  if (resp.ok) {
+    const copy = resp.clone();
+    caches.open(CACHE).then(c => c.put(req, copy));
+  }
+  return resp;
+}
@@ -0,0 +1,60 @@
+// Web Worker that owns Pyodide and the converter, so the page never blocks.
+//
+// Messages in:  {type: 'convert', id, code, direction, engine}
+//               {type: 'interrupt-buffer', buffer}   (SharedArrayBuffer, optional)
+// Messages out: {type: 'status', text}
+//               {type: 'ready', ms}
+//               {type: 'result', id, out, ms} | {type: 'error', id, error}
+//               {type: 'cancelled', id}
+const PYODIDE_URL = 'https://cdn.jsdelivr.net/pyodide/v0.25.1/full/';
+// the converter wheel; tools/build_pages.py writes it and build.json
+const SITE_PACKAGES = '/home/pyodide/cconv-wheel';
+
+importScripts(PYODIDE_URL + 'pyodide.js');
+
+let convert = null;
+
+const ready = (async () => {
+  const t0 = performance.now();
+  postMessage({ type: 'status', text: 'Loading Python runtime…' });
+  const pyodide = await loadPyodide({ indexURL: PYODIDE_URL });
+  postMessage({ type: 'status', text: 'Loading converter…' });
+  const build = await fetch('build.json').then(r => r.json());
+  const wheel = await fetch(build.wheel).then(r => r.arrayBuffer());
+  // a pure-Python wheel is a zip of the package; put it on sys.path as is
+  pyodide.unpackArchive(wheel, 'zip', { extractDir: SITE_PACKAGES });
+  pyodide.runPython(`
+import sys
+sys.path.insert(0, '${SITE_PACKAGES}')
+from cconv import ConvertOptions, convert as _convert
+
+def _cconv(code, direction, engine):
+    target = "cpp" if direction == "c2cpp" else "c"
+    return _convert(code, target, ConvertOptions(engine=engine or "regex"))
+`);
+  convert = pyodide.globals.get('_cconv');
+  postMessage({ type: 'ready', ms: performance.now() - t0 });
+  return pyodide;
+})();
+
+self.onmessage = async (ev) => {
+  const msg = ev.data;
+  const pyodide = await ready;
+  if (msg.type === 'interrupt-buffer') {
+    // with cross-origin isolation the page can stop a running conversion
+    pyodide.setInterruptBuffer(new Int32Array(msg.buffer));
+    return;
+  }
+  if (msg.type !== 'convert') return;
+  const t0 = performance.now();
+  try {
+    const out = convert(msg.code, msg.direction, msg.engine);
+    postMessage({ type: 'result', id: msg.id, out, ms: performance.now() - t0 });
+  } catch (e) {
+    if (String(e).includes('KeyboardInterrupt')) {
+      postMessage({ type: 'cancelled', id: msg.id });
+    } else {
+      postMessage({ type: 'error', id: msg.id, error: String(e) });
+    }
+  }
+};
@@ -0,0 +1,152 @@
+#include <iostream>
+#include <stdexcept>
+
+// Doubly linked deque, generic over the element type
+
+template <typename T>
+class Deque {
+    struct Node {
+        T data;
+        Node* prev;
+        Node* next;
+        Node(const T& value) : data(value), prev(nullptr), next(nullptr) {}
+    };
+
+    Node* front;
+    Node* rear;
+    int size;
+
+public:
+    Deque() : front(nullptr), rear(nullptr), size(0) {}
+
+    ~Deque() {
+        while (!is_empty()) {
+            pop_front();
+        }
+    }
+
+    // Check if empty
+    bool is_empty() const {
+        return size == 0;
+    }
+
+    // Push to front
+    void push_front(const T& value) {
+        Node* new_node = new Node(value);
+        new_node->next = front;
+        if (is_empty()) {
+            front = rear = new_node;
+        } else {
+            front->prev = new_node;
+            front = new_node;
+        }
+        size++;
+    }
+
+    // Push to back
+    void push_back(const T& value) {
+        Node* new_node = new Node(value);
+        new_node->prev = rear;
+        if (is_empty()) {
+            front = rear = new_node;
+        } else {
+            rear->next = new_node;
+            rear = new_node;
+        }
+        size++;
+    }
+
+    // Pop from front; throws if empty
+    void pop_front() {
+        if (is_empty()) {
+            throw std::out_of_range("Deque is empty");
+        }
+        Node* temp = front;
+        front = front->next;
+        if (front == nullptr) {
+            rear = nullptr;
+        } else {
+            front->prev = nullptr;
+        }
+        delete temp;
+        size--;
+    }
+
+    // Pop from back; throws if empty
+    void pop_back() {
+        if (is_empty()) {
+            throw std::out_of_range("Deque is empty");
+        }
+        Node* temp = rear;
+        rear = rear->prev;
+        if (rear == nullptr) {
+            front = nullptr;
+        } else {
+            rear->next = nullptr;
+        }
+        delete temp;
+        size--;
+    }
+
+    // Get front value; throws if empty
+    T get_front() const {
+        if (is_empty()) {
+            throw std::out_of_range("Deque is empty");
+        }
+        return front->data;
+    }
+
+    // Get rear value; throws if empty
+    T get_rear() const {
+        if (is_empty()) {
+            throw std::out_of_range("Deque is empty");
+        }
+        return rear->data;
+    }
+
+    // Get size
+    int get_size() const {
+        return size;
+    }
+
+    // Display elements
+    void display() const {
+        Node* cur = front;
+        while (cur != nullptr) {
+            std::cout << cur->data << " ";
+            cur = cur->next;
+        }
+        std::cout << std::endl;
+    }
+};
+
+int main() {
+    Deque<int> dq;
+
+    // Push elements to the front and back
+    dq.push_front(10);
+    dq.push_back(20);
+    dq.push_front(5);
+    dq.push_back(30);
+
+    // Display the Deque after pushes
+    std::cout << "Deque after pushes: ";
+    dq.display();
+
+    // Get and display the front and rear elements
+    std::cout << "Front element: " << dq.get_front() << std::endl;
+    std::cout << "Rear element: " << dq.get_rear() << std::endl;
+
+    // Pop elements from the front and back
+    dq.pop_front();
+    dq.pop_back();
+
+    // Display the Deque after pops
+    std::cout << "Deque after pops: ";
+    dq.display();
+
+    // Display the size of the Deque
+    std::cout << "Size of deque: " << dq.get_size() << std::endl;
+
+    return 0;
+}
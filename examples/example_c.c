@@ -16,6 +16,7 @@ int main() {
         printf("%d ", arr[i]);
     }
     printf("\n");
+    printf("Filled: 100%% of %d\n", n);
 
     free(arr);
     return 0;
@@ -0,0 +1,75 @@
+#include <iostream>
+
+// Array-backed stack, generic over the element type
+
+template <typename T>
+class Stack {
+    T* data;
+    int capacity;
+    int count;
+
+public:
+    Stack() : capacity(4), count(0) {
+        data = new T[capacity];
+    }
+
+    ~Stack() {
+        delete[] data;
+    }
+
+    bool is_empty() const {
+        return count == 0;
+    }
+
+    int size() const {
+        return count;
+    }
+
+    // Push, doubling the array when it is full
+    void push(const T& value) {
+        if (count == capacity) {
+            T* bigger = new T[capacity * 2];
+            for (int i = 0; i < count; i++) {
+                bigger[i] = data[i];
+            }
+            delete[] data;
+            data = bigger;
+            capacity *= 2;
+        }
+        data[count] = value;
+        count++;
+    }
+
+    // Pop the top element; the caller checks is_empty() first
+    T pop() {
+        count--;
+        return data[count];
+    }
+
+    T top() const {
+        return data[count - 1];
+    }
+};
+
+template <typename T>
+T maxOf(T a, T b) {
+    return a > b ? a : b;
+}
+
+int main() {
+    Stack<int> si;
+    Stack<double> sd;
+    for (int i = 1; i <= 10; i++) {
+        si.push(i * i);
+        sd.push(i / 4.0);
+    }
+    std::cout << "Top: " << si.top() << " " << sd.top() << std::endl;
+    std::cout << "Max: " << maxOf(si.pop(), 5) << std::endl;
+    std::cout << "Max: " << maxOf(2.5, sd.pop()) << std::endl;
+    while (!si.is_empty()) {
+        std::cout << si.pop() << " ";
+    }
+    std::cout << std::endl;
+    std::cout << "Size: " << si.size() << " " << sd.size() << std::endl;
+    return 0;
+}
@@ -0,0 +1,107 @@
+"""Build the GitHub Pages bundle: a minified pure-Python wheel of cconv/.
+
+    python tools/build_pages.py          # writes into docs/
+    python tools/build_pages.py --out site/
+
+The wheel is made from the package itself, so the browser runs exactly the
+converter the CLI and the web app run, token engine included. Docstrings go,
+and comments are lost on the way through `ast`. `build.json` names the wheel
+with a content hash in its URL, so the service worker may cache it forever.
+Needs Python 3.9+ (`ast.unparse`); the package itself stays 3.8-compatible.
+"""
+from __future__ import annotations
+
+import argparse
+import ast
+import base64
+import hashlib
+import json
+import os
+import sys
+import zipfile
+from typing import List, Tuple
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+if ROOT not in sys.path:
+    sys.path.insert(0, ROOT)
+
+from cconv import __version__  # noqa: E402
+
+PACKAGE = "cconv"
+
+
+def minify(source: str) -> str:
+    """`source` without docstrings or comments; the code is unchanged."""
+    tree = ast.parse(source)
+    for node in ast.walk(tree):
+        if isinstance(node, (ast.Module, ast.ClassDef, ast.FunctionDef, ast.AsyncFunctionDef)):
+            body = node.body
+            if body and isinstance(body[0], ast.Expr) and isinstance(body[0].value, ast.Constant) \
+                    and isinstance(body[0].value.value, str):
+                # a body can't be empty
+                body[0:1] = [] if len(body) > 1 else [ast.Pass()]
+    return ast.unparse(tree) + "\n"
+
+
+def _record_line(path: str, data: bytes) -> str:
+    digest = base64.urlsafe_b64encode(hashlib.sha256(data).digest()).rstrip(b"=").decode("ascii")
+    return f"{path},sha256={digest},{len(data)}"
+
+
+def build_wheel(out_dir: str) -> Tuple[str, bytes]:
+    """Write the wheel into `out_dir`; returns its file name and contents."""
+    pkg_dir = os.path.join(ROOT, PACKAGE)
+    files: List[Tuple[str, bytes]] = []
+    for fn in sorted(os.listdir(pkg_dir)):
+        if fn.endswith(".py"):
+            with open(os.path.join(pkg_dir, fn), "r", encoding="utf-8") as f:
+                files.append((f"{PACKAGE}/{fn}", minify(f.read()).encode("utf-8")))
+    dist_info = f"{PACKAGE}-{__version__}.dist-info"
+    files.append((f"{dist_info}/METADATA", (
+        "Metadata-Version: 2.1\n"
+        f"Name: {PACKAGE}\n"
+        f"Version: {__version__}\n"
+        "Summary: Heuristic C <-> C++ converter\n"
+        "Requires-Python: >=3.8\n"
+    ).encode("utf-8")))
+    files.append((f"{dist_info}/WHEEL", (
+        "Wheel-Version: 1.0\n"
+        "Generator: cconv build_pages\n"
+        "Root-Is-Purelib: true\n"
+        "Tag: py3-none-any\n"
+    ).encode("utf-8")))
+    record = "\n".join(_record_line(p, d) for p, d in files) + f"\n{dist_info}/RECORD,,\n"
+    files.append((f"{dist_info}/RECORD", record.encode("utf-8")))
+
+    name = f"{PACKAGE}-{__version__}-py3-none-any.whl"
+    path = os.path.join(out_dir, name)
+    with zipfile.ZipFile(path, "w", zipfile.ZIP_DEFLATED, compresslevel=9) as z:
+        for p, d in files:
+            # a fixed timestamp keeps the wheel, and so its hash, reproducible
+            info = zipfile.ZipInfo(p, date_time=(1980, 1, 1, 0, 0, 0))
+            info.compress_type = zipfile.ZIP_DEFLATED
+            z.writestr(info, d, compresslevel=9)
+    with open(path, "rb") as f:
+        return name, f.read()
+
+
+def main(argv=None) -> int:
+    p = argparse.ArgumentParser(description="Build the Pages bundle (a minified cconv wheel)")
+    p.add_argument("--out", default=os.path.join(ROOT, "docs"), help="Output directory (default docs/)")
+    args = p.parse_args(argv)
+    os.makedirs(args.out, exist_ok=True)
+    for fn in os.listdir(args.out):
+        if fn.startswith(f"{PACKAGE}-") and fn.endswith(".whl"):
+            os.remove(os.path.join(args.out, fn))
+    name, data = build_wheel(args.out)
+    digest = hashlib.sha256(data).hexdigest()
+    build = {"version": __version__, "wheel": f"{name}?v={digest[:16]}", "sha256": digest}
+    with open(os.path.join(args.out, "build.json"), "w", encoding="utf-8") as f:
+        json.dump(build, f, indent=2)
+        f.write("\n")
+    sys.stderr.write(f"{os.path.join(args.out, name)}: {len(data)} bytes\n")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
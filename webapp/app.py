@@ -1,8 +1,169 @@
-from flask import Flask, render_template, request, send_file, Response
+"""Flask front end: the HTML form at /, JSON at /api/convert, /healthz, /metrics.
+
+Run it under gunicorn in production (see gunicorn.conf.py); `python3
+webapp/app.py` starts the single-process development server.
+
+Limits come from the environment:
+- CCONV_MAX_REQUEST_BYTES  largest accepted request body (default 2 MiB)
+- CCONV_TIMEOUT            seconds one conversion may run (default 10)
+- CCONV_TIME_BUDGET        seconds after which a conversion gives up and answers with its
+                           input and a "warning" (default half of CCONV_TIMEOUT; 0 turns it off)
+- CCONV_CONVERTERS         conversion processes per web worker (default 2)
+- CCONV_MAX_BATCH_FILES    files in one /api/convert/batch request (default 1000)
+- CCONV_MAX_BATCH_BYTES    a gzip'd request body's size once inflated (default 32 MiB)
+- CCONV_CACHE_ENTRIES      results kept in each worker's LRU (default 4096; 0 turns caching off)
+- CCONV_CACHE_BYTES        characters of output the LRU may hold (default 64 MiB)
+- CCONV_REDIS_URL          share results through Redis as well (needs the redis package)
+- CCONV_CACHE_TTL          seconds a result stays in Redis (default 1 day)
+"""
+import gzip
+import hashlib
+import json
+import os
+import sys
+import zlib
+from concurrent.futures import ThreadPoolExecutor
+from flask import Flask, jsonify, render_template, request, send_file, Response
 from io import BytesIO
-from cconv import convert_c_to_cpp, convert_cpp_to_c
+from werkzeug.exceptions import HTTPException
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+if ROOT not in sys.path:
+    sys.path.insert(0, ROOT)
+
+from cconv import ConversionError, ConvertOptions  # noqa: E402
+from cconv.batch import target_for  # noqa: E402
+from cconv.cache import cache_key  # noqa: E402
+from cconv.converter import options_from_json as _options_from_json  # noqa: E402
+from webapp.cache import LRUCache, RedisCache, ResultCache  # noqa: E402
+from webapp.metrics import CONTENT_TYPE, Metrics  # noqa: E402
+from webapp.pool import ConversionCrashed, ConversionPool, ConversionTimeout  # noqa: E402
+
+MAX_REQUEST_BYTES = int(os.environ.get("CCONV_MAX_REQUEST_BYTES", 2 * 1024 * 1024))
+TIMEOUT = float(os.environ.get("CCONV_TIMEOUT", 10))
+TIME_BUDGET = float(os.environ.get("CCONV_TIME_BUDGET", TIMEOUT / 2)) or None
+CONVERTERS = int(os.environ.get("CCONV_CONVERTERS", 2))
+MAX_BATCH_FILES = int(os.environ.get("CCONV_MAX_BATCH_FILES", 1000))
+MAX_BATCH_BYTES = int(os.environ.get("CCONV_MAX_BATCH_BYTES", 32 * 1024 * 1024))
+CACHE_ENTRIES = int(os.environ.get("CCONV_CACHE_ENTRIES", 4096))
+CACHE_BYTES = int(os.environ.get("CCONV_CACHE_BYTES", 64 * 1024 * 1024))
+REDIS_URL = os.environ.get("CCONV_REDIS_URL")
+CACHE_TTL = int(os.environ.get("CCONV_CACHE_TTL", 24 * 3600))
+DEFAULT_OPTIONS = ConvertOptions()
+
+# form/API direction -> target language
+TARGETS = {"c2cpp": "cpp", "cpp2c": "c"}
 
 app = Flask(__name__)
+app.config["MAX_CONTENT_LENGTH"] = MAX_REQUEST_BYTES
+metrics = Metrics()
+pool = ConversionPool(CONVERTERS, TIMEOUT, TIME_BUDGET)
+cache = None
+if CACHE_ENTRIES > 0:
+    cache = ResultCache(LRUCache(CACHE_ENTRIES, CACHE_BYTES),
+                        RedisCache(REDIS_URL, CACHE_TTL) if REDIS_URL else None)
+# batch requests fan out over the conversion processes through these threads
+batch_threads = ThreadPoolExecutor(max_workers=CONVERTERS, thread_name_prefix="cconv-batch")
+
+
+def _key(code, target, options=None):
+    return cache_key(code, target, options or DEFAULT_OPTIONS)
+
+
+def _convert(code, target, options=None, key=None):
+    """(output, stats) of one conversion; stats is None when it came from the cache."""
+    if cache is not None:
+        key = key or _key(code, target, options)
+        out = cache.get(key)
+        metrics.cache_lookup(target, out is not None, len(cache))
+        if out is not None:
+            return out, None
+    try:
+        out, st = pool.convert(code, target, options)
+    except ConversionTimeout:
+        metrics.timed_out(target)
+        raise
+    metrics.observe(st)
+    if st.over_budget:
+        # the input passed through: a later request may find a less loaded worker
+        metrics.over_budget(target)
+    elif cache is not None:
+        cache.put(key, out)
+    return out, st
+
+
+def _over_budget_warning(st):
+    if st is not None and st.over_budget:
+        return f"conversion took longer than its {TIME_BUDGET:g}s time budget; the input is passed through unchanged"
+    return None
+
+
+def _not_modified(etag):
+    """A 304 if the client already has `etag`, else None."""
+    if request.if_none_match.contains(etag):
+        metrics.not_modified()
+        resp = Response(status=304)
+        resp.set_etag(etag)
+        return resp
+    return None
+
+
+def _parse_item(item, options=None):
+    """(code, target, options) of one API request object."""
+    if not isinstance(item, dict) or not isinstance(item.get("code"), str):
+        raise ValueError('expected a JSON object with a "code" string')
+    direction = item.get("direction")
+    if direction is None:
+        # a batch file's name tells its language; anything else is C
+        target = target_for(str(item.get("name", "")), None) or "cpp"
+    else:
+        target = TARGETS.get(direction)
+        if target is None:
+            raise ValueError("direction must be c2cpp or cpp2c")
+    if "options" in item:
+        options = _options_from_json(item["options"])
+    return item["code"], target, options
+
+
+def _request_json():
+    """The request body as JSON, inflating it first if it was sent gzip'd."""
+    data = request.get_data(cache=False)
+    if request.content_encoding == "gzip":
+        d = zlib.decompressobj(16 + zlib.MAX_WBITS)
+        try:
+            data = d.decompress(data, MAX_BATCH_BYTES)
+        except zlib.error:
+            raise ValueError("body is not valid gzip")
+        if d.unconsumed_tail:
+            raise ValueError(f"inflated body is larger than {MAX_BATCH_BYTES} bytes")
+    elif request.content_encoding not in (None, "identity"):
+        raise ValueError(f"unsupported Content-Encoding: {request.content_encoding}")
+    try:
+        return json.loads(data)
+    except (UnicodeDecodeError, json.JSONDecodeError):
+        raise ValueError("body is not valid JSON")
+
+
+def _accepts_gzip():
+    return "gzip" in request.headers.get("Accept-Encoding", "")
+
+
+def _cache_header(resp, st):
+    if cache is not None:
+        resp.headers["X-Cache"] = "MISS" if st is not None else "HIT"
+    return resp
+
+
+def _error(status, message):
+    return jsonify(error=message), status
+
+
+@app.errorhandler(HTTPException)
+def http_error(e):
+    # the API answers in JSON, the form keeps Flask's HTML pages
+    if request.path.startswith("/api/"):
+        return _error(e.code, e.description)
+    return e
 
 
 @app.route("/", methods=["GET", "POST"])
@@ -11,12 +172,11 @@ def index():
         code = request.form.get("code", "")
         direction = request.form.get("direction", "c2cpp")
         filename = request.form.get("filename", "converted")
-        if direction == "c2cpp":
-            out = convert_c_to_cpp(code)
-            ext = "cpp"
-        else:
-            out = convert_cpp_to_c(code)
-            ext = "c"
+        ext = "cpp" if direction == "c2cpp" else "c"
+        try:
+            out, _ = _convert(code, ext)
+        except (ConversionTimeout, ConversionCrashed, ConversionError) as e:
+            out = f"/* {e} */"
         if request.form.get("download"):
             bio = BytesIO(out.encode("utf-8"))
             bio.seek(0)
@@ -30,10 +190,148 @@ def index():
     return render_template("index.html", code="", out="", direction="c2cpp")
 
 
+@app.route("/api/convert", methods=["POST"])
+def api_convert():
+    """{"code": ..., "direction": "c2cpp"|"cpp2c", "options": {...}, "stats": bool}
+
+    The ETag is the cache key, so If-None-Match is answered without
+    converting. Responses with stats differ every time and get no ETag, as
+    do those over the time budget, whose "output" is the input and which
+    carry a "warning".
+    """
+    try:
+        body = _request_json()
+        code, target, options = _parse_item({"direction": "c2cpp", **body} if isinstance(body, dict) else body)
+    except ValueError as e:
+        return _error(400, str(e))
+    want_stats = bool(body.get("stats"))
+    key = _key(code, target, options)
+    if not want_stats:
+        resp = _not_modified(key)
+        if resp is not None:
+            return resp
+    try:
+        out, st = _convert(code, target, options, key)
+    except ConversionTimeout as e:
+        return _error(504, str(e))
+    except ConversionCrashed as e:
+        return _error(503, str(e))
+    except ConversionError as e:
+        return _error(422, str(e))
+    result = {"output": out, "target": target}
+    warning = _over_budget_warning(st)
+    if warning:
+        result["warning"] = warning
+    if want_stats:
+        # a cached result has no stats of its own
+        result["stats"] = st.to_dict() if st is not None else None
+    resp = jsonify(result)
+    if not want_stats and not warning:
+        resp.set_etag(key)
+    return _cache_header(resp, st)
+
+
+def _convert_one(parsed):
+    """One batch entry: a result object, or an error object with its status."""
+    name, item, key = parsed
+    if isinstance(item, ValueError):
+        return {"name": name, "error": str(item), "status": 400}
+    code, target, options = item
+    try:
+        out, st = _convert(code, target, options, key)
+    except ConversionTimeout as e:
+        return {"name": name, "error": str(e), "status": 504}
+    except ConversionCrashed as e:
+        return {"name": name, "error": str(e), "status": 503}
+    except ConversionError as e:
+        return {"name": name, "error": str(e), "status": 422}
+    except RuntimeError as e:
+        return {"name": name, "error": str(e), "status": 500}
+    result = {"name": name, "target": target, "output": out}
+    warning = _over_budget_warning(st)
+    if warning:
+        result["warning"] = warning
+    return result
+
+
+@app.route("/api/convert/batch", methods=["POST"])
+def api_convert_batch():
+    """A list of {"name", "code", "direction"?, "options"?}, or {"files": [...], "options": {...}}.
+
+    Files are converted concurrently and answered in request order, as
+    {"results": [...]} or, with `?stream=1` or `Accept: application/x-ndjson`,
+    one JSON line per file as soon as it and the files before it are done.
+    A file that fails gets {"name", "error", "status"} without failing the
+    batch. Bodies may be sent and received gzip'd.
+    """
+    try:
+        body = _request_json()
+        options = None
+        if isinstance(body, dict):
+            options = _options_from_json(body.get("options"))
+            body = body.get("files")
+        if not isinstance(body, list):
+            raise ValueError("expected a list of files")
+    except ValueError as e:
+        return _error(400, str(e))
+    if len(body) > MAX_BATCH_FILES:
+        return _error(413, f"more than {MAX_BATCH_FILES} files in one batch")
+    parsed = []
+    # the batch's ETag covers every file's cache key and how it is encoded
+    gz = _accepts_gzip()
+    stream = bool(request.args.get("stream") or "application/x-ndjson" in request.headers.get("Accept", ""))
+    h = hashlib.sha256(f"{stream}\0{gz}\0".encode("utf-8"))
+    for i, item in enumerate(body):
+        name = item.get("name", str(i)) if isinstance(item, dict) else str(i)
+        try:
+            item = _parse_item(item, options)
+            key = _key(*item)
+        except ValueError as e:
+            item, key = e, str(e)
+        parsed.append((name, item, key))
+        h.update(f"{name}\0{key}\0".encode("utf-8"))
+    etag = h.hexdigest()
+    resp = _not_modified(etag)
+    if resp is not None:
+        return resp
+
+    # map() submits every file now and yields the results in order
+    results = batch_threads.map(_convert_one, parsed)
+    if stream:
+        def lines():
+            z = zlib.compressobj(6, zlib.DEFLATED, 16 + zlib.MAX_WBITS) if gz else None
+            for r in results:
+                line = (json.dumps(r) + "\n").encode("utf-8")
+                # a sync flush hands each line to the client right away
+                yield z.compress(line) + z.flush(zlib.Z_SYNC_FLUSH) if z else line
+            if z:
+                yield z.flush()
+        resp = Response(lines(), status=200, mimetype="application/x-ndjson")
+    else:
+        results = list(results)
+        data = json.dumps({"results": results}).encode("utf-8")
+        resp = Response(gzip.compress(data) if gz else data, status=200, mimetype="application/json")
+        if any("warning" in r for r in results):
+            # a file passed through over the budget: not the batch's conversion
+            etag = None
+    if gz:
+        resp.headers["Content-Encoding"] = "gzip"
+    resp.headers["Vary"] = "Accept-Encoding"
+    if etag:
+        resp.set_etag(etag)
+    return resp
+
+
 @app.route("/healthz")
 def healthz():
     return Response("ok", status=200)
 
 
+@app.route("/metrics")
+def prometheus_metrics():
+    return Response(metrics.render(), status=200, content_type=CONTENT_TYPE)
+
+
 if __name__ == "__main__":
-    app.run(host="0.0.0.0", port=8000, debug=True)
+    # development server only; the debugger is opt-in
+    app.run(host="0.0.0.0", port=8000, debug=os.environ.get("FLASK_DEBUG") == "1")
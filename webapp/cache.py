@@ -0,0 +1,92 @@
+"""Result cache of the web app: an in-process LRU, optionally backed by Redis.
+
+Keys are `cconv.cache.cache_key(code, target, options)`, so they cover the
+converter version and every option. With Redis configured, the LRU sits in
+front of it and a Redis hit fills the LRU; workers and restarts then share
+results. A Redis that can't be reached is treated as a miss.
+"""
+from __future__ import annotations
+
+import threading
+from collections import OrderedDict
+from typing import Optional
+
+
+class LRUCache:
+    """At most `entries` outputs and `max_bytes` characters, least recently used out first."""
+
+    def __init__(self, entries: int, max_bytes: int) -> None:
+        self.entries = entries
+        self.max_bytes = max_bytes
+        self._data: "OrderedDict[str, str]" = OrderedDict()
+        self._size = 0
+        self._lock = threading.Lock()
+
+    def __len__(self) -> int:
+        return len(self._data)
+
+    def get(self, key: str) -> Optional[str]:
+        with self._lock:
+            out = self._data.get(key)
+            if out is not None:
+                self._data.move_to_end(key)
+            return out
+
+    def put(self, key: str, out: str) -> None:
+        if len(out) > self.max_bytes:
+            return
+        with self._lock:
+            old = self._data.pop(key, None)
+            if old is not None:
+                self._size -= len(old)
+            self._data[key] = out
+            self._size += len(out)
+            while len(self._data) > self.entries or self._size > self.max_bytes:
+                _, dropped = self._data.popitem(last=False)
+                self._size -= len(dropped)
+
+
+class RedisCache:
+    """Outputs in Redis under `cconv:<key>`, expiring after `ttl` seconds."""
+
+    def __init__(self, url: str, ttl: int) -> None:
+        import redis  # optional dependency, only needed with CCONV_REDIS_URL
+        self._redis = redis.Redis.from_url(url, socket_timeout=0.5)
+        self._errors = (redis.RedisError,)
+        self.ttl = ttl
+
+    def get(self, key: str) -> Optional[str]:
+        try:
+            out = self._redis.get("cconv:" + key)
+        except self._errors:
+            return None
+        return None if out is None else out.decode("utf-8")
+
+    def put(self, key: str, out: str) -> None:
+        try:
+            self._redis.set("cconv:" + key, out.encode("utf-8"), ex=self.ttl)
+        except self._errors:
+            # a cache that can't be written is just a slower request
+            pass
+
+
+class ResultCache:
+    def __init__(self, lru: LRUCache, shared: Optional[RedisCache] = None) -> None:
+        self.lru = lru
+        self.shared = shared
+
+    def __len__(self) -> int:
+        return len(self.lru)
+
+    def get(self, key: str) -> Optional[str]:
+        out = self.lru.get(key)
+        if out is None and self.shared is not None:
+            out = self.shared.get(key)
+            if out is not None:
+                self.lru.put(key, out)
+        return out
+
+    def put(self, key: str, out: str) -> None:
+        self.lru.put(key, out)
+        if self.shared is not None:
+            self.shared.put(key, out)
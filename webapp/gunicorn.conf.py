@@ -0,0 +1,60 @@
+"""gunicorn settings for the web app.
+
+    gunicorn -c webapp/gunicorn.conf.py webapp.wsgi:app
+
+The app (and with it `cconv.converter` and its compiled rule table) is
+loaded once in the master and forked into preforked threaded workers. Each
+worker then starts its conversion processes (see webapp/pool.py), which
+enforce the per-conversion timeout. Override any setting here with
+GUNICORN_CMD_ARGS, e.g. GUNICORN_CMD_ARGS="--workers 8".
+"""
+import glob
+import multiprocessing
+import os
+import tempfile
+
+# /metrics sums the workers' counters through files in this directory
+# (prometheus_client's multiprocess mode); it has to be set before the app,
+# and with it prometheus_client, is loaded
+if not os.environ.get("PROMETHEUS_MULTIPROC_DIR"):
+    os.environ["PROMETHEUS_MULTIPROC_DIR"] = tempfile.mkdtemp(prefix="cconv-metrics-")
+
+bind = os.environ.get("CCONV_BIND", "0.0.0.0:8000")
+workers = int(os.environ.get("WEB_CONCURRENCY", multiprocessing.cpu_count() * 2 + 1))
+# threads keep persistent connections; sync workers would ignore keepalive
+worker_class = "gthread"
+threads = int(os.environ.get("CCONV_THREADS", 4))
+keepalive = 5
+preload_app = True
+
+# a worker silent this long is killed; must exceed CCONV_TIMEOUT
+timeout = int(float(os.environ.get("CCONV_TIMEOUT", 10))) + 20
+graceful_timeout = 30
+# recycle workers now and then so a leak can't grow without bound
+max_requests = 2000
+max_requests_jitter = 200
+
+limit_request_line = 8190
+limit_request_fields = 100
+limit_request_field_size = 8190
+
+accesslog = "-"
+errorlog = "-"
+
+
+def post_fork(server, worker):
+    # fork the conversion processes while the worker is still single-threaded
+    from webapp.app import pool
+    pool.start()
+
+
+def on_starting(server):
+    # counts left from an earlier run would be added to this one's
+    for path in glob.glob(os.path.join(os.environ["PROMETHEUS_MULTIPROC_DIR"], "*.db")):
+        os.remove(path)
+
+
+def child_exit(server, worker):
+    # drop the live gauges of a worker that exited; its counters stay counted
+    from prometheus_client import multiprocess
+    multiprocess.mark_process_dead(worker.pid)
@@ -0,0 +1,113 @@
+"""Conversion metrics in the Prometheus text format, served at /metrics.
+
+gunicorn runs several worker processes behind one address, and a scrape is
+answered by whichever worker takes it. So the counters live in
+prometheus_client's multiprocess files when `PROMETHEUS_MULTIPROC_DIR` is
+set (gunicorn.conf.py sets it), and every scrape reports the totals of all
+workers, including ones that have been recycled. Without it (the development
+server) they are kept in this process.
+"""
+from __future__ import annotations
+
+import os
+from typing import Iterator
+
+from prometheus_client import CONTENT_TYPE_LATEST, CollectorRegistry, Counter, Gauge, Summary, generate_latest
+from prometheus_client.core import GaugeMetricFamily, Metric
+
+from cconv import ConversionStats
+
+CONTENT_TYPE = CONTENT_TYPE_LATEST
+
+
+class _WithHitRatio:
+    """A registry's metrics plus cconv_cache_hit_ratio, worked out from the
+    (already summed) hit and miss counters at scrape time."""
+
+    def __init__(self, registry: CollectorRegistry) -> None:
+        self.registry = registry
+
+    def collect(self) -> Iterator[Metric]:
+        hits, misses = {}, {}
+        for family in self.registry.collect():
+            for s in family.samples:
+                if s.name == "cconv_cache_hits_total":
+                    hits[s.labels["target"]] = hits.get(s.labels["target"], 0) + s.value
+                elif s.name == "cconv_cache_misses_total":
+                    misses[s.labels["target"]] = misses.get(s.labels["target"], 0) + s.value
+            yield family
+        ratio = GaugeMetricFamily("cconv_cache_hit_ratio", "Cache hits over lookups since the server started",
+                                  labels=["target"])
+        for target in sorted(set(hits) | set(misses)):
+            n = hits.get(target, 0) + misses.get(target, 0)
+            if n:
+                ratio.add_metric([target], hits.get(target, 0) / n)
+        if ratio.samples:
+            yield ratio
+
+
+class Metrics:
+    """Totals of every `ConversionStats` observed, across worker processes."""
+
+    def __init__(self) -> None:
+        self.multiprocess = bool(os.environ.get("PROMETHEUS_MULTIPROC_DIR"))
+        r = self.registry = CollectorRegistry()
+        t = ["target"]
+        self.conversions = Counter("cconv_conversions_total", "Conversions run (cache hits excluded)", t, registry=r)
+        self.timeouts = Counter("cconv_timeouts_total", "Conversions killed for running past the timeout", t,
+                                registry=r)
+        self.over_budgets = Counter("cconv_over_budget_total",
+                                    "Conversions past the time budget, answered with their input", t, registry=r)
+        self.seconds = Summary("cconv_conversion_seconds", "Wall time per conversion", t, registry=r)
+        self.input_bytes = Counter("cconv_input_bytes_total", "Source bytes converted", t, registry=r)
+        self.output_bytes = Counter("cconv_output_bytes_total", "Converted bytes produced", t, registry=r)
+        self.pass_seconds = Counter("cconv_pass_seconds_total", "Wall time spent in each pass", t + ["pass"],
+                                    registry=r)
+        self.rule_matches = Counter("cconv_rule_matches_total", "Matches rewritten by each rule", t + ["rule"],
+                                    registry=r)
+        self.type_map_size = Gauge("cconv_last_type_map_size",
+                                   "Names in the inferred type map of the last conversion", t, registry=r,
+                                   multiprocess_mode="mostrecent")
+        self.cache_hits = Counter("cconv_cache_hits_total", "Results served from the cache", t, registry=r)
+        self.cache_misses = Counter("cconv_cache_misses_total", "Cache lookups that had to convert", t, registry=r)
+        # each worker has its own LRU; the sum over the live ones
+        self.cache_entries = Gauge("cconv_cache_entries", "Results held in the workers' LRUs at their last lookup",
+                                   registry=r, multiprocess_mode="livesum")
+        self.not_modifieds = Counter("cconv_not_modified_total", "Requests answered 304 from If-None-Match",
+                                     registry=r)
+
+    def observe(self, st: ConversionStats) -> None:
+        t = st.target
+        self.conversions.labels(t).inc()
+        self.seconds.labels(t).observe(st.seconds)
+        self.input_bytes.labels(t).inc(st.bytes_in)
+        self.output_bytes.labels(t).inc(st.bytes_out)
+        self.pass_seconds.labels(t, "analysis").inc(st.analysis_seconds)
+        for name, sec in st.pass_seconds.items():
+            self.pass_seconds.labels(t, name).inc(sec)
+        for name, n in st.rule_matches.items():
+            if n:
+                self.rule_matches.labels(t, name).inc(n)
+        self.type_map_size.labels(t).set(st.type_map_size)
+
+    def cache_lookup(self, target: str, hit: bool, entries: int) -> None:
+        (self.cache_hits if hit else self.cache_misses).labels(target).inc()
+        self.cache_entries.set(entries)
+
+    def not_modified(self) -> None:
+        self.not_modifieds.inc()
+
+    def timed_out(self, target: str) -> None:
+        self.timeouts.labels(target).inc()
+
+    def over_budget(self, target: str) -> None:
+        self.over_budgets.labels(target).inc()
+
+    def render(self) -> bytes:
+        registry = self.registry
+        if self.multiprocess:
+            from prometheus_client import multiprocess
+            # the files of every worker, not this process's registry
+            registry = CollectorRegistry()
+            multiprocess.MultiProcessCollector(registry)
+        return generate_latest(_WithHitRatio(registry))
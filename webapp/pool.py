@@ -0,0 +1,109 @@
+"""Conversions in child processes, so a runaway one can be killed.
+
+Each web worker owns a few children that have `cconv` imported already and
+serve one conversion at a time over a pipe. A conversion that runs past the
+timeout has its child killed and replaced, and so does one whose child dies
+(`ConversionCrashed`); the other children, and the requests they are
+serving, are not affected. Running the regex passes in
+children also keeps them from contending for the web worker's GIL.
+
+With a time budget, a conversion that runs past it gives up by itself and
+returns its input (`stats.over_budget`), which costs no new child; the timeout
+is the backstop for a single pass that overruns the budget.
+"""
+from __future__ import annotations
+
+import multiprocessing
+import queue
+import signal
+import threading
+import warnings
+from typing import Optional, Tuple
+
+from cconv import ConversionError, ConversionStats, ConversionWarning, ConvertOptions, convert
+
+
+class ConversionTimeout(Exception):
+    pass
+
+
+class ConversionCrashed(Exception):
+    """The child serving the conversion died; it has been replaced."""
+
+
+def _serve(conn, budget: Optional[float]) -> None:
+    # don't run the web server's handlers (gunicorn's, say) in the child
+    for sig in (signal.SIGTERM, signal.SIGINT, signal.SIGQUIT, signal.SIGHUP):
+        signal.signal(sig, signal.SIG_DFL)
+    # the stats say so instead
+    warnings.simplefilter("ignore", ConversionWarning)
+    while True:
+        try:
+            code, target, options = conn.recv()
+        except EOFError:
+            return
+        try:
+            conn.send((True, convert(code, target, options, stats=True, budget=budget)))
+        except ConversionError as e:
+            # the input's fault, raised as it is in the web worker
+            conn.send((False, e))
+        except Exception as e:  # report it; the child stays usable
+            conn.send((False, f"{type(e).__name__}: {e}"))
+
+
+class _Child:
+    def __init__(self, mp, budget: Optional[float]) -> None:
+        self.conn, child_conn = mp.Pipe()
+        self.proc = mp.Process(target=_serve, args=(child_conn, budget), daemon=True)
+        self.proc.start()
+        child_conn.close()
+
+    def kill(self) -> None:
+        self.proc.kill()
+        self.proc.join()
+        self.conn.close()
+
+
+class ConversionPool:
+    """`size` child processes; `convert` blocks until one is free."""
+
+    def __init__(self, size: int, timeout: float, budget: Optional[float] = None) -> None:
+        self.size = size
+        self.timeout = timeout
+        self.budget = budget
+        self._mp = multiprocessing.get_context("fork")
+        self._idle: "queue.Queue[_Child]" = queue.Queue()
+        self._lock = threading.Lock()
+        self._started = False
+
+    def start(self) -> None:
+        # the children fork from the web worker, so start them before it
+        # runs request threads when possible (gunicorn's post_fork hook)
+        with self._lock:
+            if not self._started:
+                for _ in range(self.size):
+                    self._idle.put(_Child(self._mp, self.budget))
+                self._started = True
+
+    def convert(self, code: str, target: str,
+                options: Optional[ConvertOptions] = None) -> Tuple[str, ConversionStats]:
+        self.start()
+        child = self._idle.get()
+        try:
+            child.conn.send((code, target, options))
+            if not child.conn.poll(self.timeout):
+                child.kill()
+                child = _Child(self._mp, self.budget)
+                raise ConversionTimeout(f"conversion took longer than {self.timeout:g}s")
+            ok, result = child.conn.recv()
+        except (EOFError, OSError):
+            # the child died under us; replace it, and let the caller answer
+            # with a retryable error rather than the pipe's
+            child.kill()
+            child = _Child(self._mp, self.budget)
+            raise ConversionCrashed("the conversion process exited; it has been restarted") from None
+        finally:
+            self._idle.put(child)
+        if not ok:
+            raise result if isinstance(result, ConversionError) else RuntimeError(result)
+        return result
@@ -0,0 +1,2 @@
+"""WSGI entry point: `gunicorn -c webapp/gunicorn.conf.py webapp.wsgi:app`."""
+from webapp.app import app  # noqa: F401